@@ -39,6 +39,29 @@
 #include <stdint.h>
 #include <string.h>
 #endif
+#include <kern/endian.h>
+
+/*
+ * Copying is done a word (unsigned long) at a time where possible.
+ *
+ * MERGE(a, b, sh) takes two consecutive aligned words from memory and
+ * gives the word that starts SH bits into A, so a source that is not
+ * word-aligned can be read with aligned loads and shifted into place.
+ * Which way to shift depends on the byte order. SH is never 0 or a
+ * whole word.
+ */
+
+typedef unsigned long word_t;
+
+#define WORDSIZE	sizeof(word_t)
+#define WORDMASK	(WORDSIZE - 1)
+#define SMALLCOPY	(4 * WORDSIZE)	/* just do bytes below this */
+
+#if _BYTE_ORDER == _BIG_ENDIAN
+#define MERGE(a, b, sh) (((a) << (sh)) | ((b) >> (8 * WORDSIZE - (sh))))
+#else
+#define MERGE(a, b, sh) (((a) >> (sh)) | ((b) << (8 * WORDSIZE - (sh))))
+#endif
 
 /*
  * C standard function - copy a block of memory.
@@ -47,40 +70,92 @@
 void *
 memcpy(void *dst, const void *src, size_t len)
 {
-	size_t i;
+	unsigned char *d = dst;
+	const unsigned char *s = src;
+	word_t *dw;
+	const word_t *sw;
+	word_t a, b;
+	unsigned sh;
+	size_t n;
 
 	/*
 	 * memcpy does not support overlapping buffers, so always do it
 	 * forwards. (Don't change this without adjusting memmove.)
 	 *
-	 * For speedy copying, optimize the common case where both pointers
-	 * and the length are word-aligned, and copy word-at-a-time instead
-	 * of byte-at-a-time. Otherwise, copy by bytes.
+	 * Short copies go by bytes. Otherwise, copy bytes until the
+	 * destination is word-aligned; then copy words, unrolled by
+	 * eight, reading the source by words too even when it isn't
+	 * aligned the same way (see MERGE); then the last few bytes.
 	 *
-	 * The alignment logic below should be portable. We rely on
-	 * the compiler to be reasonably intelligent about optimizing
-	 * the divides and modulos out. Fortunately, it is.
+	 * Reading the source by aligned words can touch up to a word's
+	 * worth of bytes just outside it. They are always in the same
+	 * aligned word as a byte that is inside it, so they can't be on
+	 * a page that isn't mapped, and copyin and copyout are safe.
 	 */
 
-	if ((uintptr_t)dst % sizeof(long) == 0 &&
-	    (uintptr_t)src % sizeof(long) == 0 &&
-	    len % sizeof(long) == 0) {
+	if (len < SMALLCOPY) {
+		while (len-- > 0) {
+			*d++ = *s++;
+		}
+		return dst;
+	}
 
-		long *d = dst;
-		const long *s = src;
+	while ((uintptr_t)d & WORDMASK) {
+		*d++ = *s++;
+		len--;
+	}
 
-		for (i=0; i<len/sizeof(long); i++) {
-			d[i] = s[i];
+	dw = (word_t *)d;
+	n = len / WORDSIZE;
+	sh = 8 * ((uintptr_t)s & WORDMASK);
+
+	if (sh == 0) {
+		sw = (const word_t *)s;
+		for (; n >= 8; n -= 8) {
+			dw[0] = sw[0];
+			dw[1] = sw[1];
+			dw[2] = sw[2];
+			dw[3] = sw[3];
+			dw[4] = sw[4];
+			dw[5] = sw[5];
+			dw[6] = sw[6];
+			dw[7] = sw[7];
+			dw += 8;
+			sw += 8;
+		}
+		for (; n > 0; n--) {
+			*dw++ = *sw++;
 		}
 	}
 	else {
-		char *d = dst;
-		const char *s = src;
-
-		for (i=0; i<len; i++) {
-			d[i] = s[i];
+		/* The aligned word holding the first source byte. */
+		sw = (const word_t *)((uintptr_t)s & ~(uintptr_t)WORDMASK);
+		a = *sw++;
+		for (; n >= 4; n -= 4) {
+			b = sw[0];
+			dw[0] = MERGE(a, b, sh);
+			a = sw[1];
+			dw[1] = MERGE(b, a, sh);
+			b = sw[2];
+			dw[2] = MERGE(a, b, sh);
+			a = sw[3];
+			dw[3] = MERGE(b, a, sh);
+			dw += 4;
+			sw += 4;
+		}
+		for (; n > 0; n--) {
+			b = *sw++;
+			*dw++ = MERGE(a, b, sh);
+			a = b;
 		}
 	}
 
+	d = (unsigned char *)dw;
+	s += (len & ~WORDMASK);
+	len &= WORDMASK;
+	while (len-- > 0) {
+		*d++ = *s++;
+	}
+
 	return dst;
 }
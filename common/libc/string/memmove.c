@@ -39,6 +39,23 @@
 #include <stdint.h>
 #include <string.h>
 #endif
+#include <kern/endian.h>
+
+/*
+ * Word copying as in memcpy.c; look there for MERGE.
+ */
+
+typedef unsigned long word_t;
+
+#define WORDSIZE	sizeof(word_t)
+#define WORDMASK	(WORDSIZE - 1)
+#define SMALLCOPY	(4 * WORDSIZE)
+
+#if _BYTE_ORDER == _BIG_ENDIAN
+#define MERGE(a, b, sh) (((a) << (sh)) | ((b) >> (8 * WORDSIZE - (sh))))
+#else
+#define MERGE(a, b, sh) (((a) >> (sh)) | ((b) << (8 * WORDSIZE - (sh))))
+#endif
 
 /*
  * C standard function - copy a block of memory, handling overlapping
@@ -48,7 +65,13 @@
 void *
 memmove(void *dst, const void *src, size_t len)
 {
-	size_t i;
+	unsigned char *d;
+	const unsigned char *s;
+	word_t *dw;
+	const word_t *sw;
+	word_t a, b;
+	unsigned sh;
+	size_t n;
 
 	/*
 	 * If the buffers don't overlap, it doesn't matter what direction
@@ -84,34 +107,80 @@ memmove(void *dst, const void *src, size_t len)
 	}
 
 	/*
-	 * Copy by words in the common case. Look in memcpy.c for more
-	 * information.
+	 * Copy back to front the way memcpy copies front to back:
+	 * bytes until the end of the destination is word-aligned,
+	 * then words, then the bytes left at the start. Within each
+	 * group of words, the highest goes first, and every source
+	 * word is read before the destination word that might overlap
+	 * it is written.
 	 */
 
-	if ((uintptr_t)dst % sizeof(long) == 0 &&
-	    (uintptr_t)src % sizeof(long) == 0 &&
-	    len % sizeof(long) == 0) {
+	d = (unsigned char *)dst + len;
+	s = (const unsigned char *)src + len;
 
-		long *d = dst;
-		const long *s = src;
+	if (len < SMALLCOPY) {
+		while (len-- > 0) {
+			*--d = *--s;
+		}
+		return dst;
+	}
 
-		/*
-		 * The reason we copy index i-1 and test i>0 is that
-		 * i is unsigned -- so testing i>=0 doesn't work.
-		 */
+	while ((uintptr_t)d & WORDMASK) {
+		*--d = *--s;
+		len--;
+	}
 
-		for (i=len/sizeof(long); i>0; i--) {
-			d[i-1] = s[i-1];
+	dw = (word_t *)d;
+	n = len / WORDSIZE;
+	sh = 8 * ((uintptr_t)s & WORDMASK);
+
+	if (sh == 0) {
+		sw = (const word_t *)s;
+		for (; n >= 8; n -= 8) {
+			dw -= 8;
+			sw -= 8;
+			dw[7] = sw[7];
+			dw[6] = sw[6];
+			dw[5] = sw[5];
+			dw[4] = sw[4];
+			dw[3] = sw[3];
+			dw[2] = sw[2];
+			dw[1] = sw[1];
+			dw[0] = sw[0];
+		}
+		for (; n > 0; n--) {
+			*--dw = *--sw;
 		}
 	}
 	else {
-		char *d = dst;
-		const char *s = src;
-
-		for (i=len; i>0; i--) {
-			d[i-1] = s[i-1];
+		/* The aligned word holding the last source byte. */
+		sw = (const word_t *)((uintptr_t)s & ~(uintptr_t)WORDMASK);
+		b = *sw;
+		for (; n >= 4; n -= 4) {
+			dw -= 4;
+			sw -= 4;
+			a = sw[3];
+			dw[3] = MERGE(a, b, sh);
+			b = sw[2];
+			dw[2] = MERGE(b, a, sh);
+			a = sw[1];
+			dw[1] = MERGE(a, b, sh);
+			b = sw[0];
+			dw[0] = MERGE(b, a, sh);
+		}
+		for (; n > 0; n--) {
+			a = *--sw;
+			*--dw = MERGE(a, b, sh);
+			b = a;
 		}
 	}
 
+	d = (unsigned char *)dw;
+	s -= (len & ~WORDMASK);
+	len &= WORDMASK;
+	while (len-- > 0) {
+		*--d = *--s;
+	}
+
 	return dst;
 }
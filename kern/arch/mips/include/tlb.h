@@ -33,6 +33,10 @@
 /*
  * MIPS-specific TLB access functions.
  *
+ *   tlb_setasid: make the ASID field of ENTRYHI the current address
+ *        space ID. Only TLB entries with that ASID will match. The
+ *        other functions here leave the current ASID alone.
+ *
  *   tlb_random: write the TLB entry specified by ENTRYHI and ENTRYLO
  *        into a "random" TLB slot chosen by the processor.
  *
@@ -55,6 +59,7 @@
  *        ranges - these will never be matched.
  */
 
+void tlb_setasid(uint32_t entryhi);
 void tlb_random(uint32_t entryhi, uint32_t entrylo);
 void tlb_write(uint32_t entryhi, uint32_t entrylo, uint32_t index);
 void tlb_read(uint32_t *entryhi, uint32_t *entrylo, uint32_t index);
@@ -63,10 +68,10 @@ int tlb_probe(uint32_t entryhi, uint32_t entrylo);
 /*
  * TLB entry fields.
  *
- * Note that the MIPS has support for a 6-bit address space ID. In the
- * interests of simplicity, we don't use it. The fields related to it
- * (TLBLO_GLOBAL and TLBHI_PID) can be left always zero, as can the
- * bits that aren't assigned a meaning.
+ * The MIPS has support for a 6-bit address space ID (TLBHI_PID). An
+ * entry only matches while the ASID in c0_entryhi is the same as its
+ * own, unless TLBLO_GLOBAL is set; we never set it. The bits that
+ * aren't assigned a meaning can be left always zero.
  *
  * The TLBLO_DIRTY bit is actually a write privilege bit - it is not
  * ever set by the processor. If you set it, writes are permitted. If
@@ -78,7 +83,8 @@ int tlb_probe(uint32_t entryhi, uint32_t entrylo);
 
 /* Fields in the high-order word */
 #define TLBHI_VPAGE   0xfffff000
-/*      TLBHI_PID     0x00000fc0 */
+#define TLBHI_PID     0x00000fc0
+#define TLBHI_PIDSHIFT 6
 
 /* Fields in the low-order word */
 #define TLBLO_PPAGE   0xfffff000
@@ -101,5 +107,11 @@ int tlb_probe(uint32_t entryhi, uint32_t entrylo);
 
 #define NUM_TLB  64
 
+/*
+ * Number of distinct address space IDs.
+ */
+
+#define NUM_ASID 64
+
 
 #endif /* _MIPS_TLB_H_ */
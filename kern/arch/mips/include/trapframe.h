@@ -106,5 +106,11 @@ void mips_usermode(struct trapframe *tf);
 extern vaddr_t cpustacks[];
 extern vaddr_t cputhreads[];
 
+/*
+ * The page directory of each cpu's current address space, or 0, for
+ * the fast-path TLB refill. Maintained by the VM system.
+ */
+extern vaddr_t cpupagetables[];
+
 
 #endif /* _MIPS_TRAPFRAME_H_ */
@@ -30,12 +30,168 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/syscall.h>
+#include <endian.h>
 #include <lib.h>
+#include <copyinout.h>
 #include <mips/trapframe.h>
 #include <thread.h>
 #include <current.h>
 #include <syscall.h>
+#include <addrspace.h>
+#include <counter.h>
+#include <trace.h>
+#include <sysstat.h>
 
+#define SYSCALL_CALLS		0
+#define SYSCALL_ERRORS		1
+#define SYSCALL_UNKNOWN		2
+#define SYSCALL_NCOUNTERS	3
+
+static const char *const syscall_counter_names[SYSCALL_NCOUNTERS] = {
+	"calls",
+	"errors",
+	"unknown",
+};
+
+DEFCOUNTERS(syscall_counters, "syscall", syscall_counter_names,
+	    SYSCALL_NCOUNTERS);
+
+void
+syscall_bootstrap(void)
+{
+	counterset_register(&syscall_counters);
+}
+
+
+/*
+ * System call table.
+ *
+ * Each entry gives a stub that calls the handler, the call's name,
+ * the shape of its arguments as passed from user level, and how the
+ * result comes back. The shape is a string with one letter per
+ * argument, in order:
+ *
+ *    w   a 32-bit argument (int, pointer, size_t, ...)
+ *    d   a 64-bit argument (off_t)
+ *
+ * SR_32 and SR_64 handlers take, after their arguments, a pointer to
+ * where to put a 32-bit or 64-bit return value; SR_NONE handlers just
+ * return an error code, and SR_NORETURN ones do not return at all.
+ */
+
+#define SR_NONE		0
+#define SR_32		1
+#define SR_64		2
+#define SR_NORETURN	3
+
+#define SYSCALL_MAXWORDS	8	/* argument words from user level */
+
+/*
+ * What a stub gets: the user's argument words as they came in a0-a3
+ * and on the user stack, so 64-bit values are in aligned pairs; plus
+ * the trapframe and the return value slots.
+ */
+struct syscall_args {
+	uint32_t sa_words[SYSCALL_MAXWORDS];
+	struct trapframe *sa_tf;
+	int32_t sa_retval;
+	off_t sa_retval64;
+};
+
+struct syscall_desc {
+	int (*sd_stub)(struct syscall_args *);	/* NULL if not implemented */
+	const char *sd_name;
+	const char *sd_args;
+	unsigned sd_ret;
+};
+
+/*
+ * The stubs. Each unpacks the argument words and calls its handler
+ * through the handler's own prototype.
+ */
+static
+off_t
+syscall_arg64(const struct syscall_args *sa, unsigned i)
+{
+	uint64_t val;
+
+	join32to64(sa->sa_words[i], sa->sa_words[i+1], &val);
+	return (off_t)val;
+}
+
+#define ARG(i)		(sa->sa_words[i])
+#define ARGPTR(i)	((userptr_t)ARG(i))
+#define ARG64(i)	syscall_arg64(sa, i)
+
+#define SYSSTUB(sym, call) \
+	static int syscall_##sym(struct syscall_args *sa) \
+	{ \
+		return call; \
+	}
+
+SYSSTUB(fork,	   sys_fork(sa->sa_tf, &sa->sa_retval))
+SYSSTUB(vfork,	   sys_vfork(sa->sa_tf, &sa->sa_retval))
+SYSSTUB(execv,	   sys_execv(ARGPTR(0), ARGPTR(1)))
+#ifdef UW
+SYSSTUB(_exit,	   (sys__exit((int)ARG(0)), 0))
+SYSSTUB(waitpid,   sys_waitpid((pid_t)ARG(0), ARGPTR(1), (int)ARG(2),
+			       &sa->sa_retval))
+SYSSTUB(getpid,	   sys_getpid(&sa->sa_retval))
+SYSSTUB(write,	   sys_write((int)ARG(0), ARGPTR(1), ARG(2),
+			     &sa->sa_retval))
+#endif // UW
+SYSSTUB(sbrk,	   sys_sbrk((int)ARG(0), &sa->sa_retval))
+SYSSTUB(mmap,	   sys_mmap(ARGPTR(0), ARG(1), (int)ARG(2), (int)ARG(3),
+			    (int)ARG(4), ARG64(6), &sa->sa_retval))
+SYSSTUB(munmap,	   sys_munmap(ARGPTR(0), ARG(1)))
+SYSSTUB(msync,	   sys_msync(ARGPTR(0), ARG(1), (int)ARG(2)))
+SYSSTUB(open,	   sys_open(ARGPTR(0), (int)ARG(1), ARG(2),
+			    &sa->sa_retval))
+SYSSTUB(read,	   sys_read((int)ARG(0), ARGPTR(1), ARG(2),
+			    &sa->sa_retval))
+SYSSTUB(close,	   sys_close((int)ARG(0)))
+SYSSTUB(lseek,	   sys_lseek((int)ARG(0), ARG64(2), (int)ARG(4),
+			     &sa->sa_retval64))
+SYSSTUB(__time,	   sys___time(ARGPTR(0), ARGPTR(1)))
+SYSSTUB(nanosleep, sys_nanosleep((const_userptr_t)ARG(0), ARGPTR(1)))
+SYSSTUB(reboot,	   sys_reboot((int)ARG(0)))
+
+#define SYSCALL(sym, args, ret) \
+	[SYS_##sym] = { syscall_##sym, #sym, args, ret }
+
+static const struct syscall_desc syscall_table[] = {
+	SYSCALL(fork,		"",		SR_32),
+	SYSCALL(vfork,		"",		SR_32),
+	SYSCALL(execv,		"ww",		SR_NONE),
+#ifdef UW
+	SYSCALL(_exit,		"w",		SR_NORETURN),
+	SYSCALL(waitpid,	"www",		SR_32),
+	SYSCALL(getpid,		"",		SR_32),
+	SYSCALL(write,		"www",		SR_32),
+#endif // UW
+	SYSCALL(sbrk,		"w",		SR_32),
+	SYSCALL(mmap,		"wwwwwd",	SR_32),
+	SYSCALL(munmap,		"ww",		SR_NONE),
+	SYSCALL(msync,		"www",		SR_NONE),
+	SYSCALL(open,		"www",		SR_32),
+	SYSCALL(read,		"www",		SR_32),
+	SYSCALL(close,		"w",		SR_NONE),
+	SYSCALL(lseek,		"wdw",		SR_64),
+	SYSCALL(__time,		"ww",		SR_NONE),
+	SYSCALL(nanosleep,	"ww",		SR_NONE),
+	SYSCALL(reboot,		"w",		SR_NONE),
+};
+
+#define NSYSCALLS (sizeof(syscall_table) / sizeof(syscall_table[0]))
+
+const char *
+syscall_name(int callno)
+{
+	if (callno < 0 || (unsigned)callno >= NSYSCALLS) {
+		return NULL;
+	}
+	return syscall_table[callno].sd_name;
+}
 
 /*
  * System call dispatcher.
@@ -74,73 +230,98 @@
  * values) further arguments must be fetched from the user-level
  * stack, starting at sp+16 to skip over the slots for the
  * registerized values, with copyin().
+ *
+ * The dispatcher fetches as many argument words as the call's shape
+ * says, from the registers and then with one copyin from the stack,
+ * and the call's stub unpacks them for the handler.
+ *
+ * The return to user level goes by a shorter path than other traps;
+ * see exception-mips1.S.
  */
 void
 syscall(struct trapframe *tf)
 {
+	const struct syscall_desc *sd;
+	struct syscall_args sa;
+	const char *a;
+	unsigned nu;
 	int callno;
-	int32_t retval;
 	int err;
+	bool timed;
+	time_t startsecs;
+	uint32_t startnsecs;
 
 	KASSERT(curthread != NULL);
 	KASSERT(curthread->t_curspl == 0);
 	KASSERT(curthread->t_iplhigh_count == 0);
 
 	callno = tf->tf_v0;
+	counter_inc(&syscall_counters, SYSCALL_CALLS);
+	TRACE(TREV_SYSCALL, callno, 0);
+	timed = sysstat_enabled;
+	if (timed) {
+		sysstat_enter(callno, &startsecs, &startnsecs);
+	}
 
 	/*
-	 * Initialize retval to 0. Many of the system calls don't
+	 * Initialize sa_retval to 0. Many of the system calls don't
 	 * really return a value, just 0 for success and -1 on
-	 * error. Since retval is the value returned on success,
+	 * error. Since sa_retval is the value returned on success,
 	 * initialize it to 0 by default; thus it's not necessary to
 	 * deal with it except for calls that return other values, 
 	 * like write.
 	 */
 
-	retval = 0;
+	sa.sa_tf = tf;
+	sa.sa_retval = 0;
+	sa.sa_retval64 = 0;
 
-	switch (callno) {
-	    case SYS_reboot:
-		err = sys_reboot(tf->tf_a0);
-		break;
+	sd = NULL;
+	if (callno >= 0 && (unsigned)callno < NSYSCALLS &&
+	    syscall_table[callno].sd_stub != NULL) {
+		sd = &syscall_table[callno];
+	}
+	if (sd == NULL) {
+		kprintf("Unknown syscall %d\n", callno);
+		counter_inc(&syscall_counters, SYSCALL_UNKNOWN);
+		err = ENOSYS;
+		goto done;
+	}
 
-	    case SYS___time:
-		err = sys___time((userptr_t)tf->tf_a0,
-				 (userptr_t)tf->tf_a1);
-		break;
-#ifdef UW
-	case SYS_write:
-	  err = sys_write((int)tf->tf_a0,
-			  (userptr_t)tf->tf_a1,
-			  (int)tf->tf_a2,
-			  (int *)(&retval));
-	  break;
-	case SYS__exit:
-	  sys__exit((int)tf->tf_a0);
-	  /* sys__exit does not return, execution should not get here */
-	  panic("unexpected return from sys__exit");
-	  break;
-	case SYS_getpid:
-	  err = sys_getpid((pid_t *)&retval);
-	  break;
-	case SYS_waitpid:
-	  err = sys_waitpid((pid_t)tf->tf_a0,
-			    (userptr_t)tf->tf_a1,
-			    (int)tf->tf_a2,
-			    (pid_t *)&retval);
-	  break;
-#endif // UW
+	/* Count the user's argument words, with alignment padding. */
+	nu = 0;
+	for (a = sd->sd_args; *a != 0; a++) {
+		if (*a == 'w') {
+			nu++;
+		}
+		else if (*a == 'd') {
+			nu = ((nu + 1) & ~1U) + 2;
+		}
+	}
 
-	    /* Add stuff here */
- 
-	default:
-	  kprintf("Unknown syscall %d\n", callno);
-	  err = ENOSYS;
-	  break;
+	KASSERT(nu <= SYSCALL_MAXWORDS);
+	sa.sa_words[0] = tf->tf_a0;
+	sa.sa_words[1] = tf->tf_a1;
+	sa.sa_words[2] = tf->tf_a2;
+	sa.sa_words[3] = tf->tf_a3;
+	if (nu > 4) {
+		/* The rest are on the user stack, past the a0-a3 slots. */
+		err = copyin((userptr_t)(tf->tf_sp + 16), &sa.sa_words[4],
+			     (nu - 4) * sizeof(uint32_t));
+		if (err) {
+			goto done;
+		}
 	}
 
+	err = sd->sd_stub(&sa);
 
+	if (sd->sd_ret == SR_NORETURN) {
+		panic("unexpected return from syscall %d\n", callno);
+	}
+
+ done:
 	if (err) {
+		counter_inc(&syscall_counters, SYSCALL_ERRORS);
 		/*
 		 * Return the error code. This gets converted at
 		 * userlevel to a return value of -1 and the error
@@ -149,9 +330,15 @@ syscall(struct trapframe *tf)
 		tf->tf_v0 = err;
 		tf->tf_a3 = 1;      /* signal an error */
 	}
+	else if (sd->sd_ret == SR_64) {
+		/* Success, with a 64-bit value: high word in v0. */
+		tf->tf_v0 = (uint32_t)(sa.sa_retval64 >> 32);
+		tf->tf_v1 = (uint32_t)sa.sa_retval64;
+		tf->tf_a3 = 0;      /* signal no error */
+	}
 	else {
 		/* Success. */
-		tf->tf_v0 = retval;
+		tf->tf_v0 = sa.sa_retval;
 		tf->tf_a3 = 0;      /* signal no error */
 	}
 	
@@ -162,22 +349,60 @@ syscall(struct trapframe *tf)
 	
 	tf->tf_epc += 4;
 
+	TRACE(TREV_SYSRET, callno, err);
+	if (timed && sysstat_enabled) {
+		sysstat_exit(callno, err, startsecs, startnsecs);
+	}
+
 	/* Make sure the syscall code didn't forget to lower spl */
 	KASSERT(curthread->t_curspl == 0);
 	/* ...or leak any spinlocks */
 	KASSERT(curthread->t_iplhigh_count == 0);
 }
 
+/*
+ * Return 0 to user mode in a new child, given a copy of the parent's
+ * trapframe on our own stack.
+ */
+static
+void
+enter_child(struct trapframe *tf)
+{
+	tf->tf_v0 = 0;		/* child's return value */
+	tf->tf_a3 = 0;		/* signal no error */
+	tf->tf_epc += 4;	/* skip the syscall instruction */
+
+	as_activate();
+	mips_usermode(tf);
+}
+
 /*
  * Enter user mode for a newly forked process.
  *
- * This function is provided as a reminder. You need to write
- * both it and the code that calls it.
- *
- * Thus, you can trash it and do things another way if you prefer.
+ * TF is a kmalloc'd copy of the parent's trapframe made by sys_fork.
+ * Copy it onto our own stack, free it, and return 0 from fork in the
+ * child. Does not return.
  */
 void
 enter_forked_process(struct trapframe *tf)
 {
-	(void)tf;
+	struct trapframe mytf;
+
+	mytf = *tf;
+	kfree(tf);
+	enter_child(&mytf);
+}
+
+/*
+ * Enter user mode for a process made by vfork. TF is the parent's own
+ * trapframe; the parent sleeps until we exec or exit, so it is still
+ * there to be copied. Does not return.
+ */
+void
+enter_vforked_process(struct trapframe *tf)
+{
+	struct trapframe mytf;
+
+	mytf = *tf;
+	enter_child(&mytf);
 }
@@ -27,92 +27,544 @@
  * SUCH DAMAGE.
  */
 
+#define ADDRSPACEINLINE /* empty */
+
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/mman.h>
 #include <lib.h>
 #include <spl.h>
 #include <spinlock.h>
+#include <cpu.h>
 #include <proc.h>
 #include <current.h>
 #include <mips/tlb.h>
+#include <mips/trapframe.h>
 #include <addrspace.h>
 #include <vm.h>
+#include <clock.h>
+#include <vnode.h>
+#include <coremap.h>
+#include <pagecache.h>
+#include <uw-vmstats.h>
+#include <trace.h>
 
 /*
  * Dumb MIPS-only "VM system" that is intended to only be just barely
  * enough to struggle off the ground.
+ *
+ * It has grown page tables, so that pages can be shared (through the
+ * page cache and between processes) and faulted in lazily, but still
+ * has no swapping: when physical memory runs out, faults fail.
+ */
+
+/*
+ * The user stack starts out one page long and grows down as it is
+ * touched, to at most DUMBVM_STACKMAXPAGES (1M). The page below that
+ * is a guard: nothing is ever mapped there, so running off the end
+ * of the stack faults instead of scribbling on the heap.
+ */
+#define DUMBVM_STACKMAXPAGES 256
+#define DUMBVM_STACKLIMIT    (USERSTACK - DUMBVM_STACKMAXPAGES * PAGE_SIZE)
+#define DUMBVM_STACKGUARD    (DUMBVM_STACKLIMIT - PAGE_SIZE)
+
+/*
+ * mmap places mappings downward from here, leaving the space just
+ * below the stack free.
+ */
+#define DUMBVM_MMAPTOP       (USERSTACK - 0x01000000)
+
+#if DUMBVM_MMAPTOP > DUMBVM_STACKGUARD
+#error "DUMBVM_STACKMAXPAGES is too large"
+#endif
+
+/*
+ * Page tables. The user half of the address space is covered by a
+ * directory of PT_DIRSIZE pointers to second-level tables of
+ * PT_TABSIZE entries each (4M apiece); the second-level tables are
+ * allocated on first use.
+ *
+ * Entries are kept in EntryLo format: the physical page, plus
+ * TLBLO_VALID if it is mapped and TLBLO_DIRTY if it may be written.
+ * Loading the TLB is therefore just a copy.
+ *
+ * The UTLB refill handler in exception-mips1.S walks these tables
+ * itself, starting from cpupagetables[], and knows this layout; if
+ * you change it, change that too. Only misses on pages that aren't
+ * valid in the page table get as far as vm_fault.
  */
+#define PT_TABSIZE       (PAGE_SIZE / sizeof(uint32_t))
+#define PT_DIRSHIFT      22
+#define PT_DIRSIZE       (USERSPACETOP >> PT_DIRSHIFT)
+#define PT_DIRINDEX(va)  ((va) >> PT_DIRSHIFT)
+#define PT_TABINDEX(va)  (((va) >> 12) & (PT_TABSIZE - 1))
 
-/* under dumbvm, always have 48k of user stack */
-#define DUMBVM_STACKPAGES    12
+/*
+ * Address space IDs.
+ *
+ * TLB entries are tagged with the ASID of the address space they
+ * belong to, so switching address spaces only means switching ASIDs,
+ * and an address space's translations may still be in the TLB when
+ * it next runs.
+ *
+ * Each cpu hands out its own ASIDs, in order. The bits of asid_last
+ * above the ASID itself count generations: when a cpu runs out of
+ * ASIDs it flushes its TLB and starts a new generation, and any
+ * address space whose ASID there is from an older generation gets a
+ * new one when it next runs there. Generation 0 starts at ASID 1, so
+ * that 0 in as_asid means "none".
+ *
+ * A cpu's slots in asid_last, asid_cur and the other per-cpu arrays
+ * below are only touched by that cpu, with interrupts off. An address
+ * space's as_asid and as_cpus are protected by its as_lock: each cpu
+ * fills in its own as_asid slot and sets its as_cpus bit when it
+ * activates the address space, and clears the bit when it switches
+ * away. Any cpu may clear another's as_asid slot, to make it take a
+ * new ASID the next time it runs the address space (see as_shootdown).
+ */
+#define ASID_MASK        ((uint32_t)NUM_ASID - 1)
+#define ASID_GENMASK     (~ASID_MASK)
+#define ASID_FIRSTGEN    ((uint32_t)NUM_ASID)
+
+static uint32_t asid_last[MAXCPUS];	/* last ASID handed out */
+static uint32_t asid_cur[MAXCPUS];	/* current ASID, in EntryHi format */
+
+/*
+ * TLB replacement is round-robin: each cpu loads new translations
+ * into the slot after the one it loaded last, whether or not that
+ * slot is in use. After a flush this fills the TLB in order from the
+ * start, so only one slot has to be looked at per fault. Only touched
+ * by the cpu it belongs to, with interrupts off.
+ */
+static unsigned tlb_victim[MAXCPUS];
 
 /*
- * Wrap rma_stealmem in a spinlock.
+ * Page directory of each cpu's current address space, for the UTLB
+ * refill handler. Set along with the ASID.
  */
-static struct spinlock stealmem_lock = SPINLOCK_INITIALIZER;
+vaddr_t cpupagetables[MAXCPUS];
+
+/*
+ * The address space each cpu is running, if any, and each cpu's cpu
+ * structure, for sending it shootdowns.
+ */
+static struct addrspace *vm_curas[MAXCPUS];
+static struct cpu *vm_cpus[MAXCPUS];
 
 void
 vm_bootstrap(void)
 {
-	/* Do nothing. */
+	coremap_bootstrap();
+	vmstats_init();
 }
 
+/*
+ * Find the page table entry for VA. If there is no second-level table
+ * for it, make one if CREATE is set and otherwise return NULL. Also
+ * returns NULL if out of memory.
+ */
 static
-paddr_t
-getppages(unsigned long npages)
+uint32_t *
+pt_lookup(struct addrspace *as, vaddr_t va, bool create)
 {
-	paddr_t addr;
+	uint32_t *table;
+	unsigned i;
 
-	spinlock_acquire(&stealmem_lock);
+	KASSERT(va < USERSPACETOP);
 
-	addr = ram_stealmem(npages);
-	
-	spinlock_release(&stealmem_lock);
-	return addr;
+	table = as->as_pagetable[PT_DIRINDEX(va)];
+	if (table == NULL) {
+		if (!create) {
+			return NULL;
+		}
+		table = kmalloc(PAGE_SIZE);
+		if (table == NULL) {
+			return NULL;
+		}
+		for (i=0; i<PT_TABSIZE; i++) {
+			table[i] = 0;
+		}
+		as->as_pagetable[PT_DIRINDEX(va)] = table;
+	}
+	return &table[PT_TABINDEX(va)];
 }
 
-/* Allocate/free some kernel-space virtual pages */
-vaddr_t 
-alloc_kpages(int npages)
+/*
+ * Invalidate this CPU's TLB entry for VA, if any. Only meaningful for
+ * the current address space.
+ */
+static
+void
+vm_tlbinvalidate(vaddr_t va)
 {
-	paddr_t pa;
-	pa = getppages(npages);
-	if (pa==0) {
-		return 0;
+	int i, spl;
+
+	spl = splhigh();
+	i = tlb_probe(va | asid_cur[curcpu->c_number], 0);
+	if (i >= 0) {
+		tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
 	}
-	return PADDR_TO_KVADDR(pa);
+	splx(spl);
 }
 
-void 
-free_kpages(vaddr_t addr)
+/*
+ * Invalidate this CPU's whole TLB.
+ */
+static
+void
+vm_tlbflush(void)
 {
-	/* nothing - leak the memory. */
+	int i, spl;
+
+	/* Disable interrupts on this CPU while frobbing the TLB. */
+	spl = splhigh();
+
+	for (i=0; i<NUM_TLB; i++) {
+		tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+	}
+	tlb_victim[curcpu->c_number] = 0;
+	vmstats_inc(VMSTAT_TLB_INVALIDATE);
+
+	splx(spl);
+}
+
+/*
+ * Load the translation VA -> ELO for the current address space into
+ * the TLB, replacing the existing entry for VA if there is one.
+ * Returns true if there was no entry for VA, that is, if this was a
+ * real TLB miss and not a store to a page loaded read-only.
+ */
+static
+bool
+vm_tlbload(vaddr_t va, uint32_t elo)
+{
+	uint32_t ehi, oldhi, oldlo;
+	unsigned cpu;
+	int i, spl;
+
+	/* Disable interrupts on this CPU while frobbing the TLB. */
+	spl = splhigh();
+
+	cpu = curcpu->c_number;
+	ehi = va | asid_cur[cpu];
+	i = tlb_probe(ehi, 0);
+	if (i >= 0) {
+		tlb_write(ehi, elo, i);
+		splx(spl);
+		return false;
+	}
+
+	vmstats_inc(VMSTAT_TLB_FAULT);
+	i = tlb_victim[cpu];
+	tlb_victim[cpu] = (i + 1) % NUM_TLB;
+
+	tlb_read(&oldhi, &oldlo, i);
+	if (oldlo & TLBLO_VALID) {
+		vmstats_inc(VMSTAT_TLB_FAULT_REPLACE);
+	}
+	else {
+		vmstats_inc(VMSTAT_TLB_FAULT_FREE);
+	}
+
+	DEBUG(DB_VM, "dumbvm: 0x%x -> 0x%x\n", va, elo & TLBLO_PPAGE);
+	tlb_write(ehi, elo, i);
+	splx(spl);
+	return true;
+}
+
+/*
+ * Make AS take a new ASID the next time it runs on any cpu, this one
+ * included, so that nothing in any TLB can be used for it any more.
+ */
+static
+void
+as_dropasids(struct addrspace *as)
+{
+	unsigned i;
+
+	spinlock_acquire(&as->as_lock);
+	for (i=0; i<MAXCPUS; i++) {
+		as->as_asid[i] = 0;
+	}
+	spinlock_release(&as->as_lock);
+}
+
+/*
+ * TLB shootdown.
+ *
+ * Translations for the NUM pages at VAS in AS, the current address
+ * space, have been removed, and this cpu's TLB fixed up. Make sure no
+ * other cpu can still use them. If NUM is more than TLBSHOOTDOWN_MAX,
+ * only the first TLBSHOOTDOWN_MAX are in VAS and the other cpus flush
+ * everything instead.
+ *
+ * Only cpus holding an ASID for AS can have entries for it. For the
+ * ones not running AS at the moment, taking the ASID away is enough:
+ * AS gets a new one when it next runs there, and the stale entries
+ * just age out. This is the usual case, and costs no IPI. The cpus
+ * that are running AS right now get one batch each with all the
+ * pages in it, and we wait for them to finish.
+ */
+static
+void
+as_shootdown(struct addrspace *as, const vaddr_t *vas, unsigned num)
+{
+	struct tlbshootdown ts[TLBSHOOTDOWN_MAX];
+	unsigned tickets[MAXCPUS];
+	uint32_t targets;
+	time_t secs1, secs2, rsecs;
+	uint32_t nsecs1, nsecs2, rnsecs;
+	unsigned i, me;
+
+	KASSERT(num > 0);
+
+	targets = 0;
+	spinlock_acquire(&as->as_lock);
+	me = curcpu->c_number;
+	for (i=0; i<MAXCPUS; i++) {
+		if (i == me || as->as_asid[i] == 0) {
+			continue;
+		}
+		if (as->as_cpus & ((uint32_t)1 << i)) {
+			targets |= (uint32_t)1 << i;
+		}
+		else {
+			as->as_asid[i] = 0;
+			vmstats_inc(VMSTAT_TLB_SHOOTDOWN_DEFER);
+		}
+	}
+	spinlock_release(&as->as_lock);
+
+	if (targets == 0) {
+		return;
+	}
 
-	(void)addr;
+	for (i=0; i<num && i<TLBSHOOTDOWN_MAX; i++) {
+		ts[i].ts_addrspace = as;
+		ts[i].ts_vaddr = vas[i];
+	}
+
+	/* Queue all the batches before waiting for any of them. */
+	gettime(&secs1, &nsecs1);
+	for (i=0; i<MAXCPUS; i++) {
+		if (targets & ((uint32_t)1 << i)) {
+			tickets[i] = ipi_tlbshootdown_batch(vm_cpus[i], ts, num);
+			vmstats_inc(VMSTAT_TLB_SHOOTDOWN);
+		}
+	}
+	for (i=0; i<MAXCPUS; i++) {
+		if (targets & ((uint32_t)1 << i)) {
+			ipi_tlbshootdown_wait(vm_cpus[i], tickets[i]);
+		}
+	}
+	gettime(&secs2, &nsecs2);
+
+	getinterval(secs1, nsecs1, secs2, nsecs2, &rsecs, &rnsecs);
+	vmstats_add(VMSTAT_TLB_SHOOTDOWN_USEC, rsecs * 1000000 + rnsecs / 1000);
 }
 
+/*
+ * The receiving end of as_shootdown, called from the IPI handler.
+ */
 void
 vm_tlbshootdown_all(void)
 {
-	panic("dumbvm tried to do tlb shootdown?!\n");
+	vm_tlbflush();
 }
 
 void
 vm_tlbshootdown(const struct tlbshootdown *ts)
 {
-	(void)ts;
-	panic("dumbvm tried to do tlb shootdown?!\n");
+	uint32_t asid;
+	unsigned cpu;
+	int i, spl;
+
+	spl = splhigh();
+	cpu = curcpu->c_number;
+	asid = ts->ts_addrspace->as_asid[cpu];
+	if (asid != 0 && ((asid ^ asid_last[cpu]) & ASID_GENMASK) == 0) {
+		i = tlb_probe(ts->ts_vaddr |
+			      ((asid & ASID_MASK) << TLBHI_PIDSHIFT), 0);
+		if (i >= 0) {
+			tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+		}
+	}
+	splx(spl);
 }
 
+/*
+ * This cpu is no longer running whatever address space it was.
+ * Call with interrupts off.
+ */
+static
+void
+vm_leaveas(unsigned cpu)
+{
+	struct addrspace *as;
+
+	as = vm_curas[cpu];
+	if (as != NULL) {
+		spinlock_acquire(&as->as_lock);
+		as->as_cpus &= ~((uint32_t)1 << cpu);
+		spinlock_release(&as->as_lock);
+		vm_curas[cpu] = NULL;
+	}
+
+	/* Keep the refill handler away from tables that may go away. */
+	cpupagetables[cpu] = 0;
+}
+
+/*
+ * Find the region containing VA. If two regions share the page (as
+ * adjacent executable segments may), prefer a writable one.
+ */
+static
+struct vm_region *
+as_findregion(struct addrspace *as, vaddr_t va)
+{
+	struct vm_region *vr, *found;
+	unsigned i, num;
+
+	found = NULL;
+	num = vm_regionarray_num(&as->as_regions);
+	for (i=0; i<num; i++) {
+		vr = vm_regionarray_get(&as->as_regions, i);
+		if (va < vr->vr_base ||
+		    va >= vr->vr_base + vr->vr_npages * PAGE_SIZE) {
+			continue;
+		}
+		if (vr->vr_prot & PROT_WRITE) {
+			return vr;
+		}
+		if (found == NULL) {
+			found = vr;
+		}
+	}
+	return found;
+}
+
+/*
+ * Add a region to AS, handing it back in *RET if RET isn't NULL.
+ */
+static
 int
-vm_fault(int faulttype, vaddr_t faultaddress)
+as_addregion(struct addrspace *as, vaddr_t base, size_t npages, int prot,
+	     int flags, struct vnode *vn, off_t offset, struct vm_region **ret)
+{
+	struct vm_region *vr;
+	int result;
+
+	vr = kmalloc(sizeof(*vr));
+	if (vr == NULL) {
+		return ENOMEM;
+	}
+	vr->vr_base = base;
+	vr->vr_npages = npages;
+	vr->vr_prot = prot;
+	vr->vr_flags = flags;
+	vr->vr_vnode = vn;
+	vr->vr_offset = offset;
+
+	result = vm_regionarray_add(&as->as_regions, vr, NULL);
+	if (result) {
+		kfree(vr);
+		return result;
+	}
+	if (vn != NULL) {
+		VOP_INCREF(vn);
+	}
+	if (ret != NULL) {
+		*ret = vr;
+	}
+	return 0;
+}
+
+static
+void
+as_freeregion(struct vm_region *vr)
+{
+	if (vr->vr_vnode != NULL) {
+		VOP_DECREF(vr->vr_vnode);
+	}
+	kfree(vr);
+}
+
+/*
+ * Get a physical page for VA, which lies in region VR, and enter it
+ * in the page table at PTE. Sets *STAT to the vmstat that describes
+ * where the page came from: zero-fill, a read from the file, or (for
+ * a page already in the page cache) memory, which counts as a reload.
+ */
+static
+int
+vm_fillpage(struct addrspace *as, struct vm_region *vr, vaddr_t va,
+	    int faulttype, uint32_t *pte, unsigned *stat)
+{
+	paddr_t pa, cachepa;
+	off_t offset;
+	bool writable, wasread;
+	int result;
+
+	/* While loading, everything is writable so load_elf can fill it. */
+	writable = (vr->vr_prot & PROT_WRITE) || as->as_loading;
+
+	if (vr->vr_vnode == NULL) {
+		pa = page_alloc();
+		if (pa == 0) {
+			return ENOMEM;
+		}
+		bzero((void *)PADDR_TO_KVADDR(pa), PAGE_SIZE);
+		*stat = VMSTAT_PAGE_FAULT_ZERO;
+	}
+	else {
+		offset = vr->vr_offset + (va - vr->vr_base);
+		result = pagecache_getpage(vr->vr_vnode, offset, &cachepa,
+					   &wasread);
+		if (result) {
+			return result;
+		}
+		*stat = wasread ? VMSTAT_PAGE_FAULT_DISK : VMSTAT_TLB_RELOAD;
+
+		if (vr->vr_flags & MAP_SHARED) {
+			/*
+			 * Map the cache page itself. Map it read-only
+			 * until it is actually written, so that the
+			 * cache learns which pages are dirty.
+			 */
+			pa = cachepa;
+			if (faulttype == VM_FAULT_READ) {
+				writable = false;
+			}
+			else if (writable) {
+				pagecache_markdirty(vr->vr_vnode, offset);
+			}
+		}
+		else {
+			pa = page_alloc();
+			if (pa == 0) {
+				page_decref(cachepa);
+				return ENOMEM;
+			}
+			memmove((void *)PADDR_TO_KVADDR(pa),
+				(const void *)PADDR_TO_KVADDR(cachepa),
+				PAGE_SIZE);
+			page_decref(cachepa);
+		}
+	}
+
+	*pte = pa | TLBLO_VALID | (writable ? TLBLO_DIRTY : 0);
+	return 0;
+}
+
+static
+int
+vm_dofault(int faulttype, vaddr_t faultaddress)
 {
-	vaddr_t vbase1, vtop1, vbase2, vtop2, stackbase, stacktop;
-	paddr_t paddr;
-	int i;
-	uint32_t ehi, elo;
 	struct addrspace *as;
-	int spl;
+	struct vm_region *vr;
+	uint32_t *pte;
+	unsigned stat;
+	int result;
 
 	faultaddress &= PAGE_FRAME;
 
@@ -120,8 +572,6 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 
 	switch (faulttype) {
 	    case VM_FAULT_READONLY:
-		/* We always create pages read-write, so we can't get this */
-		panic("dumbvm: got VM_FAULT_READONLY\n");
 	    case VM_FAULT_READ:
 	    case VM_FAULT_WRITE:
 		break;
@@ -147,79 +597,109 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 		return EFAULT;
 	}
 
-	/* Assert that the address space has been set up properly. */
-	KASSERT(as->as_vbase1 != 0);
-	KASSERT(as->as_pbase1 != 0);
-	KASSERT(as->as_npages1 != 0);
-	KASSERT(as->as_vbase2 != 0);
-	KASSERT(as->as_pbase2 != 0);
-	KASSERT(as->as_npages2 != 0);
-	KASSERT(as->as_stackpbase != 0);
-	KASSERT((as->as_vbase1 & PAGE_FRAME) == as->as_vbase1);
-	KASSERT((as->as_pbase1 & PAGE_FRAME) == as->as_pbase1);
-	KASSERT((as->as_vbase2 & PAGE_FRAME) == as->as_vbase2);
-	KASSERT((as->as_pbase2 & PAGE_FRAME) == as->as_pbase2);
-	KASSERT((as->as_stackpbase & PAGE_FRAME) == as->as_stackpbase);
-
-	vbase1 = as->as_vbase1;
-	vtop1 = vbase1 + as->as_npages1 * PAGE_SIZE;
-	vbase2 = as->as_vbase2;
-	vtop2 = vbase2 + as->as_npages2 * PAGE_SIZE;
-	stackbase = USERSTACK - DUMBVM_STACKPAGES * PAGE_SIZE;
-	stacktop = USERSTACK;
-
-	if (faultaddress >= vbase1 && faultaddress < vtop1) {
-		paddr = (faultaddress - vbase1) + as->as_pbase1;
-	}
-	else if (faultaddress >= vbase2 && faultaddress < vtop2) {
-		paddr = (faultaddress - vbase2) + as->as_pbase2;
-	}
-	else if (faultaddress >= stackbase && faultaddress < stacktop) {
-		paddr = (faultaddress - stackbase) + as->as_stackpbase;
+	if (faultaddress >= USERSPACETOP) {
+		return EFAULT;
+	}
+
+	vr = as_findregion(as, faultaddress);
+	if (vr == NULL && as->as_stack != NULL &&
+	    faultaddress >= DUMBVM_STACKLIMIT &&
+	    faultaddress < as->as_stack->vr_base) {
+		/* Grow the stack down to cover the fault. */
+		vr = as->as_stack;
+		vr->vr_npages += (vr->vr_base - faultaddress) / PAGE_SIZE;
+		vr->vr_base = faultaddress;
 	}
-	else {
+	if (vr == NULL || vr->vr_prot == PROT_NONE) {
+		return EFAULT;
+	}
+	if (faulttype != VM_FAULT_READ && (vr->vr_prot & PROT_WRITE) == 0 &&
+	    !as->as_loading) {
 		return EFAULT;
 	}
 
-	/* make sure it's page-aligned */
-	KASSERT((paddr & PAGE_FRAME) == paddr);
+	pte = pt_lookup(as, faultaddress, true);
+	if (pte == NULL) {
+		return ENOMEM;
+	}
 
-	/* Disable interrupts on this CPU while frobbing the TLB. */
-	spl = splhigh();
+	if ((*pte & TLBLO_VALID) == 0) {
+		result = vm_fillpage(as, vr, faultaddress, faulttype, pte,
+				     &stat);
+		if (result) {
+			return result;
+		}
+	}
+	else {
+		stat = VMSTAT_TLB_RELOAD;
+		if (faulttype == VM_FAULT_READONLY) {
+			/* First store to a page mapped clean. */
+			if (vr->vr_vnode != NULL &&
+			    (vr->vr_flags & MAP_SHARED)) {
+				pagecache_markdirty(vr->vr_vnode,
+					vr->vr_offset +
+					(faultaddress - vr->vr_base));
+			}
+			*pte |= TLBLO_DIRTY;
+		}
+	}
 
-	for (i=0; i<NUM_TLB; i++) {
-		tlb_read(&ehi, &elo, i);
-		if (elo & TLBLO_VALID) {
-			continue;
+	/*
+	 * Only real misses are classified, so that TLB faults add up
+	 * to reloads plus page faults. Misses on valid entries are
+	 * normally refilled by the UTLB handler without coming here,
+	 * and are not counted at all.
+	 */
+	if (vm_tlbload(faultaddress, *pte)) {
+		vmstats_inc(stat);
+		if (stat == VMSTAT_PAGE_FAULT_DISK) {
+			vmstats_inc(VMSTAT_ELF_FILE_READ);
 		}
-		ehi = faultaddress;
-		elo = paddr | TLBLO_DIRTY | TLBLO_VALID;
-		DEBUG(DB_VM, "dumbvm: 0x%x -> 0x%x\n", faultaddress, paddr);
-		tlb_write(ehi, elo, i);
-		splx(spl);
-		return 0;
 	}
+	return 0;
+}
 
-	kprintf("dumbvm: Ran out of TLB entries - cannot handle page fault\n");
-	splx(spl);
-	return EFAULT;
+int
+vm_fault(int faulttype, vaddr_t faultaddress)
+{
+	int result;
+
+	TRACE(TREV_FAULT, faultaddress, faulttype);
+	result = vm_dofault(faulttype, faultaddress);
+	TRACE(TREV_FAULTDONE, faultaddress, result);
+	return result;
 }
 
 struct addrspace *
 as_create(void)
 {
-	struct addrspace *as = kmalloc(sizeof(struct addrspace));
+	struct addrspace *as;
+	unsigned i;
+
+	as = kmalloc(sizeof(struct addrspace));
 	if (as==NULL) {
 		return NULL;
 	}
 
-	as->as_vbase1 = 0;
-	as->as_pbase1 = 0;
-	as->as_npages1 = 0;
-	as->as_vbase2 = 0;
-	as->as_pbase2 = 0;
-	as->as_npages2 = 0;
-	as->as_stackpbase = 0;
+	as->as_pagetable = kmalloc(PT_DIRSIZE * sizeof(uint32_t *));
+	if (as->as_pagetable == NULL) {
+		kfree(as);
+		return NULL;
+	}
+	for (i=0; i<PT_DIRSIZE; i++) {
+		as->as_pagetable[i] = NULL;
+	}
+
+	vm_regionarray_init(&as->as_regions);
+	as->as_loading = false;
+	as->as_heap = NULL;
+	as->as_heapbreak = 0;
+	as->as_stack = NULL;
+	for (i=0; i<MAXCPUS; i++) {
+		as->as_asid[i] = 0;
+	}
+	as->as_cpus = 0;
+	spinlock_init(&as->as_lock);
 
 	return as;
 }
@@ -227,37 +707,117 @@ as_create(void)
 void
 as_destroy(struct addrspace *as)
 {
+	struct vm_region *vr;
+	uint32_t *table;
+	unsigned i, j, num;
+	int spl;
+
+	/* Nothing may be running it, but this cpu may not know yet. */
+	spl = splhigh();
+	if (vm_curas[curcpu->c_number] == as) {
+		vm_leaveas(curcpu->c_number);
+	}
+	splx(spl);
+	KASSERT(as->as_cpus == 0);
+
+	/*
+	 * Drop the pages before the regions, so that the last
+	 * reference to a mapped file doesn't write back its cache
+	 * while we still hold pages of it.
+	 */
+	for (i=0; i<PT_DIRSIZE; i++) {
+		table = as->as_pagetable[i];
+		if (table == NULL) {
+			continue;
+		}
+		for (j=0; j<PT_TABSIZE; j++) {
+			if (table[j] & TLBLO_VALID) {
+				page_decref(table[j] & TLBLO_PPAGE);
+			}
+		}
+		kfree(table);
+	}
+	kfree(as->as_pagetable);
+
+	num = vm_regionarray_num(&as->as_regions);
+	for (i=0; i<num; i++) {
+		vr = vm_regionarray_get(&as->as_regions, i);
+		as_freeregion(vr);
+	}
+	vm_regionarray_setsize(&as->as_regions, 0);
+	vm_regionarray_cleanup(&as->as_regions);
+
+	spinlock_cleanup(&as->as_lock);
 	kfree(as);
 }
 
 void
 as_activate(void)
 {
-	int i, spl;
 	struct addrspace *as;
+	unsigned cpu;
+	uint32_t asid;
+	int spl;
 
 	as = curproc_getas();
 #ifdef UW
         /* Kernel threads don't have an address spaces to activate */
 #endif
 	if (as == NULL) {
+		as_deactivate();
 		return;
 	}
 
 	/* Disable interrupts on this CPU while frobbing the TLB. */
 	spl = splhigh();
 
-	for (i=0; i<NUM_TLB; i++) {
-		tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+	cpu = curcpu->c_number;
+	vm_cpus[cpu] = curcpu->c_self;
+	if (vm_curas[cpu] != as) {
+		vm_leaveas(cpu);
 	}
 
+	spinlock_acquire(&as->as_lock);
+	asid = as->as_asid[cpu];
+	if (asid == 0 || ((asid ^ asid_last[cpu]) & ASID_GENMASK) != 0) {
+		/* No ASID from this generation; hand out the next one. */
+		asid = ++asid_last[cpu];
+		if ((asid & ASID_MASK) == 0) {
+			/* All used up: flush and start a new generation. */
+			if (asid == 0) {
+				asid = ASID_FIRSTGEN;
+				asid_last[cpu] = asid;
+			}
+			vm_tlbflush();
+			vmstats_inc(VMSTAT_ASID_ROLLOVER);
+		}
+		else {
+			vmstats_inc(VMSTAT_TLB_FLUSH_AVOIDED);
+		}
+		as->as_asid[cpu] = asid;
+	}
+	else {
+		vmstats_inc(VMSTAT_TLB_FLUSH_AVOIDED);
+	}
+	as->as_cpus |= (uint32_t)1 << cpu;
+	spinlock_release(&as->as_lock);
+
+	vm_curas[cpu] = as;
+	asid_cur[cpu] = (asid & ASID_MASK) << TLBHI_PIDSHIFT;
+	tlb_setasid(asid_cur[cpu]);
+	cpupagetables[cpu] = (vaddr_t)as->as_pagetable;
+
 	splx(spl);
 }
 
 void
 as_deactivate(void)
 {
-	/* nothing */
+	int spl;
+
+	spl = splhigh();
+	vm_leaveas(curcpu->c_number);
+	splx(spl);
 }
 
 int
@@ -265,6 +825,7 @@ as_define_region(struct addrspace *as, vaddr_t vaddr, size_t sz,
 		 int readable, int writeable, int executable)
 {
 	size_t npages; 
+	int prot;
 
 	/* Align the region. First, the base... */
 	sz += vaddr & ~(vaddr_t)PAGE_FRAME;
@@ -275,119 +836,488 @@ as_define_region(struct addrspace *as, vaddr_t vaddr, size_t sz,
 
 	npages = sz / PAGE_SIZE;
 
-	/* We don't use these - all pages are read-write */
-	(void)readable;
-	(void)writeable;
-	(void)executable;
+	prot = (readable ? PROT_READ : 0) |
+		(writeable ? PROT_WRITE : 0) |
+		(executable ? PROT_EXEC : 0);
+
+	return as_addregion(as, vaddr, npages, prot, MAP_PRIVATE, NULL, 0,
+			    NULL);
+}
 
-	if (as->as_vbase1 == 0) {
-		as->as_vbase1 = vaddr;
-		as->as_npages1 = npages;
-		return 0;
+/*
+ * Fill every page of region VR that isn't already present.
+ */
+static
+int
+as_fillregion(struct addrspace *as, struct vm_region *vr)
+{
+	vaddr_t va;
+	uint32_t *pte;
+	unsigned stat;
+	size_t i;
+	int result;
+
+	for (i=0; i<vr->vr_npages; i++) {
+		va = vr->vr_base + i * PAGE_SIZE;
+		pte = pt_lookup(as, va, true);
+		if (pte == NULL) {
+			return ENOMEM;
+		}
+		if (*pte & TLBLO_VALID) {
+			continue;
+		}
+		result = vm_fillpage(as, vr, va, VM_FAULT_WRITE, pte, &stat);
+		if (result) {
+			return result;
+		}
+	}
+	return 0;
+}
+
+int
+as_prepare_load(struct addrspace *as)
+{
+	unsigned i, num;
+	int result;
+
+	/*
+	 * The executable's segments are still allocated up front, as
+	 * load_elf reads straight into them.
+	 */
+	as->as_loading = true;
+	num = vm_regionarray_num(&as->as_regions);
+	for (i=0; i<num; i++) {
+		result = as_fillregion(as,
+				vm_regionarray_get(&as->as_regions, i));
+		if (result) {
+			return result;
+		}
+	}
+	return 0;
+}
+
+int
+as_complete_load(struct addrspace *as)
+{
+	struct vm_region *vr;
+	uint32_t *pte;
+	vaddr_t va, heapbase;
+	unsigned i, num;
+	size_t j;
+	int result;
+
+	as->as_loading = false;
+
+	/* The heap starts out empty, just above the highest segment. */
+	heapbase = 0;
+	num = vm_regionarray_num(&as->as_regions);
+	for (i=0; i<num; i++) {
+		vr = vm_regionarray_get(&as->as_regions, i);
+		if (vr->vr_base + vr->vr_npages * PAGE_SIZE > heapbase) {
+			heapbase = vr->vr_base + vr->vr_npages * PAGE_SIZE;
+		}
+	}
+	result = as_addregion(as, heapbase, 0, PROT_READ | PROT_WRITE,
+			      MAP_PRIVATE, NULL, 0, &as->as_heap);
+	if (result) {
+		return result;
 	}
+	as->as_heapbreak = heapbase;
 
-	if (as->as_vbase2 == 0) {
-		as->as_vbase2 = vaddr;
-		as->as_npages2 = npages;
-		return 0;
+	/* Now write-protect the read-only segments. */
+	num = vm_regionarray_num(&as->as_regions);
+	for (i=0; i<num; i++) {
+		vr = vm_regionarray_get(&as->as_regions, i);
+		if (vr->vr_prot & PROT_WRITE) {
+			continue;
+		}
+		for (j=0; j<vr->vr_npages; j++) {
+			va = vr->vr_base + j * PAGE_SIZE;
+			if (as_findregion(as, va)->vr_prot & PROT_WRITE) {
+				continue;
+			}
+			pte = pt_lookup(as, va, false);
+			if (pte != NULL) {
+				*pte &= ~(uint32_t)TLBLO_DIRTY;
+			}
+		}
 	}
 
 	/*
-	 * Support for more than two regions is not available.
+	 * Drop any writable translations load_elf left behind, by
+	 * switching to a fresh ASID rather than flushing the TLB.
 	 */
-	kprintf("dumbvm: Warning: too many regions\n");
-	return EUNIMP;
+	as_dropasids(as);
+	if (as == curproc_getas()) {
+		as_activate();
+	}
+	return 0;
 }
 
-static
-void
-as_zero_region(paddr_t paddr, unsigned npages)
+int
+as_define_stack(struct addrspace *as, vaddr_t *stackptr)
 {
-	bzero((void *)PADDR_TO_KVADDR(paddr), npages * PAGE_SIZE);
+	int result;
+
+	result = as_addregion(as, USERSTACK - PAGE_SIZE, 1,
+			      PROT_READ | PROT_WRITE, MAP_PRIVATE, NULL, 0,
+			      &as->as_stack);
+	if (result) {
+		return result;
+	}
+
+	*stackptr = USERSTACK;
+	return 0;
 }
 
 int
-as_prepare_load(struct addrspace *as)
+as_copy(struct addrspace *old, struct addrspace **ret)
 {
-	KASSERT(as->as_pbase1 == 0);
-	KASSERT(as->as_pbase2 == 0);
-	KASSERT(as->as_stackpbase == 0);
+	struct addrspace *new;
+	struct vm_region *vr, *newvr;
+	uint32_t *table, *pte;
+	vaddr_t va;
+	paddr_t pa, newpa;
+	unsigned i, j, num;
+	int result;
+
+	/*
+	 * Shared anonymous memory has no backing object for the two
+	 * processes to fault pages in from, so fault in all of it now
+	 * and share the frames.
+	 */
+	num = vm_regionarray_num(&old->as_regions);
+	for (i=0; i<num; i++) {
+		vr = vm_regionarray_get(&old->as_regions, i);
+		if (vr->vr_vnode == NULL && (vr->vr_flags & MAP_SHARED)) {
+			result = as_fillregion(old, vr);
+			if (result) {
+				return result;
+			}
+		}
+	}
 
-	as->as_pbase1 = getppages(as->as_npages1);
-	if (as->as_pbase1 == 0) {
+	new = as_create();
+	if (new==NULL) {
 		return ENOMEM;
 	}
 
-	as->as_pbase2 = getppages(as->as_npages2);
-	if (as->as_pbase2 == 0) {
+	for (i=0; i<num; i++) {
+		vr = vm_regionarray_get(&old->as_regions, i);
+		result = as_addregion(new, vr->vr_base, vr->vr_npages,
+				      vr->vr_prot, vr->vr_flags,
+				      vr->vr_vnode, vr->vr_offset, &newvr);
+		if (result) {
+			as_destroy(new);
+			return result;
+		}
+		if (vr == old->as_heap) {
+			new->as_heap = newvr;
+		}
+		if (vr == old->as_stack) {
+			new->as_stack = newvr;
+		}
+	}
+	new->as_heapbreak = old->as_heapbreak;
+
+	/*
+	 * Shared pages are shared with the child; private pages are
+	 * copied. Pages not yet faulted in stay that way.
+	 */
+	for (i=0; i<PT_DIRSIZE; i++) {
+		table = old->as_pagetable[i];
+		if (table == NULL) {
+			continue;
+		}
+		for (j=0; j<PT_TABSIZE; j++) {
+			if ((table[j] & TLBLO_VALID) == 0) {
+				continue;
+			}
+			va = (i << PT_DIRSHIFT) | (j * PAGE_SIZE);
+			pte = pt_lookup(new, va, true);
+			if (pte == NULL) {
+				as_destroy(new);
+				return ENOMEM;
+			}
+
+			pa = table[j] & TLBLO_PPAGE;
+			vr = as_findregion(old, va);
+			KASSERT(vr != NULL);
+			if (vr->vr_flags & MAP_SHARED) {
+				page_incref(pa);
+				*pte = table[j];
+				continue;
+			}
+
+			newpa = page_alloc();
+			if (newpa == 0) {
+				as_destroy(new);
+				return ENOMEM;
+			}
+			memmove((void *)PADDR_TO_KVADDR(newpa),
+				(const void *)PADDR_TO_KVADDR(pa),
+				PAGE_SIZE);
+			*pte = newpa | (table[j] & ~(uint32_t)TLBLO_PPAGE);
+		}
+	}
+
+	*ret = new;
+	return 0;
+}
+
+int
+as_mmap(struct addrspace *as, size_t len, int prot, int flags,
+	struct vnode *vn, off_t offset, vaddr_t *ret)
+{
+	struct vm_region *vr;
+	vaddr_t base, top;
+	size_t npages;
+	unsigned i, num;
+	int result;
+
+	KASSERT(len > 0);
+	if (len > DUMBVM_MMAPTOP) {
 		return ENOMEM;
 	}
+	npages = DIVROUNDUP(len, PAGE_SIZE);
 
-	as->as_stackpbase = getppages(DUMBVM_STACKPAGES);
-	if (as->as_stackpbase == 0) {
+	/*
+	 * First fit, working down from DUMBVM_MMAPTOP: whenever the
+	 * candidate overlaps a region, retry just below that region.
+	 * Page 0 is never handed out.
+	 */
+	top = DUMBVM_MMAPTOP;
+ retry:
+	if (npages * PAGE_SIZE > top - PAGE_SIZE) {
 		return ENOMEM;
 	}
-	
-	as_zero_region(as->as_pbase1, as->as_npages1);
-	as_zero_region(as->as_pbase2, as->as_npages2);
-	as_zero_region(as->as_stackpbase, DUMBVM_STACKPAGES);
+	base = top - npages * PAGE_SIZE;
+	num = vm_regionarray_num(&as->as_regions);
+	for (i=0; i<num; i++) {
+		vr = vm_regionarray_get(&as->as_regions, i);
+		if (vr->vr_base < top &&
+		    vr->vr_base + vr->vr_npages * PAGE_SIZE > base) {
+			top = vr->vr_base;
+			goto retry;
+		}
+	}
+
+	result = as_addregion(as, base, npages, prot, flags, vn, offset,
+			      NULL);
+	if (result) {
+		return result;
+	}
 
+	*ret = base;
 	return 0;
 }
 
+/*
+ * Drop the pages in [START, END) of the current address space, and
+ * their translations.
+ */
+static
+void
+as_unmappages(struct addrspace *as, vaddr_t start, vaddr_t end)
+{
+	vaddr_t va, vas[TLBSHOOTDOWN_MAX];
+	uint32_t *pte;
+	unsigned num;
+
+	num = 0;
+	for (va = start; va < end; va += PAGE_SIZE) {
+		pte = pt_lookup(as, va, false);
+		if (pte == NULL || (*pte & TLBLO_VALID) == 0) {
+			continue;
+		}
+		page_decref(*pte & TLBLO_PPAGE);
+		*pte = 0;
+		vm_tlbinvalidate(va);
+		if (num < TLBSHOOTDOWN_MAX) {
+			vas[num] = va;
+		}
+		num++;
+	}
+	if (num > 0) {
+		as_shootdown(as, vas, num);
+	}
+}
+
 int
-as_complete_load(struct addrspace *as)
+as_munmap(struct addrspace *as, vaddr_t addr, size_t len)
 {
-	(void)as;
+	struct vm_region *vr;
+	vaddr_t end, vrend;
+	unsigned i;
+	int result;
+
+	if ((addr & ~(vaddr_t)PAGE_FRAME) != 0 || len == 0 ||
+	    addr >= USERSPACETOP || len > USERSPACETOP - addr) {
+		return EINVAL;
+	}
+	end = addr + ROUNDUP(len, PAGE_SIZE);
+
+	/* The heap belongs to sbrk, and the stack to the fault handler. */
+	if (as->as_heap != NULL && addr < as->as_heapbreak &&
+	    end > as->as_heap->vr_base) {
+		return EINVAL;
+	}
+	if (end > DUMBVM_STACKGUARD) {
+		return EINVAL;
+	}
+
+	/*
+	 * If the range is strictly inside a region, the region is
+	 * split in two. Make the upper half first, as that is the only
+	 * step that can fail.
+	 */
+	vr = as_findregion(as, addr);
+	if (vr != NULL) {
+		vrend = vr->vr_base + vr->vr_npages * PAGE_SIZE;
+		if (vr->vr_base < addr && vrend > end) {
+			result = as_addregion(as, end,
+					(vrend - end) / PAGE_SIZE,
+					vr->vr_prot, vr->vr_flags,
+					vr->vr_vnode,
+					vr->vr_offset + (end - vr->vr_base),
+					NULL);
+			if (result) {
+				return result;
+			}
+		}
+	}
+
+	as_unmappages(as, addr, end);
+
+	/* Trim or remove every region that overlaps the range. */
+	i = 0;
+	while (i < vm_regionarray_num(&as->as_regions)) {
+		vr = vm_regionarray_get(&as->as_regions, i);
+		vrend = vr->vr_base + vr->vr_npages * PAGE_SIZE;
+		if (vrend <= addr || vr->vr_base >= end) {
+			i++;
+			continue;
+		}
+		if (vr->vr_base >= addr && vrend <= end) {
+			vm_regionarray_remove(&as->as_regions, i);
+			as_freeregion(vr);
+			continue;
+		}
+		if (vr->vr_base < addr) {
+			vr->vr_npages = (addr - vr->vr_base) / PAGE_SIZE;
+		}
+		else {
+			vr->vr_offset += end - vr->vr_base;
+			vr->vr_npages -= (end - vr->vr_base) / PAGE_SIZE;
+			vr->vr_base = end;
+		}
+		i++;
+	}
+
 	return 0;
 }
 
 int
-as_define_stack(struct addrspace *as, vaddr_t *stackptr)
+as_msync(struct addrspace *as, vaddr_t addr, size_t len, bool async)
 {
-	KASSERT(as->as_stackpbase != 0);
+	struct vm_region *vr;
+	vaddr_t end, vrend, start, stop, va;
+	unsigned i, num;
+	int result;
 
-	*stackptr = USERSTACK;
+	if ((addr & ~(vaddr_t)PAGE_FRAME) != 0 ||
+	    addr >= USERSPACETOP || len > USERSPACETOP - addr) {
+		return EINVAL;
+	}
+	end = addr + ROUNDUP(len, PAGE_SIZE);
+
+	for (va = addr; va < end; va += PAGE_SIZE) {
+		if (as_findregion(as, va) == NULL) {
+			return ENOMEM;
+		}
+	}
+
+	num = vm_regionarray_num(&as->as_regions);
+	for (i=0; i<num; i++) {
+		vr = vm_regionarray_get(&as->as_regions, i);
+		if (vr->vr_vnode == NULL || (vr->vr_flags & MAP_SHARED) == 0) {
+			continue;
+		}
+		vrend = vr->vr_base + vr->vr_npages * PAGE_SIZE;
+		start = vr->vr_base > addr ? vr->vr_base : addr;
+		stop = vrend < end ? vrend : end;
+		if (start >= stop) {
+			continue;
+		}
+		if (async) {
+			pagecache_flush_async(vr->vr_vnode,
+				vr->vr_offset + (start - vr->vr_base),
+				stop - start);
+			continue;
+		}
+		result = pagecache_flush(vr->vr_vnode,
+				vr->vr_offset + (start - vr->vr_base),
+				stop - start);
+		if (result) {
+			return result;
+		}
+	}
 	return 0;
 }
 
 int
-as_copy(struct addrspace *old, struct addrspace **ret)
+as_sbrk(struct addrspace *as, int amount, vaddr_t *ret)
 {
-	struct addrspace *new;
+	struct vm_region *heap, *vr;
+	vaddr_t oldbreak, newbreak, oldtop, newtop, shrink;
+	unsigned i, num;
 
-	new = as_create();
-	if (new==NULL) {
+	heap = as->as_heap;
+	if (heap == NULL) {
 		return ENOMEM;
 	}
+	oldbreak = as->as_heapbreak;
 
-	new->as_vbase1 = old->as_vbase1;
-	new->as_npages1 = old->as_npages1;
-	new->as_vbase2 = old->as_vbase2;
-	new->as_npages2 = old->as_npages2;
-
-	/* (Mis)use as_prepare_load to allocate some physical memory. */
-	if (as_prepare_load(new)) {
-		as_destroy(new);
-		return ENOMEM;
+	if (amount < 0) {
+		/* Negate unsigned, since -INT_MIN doesn't fit in an int. */
+		shrink = (vaddr_t)0 - (vaddr_t)amount;
+		if (shrink > oldbreak - heap->vr_base) {
+			return EINVAL;
+		}
+		newbreak = oldbreak - shrink;
+	}
+	else {
+		if ((vaddr_t)amount > USERSPACETOP - oldbreak) {
+			return ENOMEM;
+		}
+		newbreak = oldbreak + amount;
 	}
 
-	KASSERT(new->as_pbase1 != 0);
-	KASSERT(new->as_pbase2 != 0);
-	KASSERT(new->as_stackpbase != 0);
+	oldtop = heap->vr_base + heap->vr_npages * PAGE_SIZE;
+	newtop = ROUNDUP(newbreak, PAGE_SIZE);
 
-	memmove((void *)PADDR_TO_KVADDR(new->as_pbase1),
-		(const void *)PADDR_TO_KVADDR(old->as_pbase1),
-		old->as_npages1*PAGE_SIZE);
+	if (newtop > oldtop) {
+		/* Growing: the new pages must not run into anything. */
+		if (newtop > DUMBVM_STACKGUARD) {
+			return ENOMEM;
+		}
+		num = vm_regionarray_num(&as->as_regions);
+		for (i=0; i<num; i++) {
+			vr = vm_regionarray_get(&as->as_regions, i);
+			if (vr != heap && vr->vr_base < newtop &&
+			    vr->vr_base + vr->vr_npages * PAGE_SIZE > oldtop) {
+				return ENOMEM;
+			}
+		}
+	}
+	else if (newtop < oldtop) {
+		/* Shrinking: give back whole pages above the break. */
+		as_unmappages(as, newtop, oldtop);
+	}
 
-	memmove((void *)PADDR_TO_KVADDR(new->as_pbase2),
-		(const void *)PADDR_TO_KVADDR(old->as_pbase2),
-		old->as_npages2*PAGE_SIZE);
+	heap->vr_npages = (newtop - heap->vr_base) / PAGE_SIZE;
+	as->as_heapbreak = newbreak;
 
-	memmove((void *)PADDR_TO_KVADDR(new->as_stackpbase),
-		(const void *)PADDR_TO_KVADDR(old->as_stackpbase),
-		DUMBVM_STACKPAGES*PAGE_SIZE);
-	
-	*ret = new;
+	*ret = oldbreak;
 	return 0;
 }
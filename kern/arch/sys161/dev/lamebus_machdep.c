@@ -38,8 +38,10 @@
 #include <current.h>
 #include <synch.h>
 #include <mainbus.h>
+#include <prof.h>
 #include <sys161/bus.h>
 #include <lamebus/lamebus.h>
+#include <platform/maxcpus.h>
 #include "autoconf.h"
 
 /*
@@ -73,6 +75,44 @@ mips_timer_set(uint32_t count)
 		:: "r" (count));
 }
 
+/*
+ * Read the cycle counter, which starts again from zero whenever the
+ * timer is set.
+ */
+static
+uint32_t
+mips_timer_count(void)
+{
+	uint32_t count;
+
+	/* $9 == c0_count */
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 registers */
+		"mfc0 %0, $9;"		/* do it */
+		".set pop"		/* restore assembler mode */
+		: "=r" (count));
+	return count;
+}
+
+/*
+ * Cycles each cpu's count register had reached as of the last time
+ * its timer was set. Only touched by that cpu, with interrupts off.
+ */
+static uint64_t timer_cycles[MAXCPUS];
+
+/*
+ * Set the timer, keeping track of the cycles the count register had
+ * reached before it starts over.
+ */
+static
+void
+mips_timer_reset(uint32_t count)
+{
+	timer_cycles[curcpu->c_number] += mips_timer_count();
+	mips_timer_set(count);
+}
+
 /*
  * LAMEbus data for the system. (We have only one LAMEbus per system.)
  * This does not need to be locked, because it's constant once
@@ -242,6 +282,42 @@ mainbus_send_ipi(struct cpu *target)
 	lamebus_assert_ipi(lamebus, target);
 }
 
+/*
+ * Tickless idle: push the next hardclock as far off as the timer goes
+ * (about three minutes), and on the way out restart the usual tick
+ * and work out how many we skipped from the cycle count.
+ */
+void
+mainbus_hardclock_stop(void)
+{
+	mips_timer_reset(0xffffffff);
+}
+
+unsigned
+mainbus_hardclock_start(void)
+{
+	uint32_t count;
+
+	count = mips_timer_count();
+	mips_timer_reset(CPU_FREQUENCY / HZ);
+	return count / (CPU_FREQUENCY / HZ);
+}
+
+/*
+ * Cycles this cpu has run since its timer was first set.
+ */
+uint64_t
+mainbus_cycles(void)
+{
+	uint64_t ret;
+	int spl;
+
+	spl = splhigh();
+	ret = timer_cycles[curcpu->c_number] + mips_timer_count();
+	splx(spl);
+	return ret;
+}
+
 /*
  * Interrupt dispatcher.
  */
@@ -269,7 +345,10 @@ mainbus_interrupt(struct trapframe *tf)
 	}
 	else if (cause & MIPS_TIMER_BIT) {
 		/* Reset the timer (this clears the interrupt) */
-		mips_timer_set(CPU_FREQUENCY / HZ);
+		mips_timer_reset(CPU_FREQUENCY / HZ);
+		if (prof_enabled) {
+			prof_sample(tf->tf_epc);
+		}
 		/* and call hardclock */
 		hardclock();
 	}
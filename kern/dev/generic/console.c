@@ -48,6 +48,13 @@
  *
  * Note that we have no input buffering; characters typed too rapidly
  * will be lost.
+ *
+ * Output from threads goes into a ring of CONSOLE_OUTPUT_BUFFER_SIZE
+ * characters that the device's write-done interrupt drains, so a
+ * writer only waits when the ring is full rather than once per
+ * character. Output from interrupt handlers and with interrupts off
+ * (including panics) still goes straight to the device by polling,
+ * and so can overtake whatever is still in the ring.
  */
 
 #include <types.h>
@@ -57,6 +64,8 @@
 #include <thread.h>
 #include <current.h>
 #include <synch.h>
+#include <spinlock.h>
+#include <wchan.h>
 #include <generic/console.h>
 #include <vfs.h>
 #include <device.h>
@@ -74,6 +83,12 @@ static struct con_softc *the_console = NULL;
 static struct lock *con_userlock_read = NULL;
 static struct lock *con_userlock_write = NULL;
 
+/*
+ * Staging buffer for user writes, so each chunk is copied in with one
+ * uiomove. Protected by con_userlock_write.
+ */
+static char con_writebuf[CONSOLE_OUTPUT_BUFFER_SIZE];
+
 //////////////////////////////////////////////////
 
 /*
@@ -142,6 +157,69 @@ putch_complete_polled(struct con_softc *cs)
 
 //////////////////////////////////////////////////
 
+/*
+ * Start the device on the next character in the output ring, or note
+ * that it has gone idle if there isn't one. Wake up writers once the
+ * ring is half empty. Called with cs_outlock held.
+ */
+static
+void
+con_sendnext(struct con_softc *cs)
+{
+	unsigned used;
+	int ch;
+
+	KASSERT(spinlock_do_i_hold(&cs->cs_outlock));
+
+	if (cs->cs_outhead == cs->cs_outtail) {
+		cs->cs_outbusy = false;
+	}
+	else {
+		ch = cs->cs_outbuf[cs->cs_outtail];
+		cs->cs_outtail =
+			(cs->cs_outtail + 1) % CONSOLE_OUTPUT_BUFFER_SIZE;
+		cs->cs_outbusy = true;
+		cs->cs_send(cs->cs_devdata, ch);
+	}
+
+	used = (cs->cs_outhead + CONSOLE_OUTPUT_BUFFER_SIZE - cs->cs_outtail)
+		% CONSOLE_OUTPUT_BUFFER_SIZE;
+	if (cs->cs_outwaiters > 0 && used <= CONSOLE_OUTPUT_BUFFER_SIZE / 2) {
+		wchan_wakeall(cs->cs_outwchan);
+	}
+}
+
+/*
+ * Queue LEN characters for output, waiting for the interrupt handler
+ * to make room if the ring fills up.
+ */
+static
+void
+con_output(struct con_softc *cs, const char *buf, size_t len)
+{
+	unsigned nexthead;
+	size_t i;
+
+	spinlock_acquire(&cs->cs_outlock);
+	for (i=0; i<len; i++) {
+		nexthead = (cs->cs_outhead + 1) % CONSOLE_OUTPUT_BUFFER_SIZE;
+		while (nexthead == cs->cs_outtail) {
+			cs->cs_outwaiters++;
+			wchan_lock(cs->cs_outwchan);
+			spinlock_release(&cs->cs_outlock);
+			wchan_sleep(cs->cs_outwchan);
+			spinlock_acquire(&cs->cs_outlock);
+			cs->cs_outwaiters--;
+		}
+		cs->cs_outbuf[cs->cs_outhead] = buf[i];
+		cs->cs_outhead = nexthead;
+		if (!cs->cs_outbusy) {
+			con_sendnext(cs);
+		}
+	}
+	spinlock_release(&cs->cs_outlock);
+}
+
 /*
  * Print a character, using interrupts to wait for I/O completion.
  */
@@ -149,8 +227,9 @@ static
 void
 putch_intr(struct con_softc *cs, int ch)
 {
-	P(cs->cs_wsem);
-	cs->cs_send(cs->cs_devdata, ch);
+	char c = ch;
+
+	con_output(cs, &c, 1);
 }
 
 /*
@@ -198,13 +277,16 @@ con_input(void *vcs, int ch)
 
 /*
  * Called from underlying device when a write-done interrupt occurs.
+ * Send the next character straight from the ring.
  */
 void
 con_start(void *vcs)
 {
 	struct con_softc *cs = vcs;
 
-	V(cs->cs_wsem);
+	spinlock_acquire(&cs->cs_outlock);
+	con_sendnext(cs);
+	spinlock_release(&cs->cs_outlock);
 }
 
 //////////////////////////////////////////////////
@@ -265,6 +347,32 @@ putch_complete(void)
 	}
 }
 
+/*
+ * Wait for everything in the output ring to go out. For shutdown,
+ * which is about to turn interrupts off for good.
+ */
+void
+putch_drain(void)
+{
+	struct con_softc *cs = the_console;
+
+	if (cs == NULL) {
+		return;
+	}
+	KASSERT(!curthread->t_in_interrupt && curthread->t_iplhigh_count == 0);
+
+	spinlock_acquire(&cs->cs_outlock);
+	while (cs->cs_outbusy) {
+		cs->cs_outwaiters++;
+		wchan_lock(cs->cs_outwchan);
+		spinlock_release(&cs->cs_outlock);
+		wchan_sleep(cs->cs_outwchan);
+		spinlock_acquire(&cs->cs_outlock);
+		cs->cs_outwaiters--;
+	}
+	spinlock_release(&cs->cs_outlock);
+}
+
 int
 getch(void)
 {
@@ -298,15 +406,35 @@ con_close(struct device *dev)
 	return 0;
 }
 
+/*
+ * Queue a chunk of user output, turning each newline into CR-LF.
+ */
+static
+void
+con_output_crlf(struct con_softc *cs, const char *buf, size_t len)
+{
+	size_t i, start;
+
+	start = 0;
+	for (i=0; i<len; i++) {
+		if (buf[i] == '\n') {
+			con_output(cs, buf + start, i - start);
+			con_output(cs, "\r\n", 2);
+			start = i + 1;
+		}
+	}
+	con_output(cs, buf + start, len - start);
+}
+
 static
 int
 con_io(struct device *dev, struct uio *uio)
 {
 	int result;
 	char ch;
+	size_t len;
 	struct lock *lk;
-
-	(void)dev;  // unused
+	struct con_softc *cs = dev->d_data;
 
 	if (uio->uio_rw==UIO_READ) {
 		lk = con_userlock_read;
@@ -334,15 +462,16 @@ con_io(struct device *dev, struct uio *uio)
 			}
 		}
 		else {
-			result = uiomove(&ch, 1, uio);
+			len = uio->uio_resid;
+			if (len > sizeof(con_writebuf)) {
+				len = sizeof(con_writebuf);
+			}
+			result = uiomove(con_writebuf, len, uio);
 			if (result) {
 				lock_release(lk);
 				return result;
 			}
-			if (ch=='\n') {
-				putch('\r');
-			}
-			putch(ch);
+			con_output_crlf(cs, con_writebuf, len);
 		}
 	}
 	lock_release(lk);
@@ -398,7 +527,8 @@ attach_console_to_vfs(struct con_softc *cs)
 int
 config_con(struct con_softc *cs, int unit)
 {
-	struct semaphore *rsem, *wsem;
+	struct semaphore *rsem;
+	struct wchan *outwchan;
 	struct lock *rlk, *wlk;
 
 	/*
@@ -418,29 +548,34 @@ config_con(struct con_softc *cs, int unit)
 	if (rsem == NULL) {
 		return ENOMEM;
 	}
-	wsem = sem_create("console write", 1);
-	if (wsem == NULL) {
+	outwchan = wchan_create("console output");
+	if (outwchan == NULL) {
 		sem_destroy(rsem);
 		return ENOMEM;
 	}
 	rlk = lock_create("console-lock-read");
 	if (rlk == NULL) {
 		sem_destroy(rsem);
-		sem_destroy(wsem);
+		wchan_destroy(outwchan);
 		return ENOMEM;
 	}
 	wlk = lock_create("console-lock-write");
 	if (wlk == NULL) {
 		lock_destroy(rlk);
 		sem_destroy(rsem);
-		sem_destroy(wsem);
+		wchan_destroy(outwchan);
 		return ENOMEM;
 	}
 
 	cs->cs_rsem = rsem; 
-	cs->cs_wsem = wsem; 
 	cs->cs_gotchars_head = 0;
 	cs->cs_gotchars_tail = 0;
+	spinlock_init(&cs->cs_outlock);
+	cs->cs_outwchan = outwchan;
+	cs->cs_outhead = 0;
+	cs->cs_outtail = 0;
+	cs->cs_outwaiters = 0;
+	cs->cs_outbusy = false;
 
 	the_console = cs;
 	con_userlock_read = rlk;
@@ -30,6 +30,8 @@
 #ifndef _GENERIC_CONSOLE_H_
 #define _GENERIC_CONSOLE_H_
 
+#include <spinlock.h>
+
 /*
  * Device data for the hardware-independent system console.
  *
@@ -38,6 +40,7 @@
  */
 
 #define CONSOLE_INPUT_BUFFER_SIZE 32
+#define CONSOLE_OUTPUT_BUFFER_SIZE 4096
 
 struct con_softc {
 	/* initialized by attach routine */
@@ -49,10 +52,18 @@ struct con_softc {
 
 	/* initialized by config routine */
 	struct semaphore *cs_rsem;
-	struct semaphore *cs_wsem;
 	unsigned char cs_gotchars[CONSOLE_INPUT_BUFFER_SIZE];
 	unsigned cs_gotchars_head;	/* next slot to put a char in */
 	unsigned cs_gotchars_tail;	/* next slot to take a char out */
+
+	/* output ring, drained by the write-done interrupt */
+	struct spinlock cs_outlock;	/* protects the rest */
+	struct wchan *cs_outwchan;	/* writers waiting for space */
+	unsigned char cs_outbuf[CONSOLE_OUTPUT_BUFFER_SIZE];
+	unsigned cs_outhead;		/* next slot to put a char in */
+	unsigned cs_outtail;		/* next slot to take a char out */
+	unsigned cs_outwaiters;		/* threads on cs_outwchan */
+	bool cs_outbusy;		/* device is sending a char */
 };
 
 /*
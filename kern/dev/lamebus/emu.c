@@ -840,10 +840,11 @@ emufs_namefile(struct vnode *v, struct uio *uio)
  */
 static
 int
-emufs_mmap(struct vnode *v)
+emufs_mmap(struct vnode *v, int prot)
 {
 	(void)v;
-	return EUNIMP;
+	(void)prot;
+	return 0;
 }
 
 //////////////////////////////
@@ -944,6 +945,15 @@ emufs_void_op_isdir(struct vnode *v)
 	return EISDIR;
 }
 
+static
+int
+emufs_mmap_isdir(struct vnode *v, int prot)
+{
+	(void)v;
+	(void)prot;
+	return EISDIR;
+}
+
 static
 int
 emufs_uio_op_isdir(struct vnode *v, struct uio *uio)
@@ -1124,7 +1134,7 @@ static const struct vnode_ops emufs_dirops = {
 	emufs_dir_gettype,
 	emufs_dir_tryseek,
 	emufs_void_op_isdir,  /* fsync */
-	emufs_void_op_isdir,  /* mmap */
+	emufs_mmap_isdir,
 	emufs_truncate_isdir,
 	emufs_namefile,
 
@@ -38,6 +38,7 @@
 #include <synch.h>
 #include <platform/bus.h>
 #include <vfs.h>
+#include <trace.h>
 #include <lamebus/lhd.h>
 #include "autoconf.h"
 
@@ -116,6 +117,7 @@ lhd_irq(void *vlh)
 {
 	struct lhd_softc *lh = vlh;
 	uint32_t val;
+	int err;
 	
 	val = lhd_rdreg(lh, LHD_REG_STAT);
 
@@ -127,7 +129,9 @@ lhd_irq(void *vlh)
 	    case LHD_INVSECT:
 	    case LHD_MEDIA:
 		lhd_wreg(lh, LHD_REG_STAT, 0);
-		lhd_iodone(lh, lhd_code_to_errno(lh, val));
+		err = lhd_code_to_errno(lh, val);
+		TRACE(TREV_DISKDONE, lh->lh_unit, err);
+		lhd_iodone(lh, err);
 		break;
 	}
 }
@@ -247,6 +251,8 @@ lhd_io(struct device *d, struct uio *uio)
 		lhd_wreg(lh, LHD_REG_SECT, sector+i);
 
 		/* and start the operation. */
+		TRACE(TREV_DISKIO, lh->lh_unit, (sector + i) |
+		      (uio->uio_rw == UIO_WRITE ? TRACE_DISK_WRITE : 0));
 		lhd_wreg(lh, LHD_REG_STAT, statval);
 
 		/* Now wait until the interrupt handler tells us we're done. */
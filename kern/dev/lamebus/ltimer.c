@@ -47,6 +47,7 @@
 #define LT_REG_SPKR   20    /* Beep control */
 
 static bool havetimerclock;
+static struct ltimer_softc *timerclock_lt;	/* the one with lt_timerclock */
 
 /*
  * Setup routine called by autoconf stuff when an ltimer is found.
@@ -87,6 +88,7 @@ config_ltimer(struct ltimer_softc *lt, int ltimerno)
 	if (!havetimerclock) {
 		havetimerclock = true;
 		lt->lt_timerclock = 1;
+		timerclock_lt = lt;
 
 		/* Wire it to go off once every 10 ms */
 		/* KMS: reduced this from 1s to 10ms */
@@ -125,6 +127,27 @@ ltimer_irq(void *vlt)
 	}
 }
 
+/*
+ * Start the timerclock countdown again from the beginning, or stop it
+ * restarting. When stopped, the countdown in progress still goes off
+ * once more; timerclock() copes with that.
+ */
+void
+ltimer_timerclock_enable(bool on)
+{
+	struct ltimer_softc *lt = timerclock_lt;
+
+	if (lt == NULL) {
+		/* Not attached yet; it starts out running when it is. */
+		return;
+	}
+	bus_write_register(lt->lt_bus, lt->lt_buspos, LT_REG_ROE, on ? 1 : 0);
+	if (on) {
+		bus_write_register(lt->lt_bus, lt->lt_buspos, LT_REG_COUNT,
+				   LT_GRANULARITY);
+	}
+}
+
 /*
  * The timer device will beep if you write to the beep register. It
  * doesn't matter what value you write. This function is called if
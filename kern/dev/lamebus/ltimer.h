@@ -56,4 +56,7 @@ void ltimer_beep(/*struct ltimer_softc*/ void *devdata);   // for beep device
 void ltimer_gettime(/*struct ltimer_softc*/ void *devdata,
 		    time_t *secs, uint32_t *nsecs);       // for rtclock
 
+/* Start or stop the timer that drives timerclock() */
+void ltimer_timerclock_enable(bool on);
+
 #endif /* _LAMEBUS_LTIMER_H_ */
@@ -262,6 +262,8 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 	/* We don't pass any options through mount */
 	(void)options;
 
+	sfs_registercounters();
+
 	/*
 	 * Make sure our on-disk structures aren't messed up
 	 */
@@ -33,8 +33,31 @@
 #include <uio.h>
 #include <vfs.h>
 #include <device.h>
+#include <counter.h>
 #include <sfs.h>
 
+#define SFS_BLOCKREADS		0
+#define SFS_BLOCKWRITES		1
+#define SFS_IOERRORS		2
+#define SFS_NCOUNTERS		3
+
+static const char *const sfs_counter_names[SFS_NCOUNTERS] = {
+	"block reads",
+	"block writes",
+	"I/O errors",
+};
+
+DEFCOUNTERS(sfs_counters, "sfs", sfs_counter_names, SFS_NCOUNTERS);
+
+/*
+ * Called at each mount; registers the first time.
+ */
+void
+sfs_registercounters(void)
+{
+	counterset_register(&sfs_counters);
+}
+
 ////////////////////////////////////////////////////////////
 //
 // Basic block-level I/O routines
@@ -56,6 +79,8 @@ sfs_rwblock(struct sfs_fs *sfs, struct uio *uio)
 	      uio->uio_rw == UIO_READ ? "read" : "write",
 	      uio->uio_offset / SFS_BLOCKSIZE);
 
+	counter_inc(&sfs_counters, uio->uio_rw == UIO_READ ?
+		    SFS_BLOCKREADS : SFS_BLOCKWRITES);
  retry:
 	result = sfs->sfs_device->d_io(sfs->sfs_device, uio);
 	if (result == EINVAL) {
@@ -67,6 +92,7 @@ sfs_rwblock(struct sfs_fs *sfs, struct uio *uio)
 		panic("sfs: d_io returned EINVAL\n");
 	}
 	if (result == EIO) {
+		counter_inc(&sfs_counters, SFS_IOERRORS);
 		if (tries == 0) {
 			tries++;
 			kprintf("sfs: block %llu I/O error, retrying\n",
@@ -1110,14 +1110,16 @@ sfs_fsync(struct vnode *v)
 }
 
 /*
- * Called for mmap().
+ * Called for mmap(). Regular files can always be mapped; the VM
+ * system does the paging through sfs_read and sfs_write.
  */
 static
 int
-sfs_mmap(struct vnode *v   /* add stuff as needed */)
+sfs_mmap(struct vnode *v, int prot)
 {
 	(void)v;
-	return EUNIMP;
+	(void)prot;
+	return 0;
 }
 
 /*
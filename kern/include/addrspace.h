@@ -35,26 +35,58 @@
  */
 
 
+#include <array.h>
+#include <spinlock.h>
 #include <vm.h>
+#include <platform/maxcpus.h>
 
 struct vnode;
 
 
+/*
+ * A region is a run of pages with the same protection and the same
+ * backing: either anonymous zero-fill memory (vr_vnode == NULL) or a
+ * file mapped starting at vr_offset. Executable segments and the
+ * stack are private anonymous regions; mmap adds the rest.
+ */
+struct vm_region {
+	vaddr_t vr_base;		/* page-aligned start */
+	size_t vr_npages;		/* length in pages */
+	int vr_prot;			/* PROT_* from <kern/mman.h> */
+	int vr_flags;			/* MAP_SHARED or MAP_PRIVATE */
+	struct vnode *vr_vnode;		/* mapped file, or NULL */
+	off_t vr_offset;		/* file offset of vr_base */
+};
+
+#ifndef ADDRSPACEINLINE
+#define ADDRSPACEINLINE INLINE
+#endif
+
+DECLARRAY(vm_region);
+DEFARRAY(vm_region, ADDRSPACEINLINE);
+
 /* 
  * Address space - data structure associated with the virtual memory
  * space of a process.
  *
- * You write this.
+ * as_pagetable is a two-level table covering the user half of the
+ * address space; entries are in TLB EntryLo format (see dumbvm.c).
+ * as_asid[n] is the TLB address space ID this address space has on
+ * cpu n, with its generation, or 0 if it has none there; bit n of
+ * as_cpus is set while cpu n is running it. Both are protected by
+ * as_lock.
  */
 
 struct addrspace {
-  vaddr_t as_vbase1;
-  paddr_t as_pbase1;
-  size_t as_npages1;
-  vaddr_t as_vbase2;
-  paddr_t as_pbase2;
-  size_t as_npages2;
-  paddr_t as_stackpbase;
+	struct vm_regionarray as_regions;
+	uint32_t **as_pagetable;
+	bool as_loading;		/* between prepare/complete_load */
+	struct vm_region *as_heap;	/* sbrk region, or NULL before load */
+	vaddr_t as_heapbreak;		/* current break (not page-aligned) */
+	struct vm_region *as_stack;	/* grows down on fault */
+	uint32_t as_asid[MAXCPUS];	/* per-cpu ASID, see dumbvm.c */
+	uint32_t as_cpus;		/* cpus it is active on */
+	struct spinlock as_lock;
 };
 
 /*
@@ -91,6 +123,22 @@ struct addrspace {
  *    as_define_stack - set up the stack region in the address space.
  *                (Normally called *after* as_complete_load().) Hands
  *                back the initial stack pointer for the new process.
+ *                The stack starts at one page and grows on demand.
+ *
+ *    as_mmap   - add a region of LEN bytes backed by VN (or anonymous
+ *                memory if VN is NULL) at an address chosen by the
+ *                VM system, returned in *RET. Pages are faulted in
+ *                on first touch.
+ *
+ *    as_munmap - remove [ADDR, ADDR+LEN) from whatever regions it
+ *                overlaps, splitting them as needed.
+ *
+ *    as_msync  - write back the dirty shared file pages in
+ *                [ADDR, ADDR+LEN). If ASYNC, just start the writes.
+ *
+ *    as_sbrk   - move the heap break by AMOUNT bytes, handing back
+ *                the old break. The heap starts just above the
+ *                executable's segments and is faulted in lazily.
  */
 
 struct addrspace *as_create(void);
@@ -108,6 +156,14 @@ int               as_prepare_load(struct addrspace *as);
 int               as_complete_load(struct addrspace *as);
 int               as_define_stack(struct addrspace *as, vaddr_t *initstackptr);
 
+int               as_mmap(struct addrspace *as, size_t len, int prot,
+                          int flags, struct vnode *vn, off_t offset,
+                          vaddr_t *ret);
+int               as_munmap(struct addrspace *as, vaddr_t addr, size_t len);
+int               as_msync(struct addrspace *as, vaddr_t addr, size_t len,
+                           bool async);
+int               as_sbrk(struct addrspace *as, int amount, vaddr_t *ret);
+
 
 /*
  * Functions in loadelf.c
@@ -38,8 +38,12 @@
  * hardclock() is called on every CPU HZ times a second, possibly only
  * when the CPU is not idle, for scheduling.
  *
- * timerclock() is called on one CPU once a second to allow simple
- * timed operations. (This is a fairly simpleminded interface.)
+ * timerclock() is called on one CPU once every LT_GRANULARITY usec
+ * and drives the timer wheel (see timer.h) for timed operations.
+ * timerclock_enable() turns those calls off and on; the timer wheel
+ * turns them off while it has nothing to do. Secondly, a cpu with
+ * nothing to run turns its hardclock off until it has (see
+ * thread_switch), and counts the ticks it skipped.
  *
  * gettime() may be used to fetch the current time of day.
  * getinterval() computes the time from time1 to time2.
@@ -60,6 +64,7 @@ void hardclock_bootstrap(void);
 
 void hardclock(void);
 void timerclock(void);
+void timerclock_enable(bool on);
 
 void gettime(time_t *seconds, uint32_t *nanoseconds);
 
@@ -71,7 +76,8 @@ void getinterval(time_t secs1, uint32_t nsecs,
  * clocksleep() suspends execution for the requested number of seconds,
  * like userlevel sleep(3). (Don't confuse it with wchan_sleep.)
  *
- *  this will be more efficient than clocknap() for longer sleeps
+ *  like clocknap(), this sleeps on the timer wheel and costs nothing
+ *  until it is time to wake up
  */
 void clocksleep(int seconds);
 
@@ -0,0 +1,44 @@
+#ifndef _COREMAP_H_
+#define _COREMAP_H_
+
+/*
+ * Physical page management.
+ *
+ * The coremap has one entry for every physical page of RAM. Kernel
+ * allocations (alloc_kpages/free_kpages) may span several contiguous
+ * pages; user pages are always allocated one at a time and carry a
+ * reference count so that a single frame can be mapped by several
+ * address spaces and by the page cache at once.
+ *
+ *    coremap_bootstrap - take over physical memory from ram.c. Called
+ *                      from vm_bootstrap; before this, page allocation
+ *                      falls back on ram_stealmem.
+ *
+ *    page_alloc      - allocate one user page with a reference count
+ *                      of 1. The contents are not cleared. Returns 0
+ *                      if no memory is available.
+ *
+ *    page_incref     - add a reference to an allocated user page.
+ *
+ *    page_decref     - drop a reference; the page is freed when the
+ *                      count reaches zero.
+ *
+ *    page_refcount   - current reference count (for diagnostics and
+ *                      for callers deciding whether a page is shared).
+ *
+ *    coremap_printstats - print page usage counts.
+ */
+
+#include <vm.h>
+
+void coremap_bootstrap(void);
+
+paddr_t page_alloc(void);
+void page_incref(paddr_t pa);
+void page_decref(paddr_t pa);
+unsigned page_refcount(paddr_t pa);
+
+void coremap_printstats(void);
+
+
+#endif /* _COREMAP_H_ */
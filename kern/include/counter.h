@@ -0,0 +1,104 @@
+#ifndef _COUNTER_H_
+#define _COUNTER_H_
+
+/*
+ * Statistics counters.
+ *
+ * A subsystem defines a set of named counters with DEFCOUNTERS and
+ * registers it once at boot. Each cpu has its own copy of every
+ * counter, in its own cache line, and bumps only that copy, with
+ * interrupts off for the instant it takes and no lock; the copies
+ * are only added up when someone reads them. Counting may start
+ * before the set is registered (or before there is a curcpu, which
+ * counts as cpu 0); registering just makes the set visible.
+ *
+ * Registered sets can be printed from the menu and read from the
+ * "counters:" device.
+ *
+ *    DEFCOUNTERS      - define a counter set VAR called NAME, with
+ *                       NUM counters named by the string array NAMES.
+ *    counter_inc      - add 1 to counter WHICH of CS on this cpu.
+ *    counter_add      - add AMOUNT to counter WHICH of CS on this cpu.
+ *    counter_read     - total of counter WHICH over all cpus.
+ *    counterset_register - make CS visible. Registering a set again
+ *                       does nothing.
+ *    counterset_reset - zero every counter in CS.
+ *    counters_print   - print every registered set.
+ *    counters_bootstrap - create the counters: device.
+ */
+
+#include <cpu.h>
+#include <current.h>
+#include <spl.h>
+#include <platform/maxcpus.h>
+
+#define COUNTER_LINE	64	/* bytes */
+
+/* Counters per cpu for a set of NUM, padded to a whole cache line */
+#define COUNTER_STRIDE(num) \
+	ROUNDUP((num), COUNTER_LINE / sizeof(unsigned))
+
+struct counterset {
+	const char *cs_name;
+	const char *const *cs_names;	/* cs_num of them */
+	unsigned cs_num;
+	unsigned cs_stride;		/* per-cpu row length */
+	unsigned *cs_counts;		/* MAXCPUS rows */
+	bool cs_registered;
+	struct counterset *cs_next;	/* registered sets */
+};
+
+#define DEFCOUNTERS(var, name, names, num) \
+	static unsigned var##_counts[MAXCPUS * COUNTER_STRIDE(num)] \
+		__attribute__((__aligned__(COUNTER_LINE))); \
+	struct counterset var = { \
+		.cs_name = (name), \
+		.cs_names = (names), \
+		.cs_num = (num), \
+		.cs_stride = COUNTER_STRIDE(num), \
+		.cs_counts = var##_counts, \
+		.cs_registered = false, \
+		.cs_next = NULL, \
+	}
+
+#ifndef COUNTERINLINE
+#define COUNTERINLINE INLINE
+#endif
+
+COUNTERINLINE void counter_add(struct counterset *cs, unsigned which,
+			       unsigned amount);
+COUNTERINLINE void counter_inc(struct counterset *cs, unsigned which);
+
+COUNTERINLINE void
+counter_add(struct counterset *cs, unsigned which, unsigned amount)
+{
+	unsigned *row;
+	int spl;
+
+	DEBUGASSERT(which < cs->cs_num);
+
+	if (!CURCPU_EXISTS()) {
+		/* early boot: only one cpu, interrupts off */
+		cs->cs_counts[which] += amount;
+		return;
+	}
+	spl = splhigh();
+	row = &cs->cs_counts[curcpu->c_number * cs->cs_stride];
+	row[which] += amount;
+	splx(spl);
+}
+
+COUNTERINLINE void
+counter_inc(struct counterset *cs, unsigned which)
+{
+	counter_add(cs, which, 1);
+}
+
+unsigned counter_read(struct counterset *cs, unsigned which);
+void counterset_register(struct counterset *cs);
+void counterset_reset(struct counterset *cs);
+void counters_print(void);
+void counters_bootstrap(void);
+
+
+#endif /* _COUNTER_H_ */
@@ -60,6 +60,7 @@ struct cpu {
 	struct thread *c_curthread;	/* Current thread on cpu */
 	struct threadlist c_zombies;	/* List of exited threads */
 	unsigned c_hardclocks;		/* Counter of hardclock() calls */
+	unsigned c_ticks_suppressed;	/* hardclocks skipped while idle */
 
 	/*
 	 * Accessed by other cpus.
@@ -82,10 +83,14 @@ struct cpu {
 	 * struct tlbshootdown is machine-dependent and might
 	 * reasonably be either an address space and vaddr pair, or a
 	 * paddr, or something else.
+	 *
+	 * c_shootdowns_done is bumped each time the cpu finishes the
+	 * shootdowns queued for it, so senders can wait for theirs.
 	 */
 	uint32_t c_ipi_pending;		/* One bit for each IPI number */
 	struct tlbshootdown c_shootdown[TLBSHOOTDOWN_MAX];
 	int c_numshootdown;
+	unsigned c_shootdowns_done;
 	struct spinlock c_ipi_lock;
 };
 
@@ -105,6 +110,8 @@ struct cpu {
  * for the cpu.
  */
 struct cpu *cpu_create(unsigned hardware_number);
+unsigned cpu_count(void);
+void cpu_printtickstats(void);
 void cpu_machdep_init(struct cpu *);
 /*ASMLINKAGE*/ void cpu_start_secondary(void);
 void cpu_hatch(unsigned software_number);
@@ -152,6 +159,11 @@ void cpu_halt(void);
  * ipi_send sends an IPI to one CPU.
  * ipi_broadcast sends an IPI to all CPUs except the current one.
  * ipi_tlbshootdown is like ipi_send but carries TLB shootdown data.
+ * ipi_tlbshootdown_batch queues several mappings with a single IPI,
+ * and returns a ticket that can be passed to ipi_tlbshootdown_wait to
+ * wait until the target has dealt with them. Passing NUM greater than
+ * TLBSHOOTDOWN_MAX asks for TLBSHOOTDOWN_ALL. Don't wait with
+ * interrupts off, or two cpus shooting at each other will deadlock.
  *
  * interprocessor_interrupt is called on the target CPU when an IPI is
  * received.
@@ -166,6 +178,10 @@ void cpu_halt(void);
 void ipi_send(struct cpu *target, int code);
 void ipi_broadcast(int code);
 void ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping);
+unsigned ipi_tlbshootdown_batch(struct cpu *target,
+				const struct tlbshootdown *mappings,
+				unsigned num);
+void ipi_tlbshootdown_wait(struct cpu *target, unsigned ticket);
 
 void interprocessor_interrupt(void);
 
@@ -0,0 +1,62 @@
+#ifndef _FILE_H_
+#define _FILE_H_
+
+/*
+ * Open files and per-process file tables.
+ *
+ * An openfile is what a file descriptor refers to: a vnode plus the
+ * seek position and access mode it was opened with. Openfiles are
+ * reference counted because several descriptors (and, after fork,
+ * several processes) may refer to the same one and share its seek
+ * position.
+ *
+ *    openfile_open   - vfs_open PATH and wrap the result. PATH may be
+ *                      destroyed, as with vfs_open.
+ *    openfile_incref - add a reference.
+ *    openfile_decref - drop a reference, closing the vnode on the last.
+ *
+ *    filetable_create  - make an empty table.
+ *    filetable_destroy - drop every open file and free the table.
+ *    filetable_copy    - make a table referring to the same openfiles
+ *                        (for fork).
+ *    filetable_place   - put an openfile in the lowest free slot,
+ *                        consuming the caller's reference.
+ *    filetable_get     - look up FD; returns EBADF if it isn't open.
+ *                        No reference is added.
+ *    filetable_remove  - clear FD and hand back its openfile (with its
+ *                        reference) for the caller to drop.
+ */
+
+#include <limits.h>
+#include <spinlock.h>
+
+struct vnode;
+struct semaphore;
+
+struct openfile {
+	struct vnode *of_vnode;
+	int of_accmode;			/* O_RDONLY, O_WRONLY, or O_RDWR */
+	off_t of_offset;		/* seek position */
+	struct semaphore *of_mutex;	/* serializes I/O on of_offset */
+	struct spinlock of_lock;	/* protects of_refcount */
+	unsigned of_refcount;
+};
+
+struct filetable {
+	struct openfile *ft_files[OPEN_MAX];
+};
+
+int openfile_open(char *path, int openflags, mode_t mode,
+		  struct openfile **ret);
+void openfile_incref(struct openfile *of);
+void openfile_decref(struct openfile *of);
+
+struct filetable *filetable_create(void);
+void filetable_destroy(struct filetable *ft);
+struct filetable *filetable_copy(struct filetable *ft);
+int filetable_place(struct filetable *ft, struct openfile *of, int *fd);
+int filetable_get(struct filetable *ft, int fd, struct openfile **ret);
+struct openfile *filetable_remove(struct filetable *ft, int fd);
+
+
+#endif /* _FILE_H_ */
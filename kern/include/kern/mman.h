@@ -0,0 +1,31 @@
+#ifndef _KERN_MMAN_H_
+#define _KERN_MMAN_H_
+
+/*
+ * Constants for mmap(), munmap(), and msync() - libc's <sys/mman.h>.
+ */
+
+/* Protection: PROT_NONE, or any combination of the others. */
+#define PROT_NONE     0
+#define PROT_READ     1      /* Pages may be read */
+#define PROT_WRITE    2      /* Pages may be written */
+#define PROT_EXEC     4      /* Pages may be executed */
+
+/* Mapping type: exactly one of these... */
+#define MAP_SHARED    1      /* Stores go to the file and other mappings */
+#define MAP_PRIVATE   2      /* Stores are private to this mapping */
+
+/* ...optionally with this. */
+#define MAP_ANON      4      /* Zero-filled memory; no file (fd ignored) */
+#define MAP_ANONYMOUS MAP_ANON
+
+/* Flags for msync(). */
+#define MS_ASYNC      1      /* Queue the writes and return at once */
+#define MS_SYNC       2      /* Write back before returning */
+#define MS_INVALIDATE 4      /* Accepted; the cache is always coherent */
+
+/* Error return from mmap(). */
+#define MAP_FAILED    ((void *)-1)
+
+
+#endif /* _KERN_MMAN_H_ */
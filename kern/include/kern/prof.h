@@ -0,0 +1,25 @@
+#ifndef _KERN_PROF_H_
+#define _KERN_PROF_H_
+
+/*
+ * Format of kernel profile dumps, shared with the host-side
+ * symbolizer (user/sbin/profdump). A dump is a struct prof_header
+ * followed by ph_nsamples 32-bit program counters, each cpu's after
+ * the one before. Everything is big-endian.
+ *
+ * Each sample is the PC a hardclock interrupt interrupted; kernel
+ * addresses have the top bit set, user addresses do not.
+ */
+
+#define PROF_MAGIC	0x70726f31	/* "pro1" */
+
+struct prof_header {
+	uint32_t ph_magic;
+	uint32_t ph_ncpus;
+	uint32_t ph_hz;			/* samples per second per cpu */
+	uint32_t ph_nsamples;
+	uint32_t ph_dropped;		/* taken after the buffer filled */
+};
+
+
+#endif /* _KERN_PROF_H_ */
@@ -197,6 +197,9 @@
 #define SYS_reboot       119
 //#define SYS___sysctl   120
 
+//                              -- Local additions --
+#define SYS_msync        121
+
 /*CALLEND*/
 
 
@@ -0,0 +1,50 @@
+#ifndef _KERN_TRACE_H_
+#define _KERN_TRACE_H_
+
+/*
+ * Format of kernel trace dumps, shared with the host-side decoder
+ * (user/sbin/tracedump). A dump is a struct trace_header followed by
+ * th_nrecords struct trace_records: each cpu's records in the order
+ * they happened, one cpu after another. Everything is big-endian.
+ *
+ * Timestamps are in cpu cycles since that cpu started its timer, so
+ * they are only roughly comparable between cpus.
+ */
+
+#define TRACE_MAGIC	0x74726331	/* "trc1" */
+
+struct trace_header {
+	uint32_t th_magic;
+	uint32_t th_ncpus;
+	uint32_t th_nrecords;
+	uint32_t th_dropped;		/* overwritten before the dump */
+};
+
+struct trace_record {
+	uint32_t tr_cycles_hi;
+	uint32_t tr_cycles_lo;
+	uint16_t tr_event;		/* TREV_* */
+	uint16_t tr_cpu;
+	uint32_t tr_thread;		/* address of the thread */
+	uint32_t tr_arg1;
+	uint32_t tr_arg2;
+};
+
+/*
+ * Events, and what goes in arg1 and arg2.
+ */
+#define TREV_SWITCH		1	/* next thread, new state of this one */
+#define TREV_SLEEP		2	/* wchan, 0 */
+#define TREV_WAKE		3	/* wchan, thread woken */
+#define TREV_SYSCALL		4	/* call number, 0 */
+#define TREV_SYSRET		5	/* call number, error */
+#define TREV_FAULT		6	/* fault address, fault type */
+#define TREV_FAULTDONE		7	/* fault address, error */
+#define TREV_DISKIO		8	/* disk unit, sector (+write flag) */
+#define TREV_DISKDONE		9	/* disk unit, error */
+#define TREV_NEVENTS		10
+
+/* In arg2 of TREV_DISKIO */
+#define TRACE_DISK_WRITE	0x80000000
+
+#endif /* _KERN_TRACE_H_ */
@@ -122,10 +122,12 @@ uint32_t random(void);
 /*
  * Kernel heap memory allocation. Like malloc/free.
  * If out of memory, kmalloc returns NULL.
+ * kheap_bootstrap registers kmalloc's statistics counters.
  */
 void *kmalloc(size_t size);
 void kfree(void *ptr);
 void kheap_printstats(void);
+void kheap_bootstrap(void);
 
 /*
  * C string functions. 
@@ -156,11 +158,13 @@ const char *strerror(int errcode);
  *
  * putch_prepare and putch_complete should be called around a series
  * of putch() calls, if printing in polling mode is a possibility.
- * kprintf does this.
+ * kprintf does this. putch_drain waits until output buffered by
+ * putch has gone out.
  */
 void putch(int ch);
 void putch_prepare(void);
 void putch_complete(void);
+void putch_drain(void);
 int getch(void);
 void beep(void);
 
@@ -175,7 +179,17 @@ void beep(void);
  *
  * kprintf_bootstrap sets up a lock for kprintf and should be called
  * during boot once malloc is available and before any additional
- * threads are created.
+ * threads are created. It also starts the klog thread.
+ *
+ * kprintf_startlog gives the current cpu a log ring: from then on its
+ * kprintfs are formatted into the ring and printed later by the klog
+ * thread, so they don't wait for the console. Called once on each cpu
+ * as it comes up. kprintf_poll is called by hardclock, and before a
+ * cpu stops its clock to idle, to catch messages logged while holding
+ * a spinlock on any cpu. kprintf_stoplog prints
+ * what's left and goes back to printing directly, for shutdown; panic
+ * does the same for itself. kprintf_dumplog prints the messages the
+ * rings still hold.
  */
 int kprintf(const char *format, ...) __PF(1,2);
 void panic(const char *format, ...) __PF(1,2);
@@ -184,6 +198,10 @@ void badassert(const char *expr, const char *file, int line, const char *func);
 void kgets(char *buf, size_t maxbuflen);
 
 void kprintf_bootstrap(void);
+void kprintf_startlog(void);
+void kprintf_poll(void);
+void kprintf_stoplog(void);
+void kprintf_dumplog(void);
 
 /*
  * Other miscellaneous stuff
@@ -0,0 +1,54 @@
+#ifndef _LOCKSTAT_H_
+#define _LOCKSTAT_H_
+
+/*
+ * Lock contention statistics.
+ *
+ * While turned on, every spinlock acquire, lock acquire and P()
+ * records, in per-cpu tables: how many acquires there were, how many
+ * had to wait, how long they waited, and (for spinlocks and locks)
+ * how long the lock was then held. Spinlocks also count the times
+ * they went round the spin loop. Times are in cpu cycles; a wait or
+ * hold that starts on one cpu and ends on another is only
+ * approximate.
+ *
+ * Locks and semaphores are keyed by name, so all the instances with
+ * one name (all the vnode locks, say) add up together. Spinlocks have
+ * no names, so they are keyed by where they were acquired from; look
+ * the address up in the kernel's symbol table. When turned off it
+ * costs a test of lockstat_enabled per operation.
+ *
+ *    lockstat_start  - clear the statistics and start collecting.
+ *    lockstat_stop   - stop collecting.
+ *    lockstat_print  - print the N entries that spent longest waiting.
+ *
+ * The rest are the hooks called by the lock code.
+ */
+
+#define LOCKSTAT_NENTRIES	256	/* per cpu */
+#define LOCKSTAT_NAMELEN	20
+
+/* Kinds of lock */
+#define LOCKSTAT_SPIN		0
+#define LOCKSTAT_LOCK		1
+#define LOCKSTAT_SEM		2
+
+struct spinlock;
+
+extern volatile bool lockstat_enabled;
+
+int lockstat_start(void);
+void lockstat_stop(void);
+void lockstat_print(unsigned n);
+
+/* Spinlocks: after getting the lock, and before letting it go. */
+void lockstat_spin_acquired(struct spinlock *lk, vaddr_t site,
+			    unsigned spins, uint64_t waitstart);
+void lockstat_spin_releasing(struct spinlock *lk);
+
+/* Locks and semaphores; waitstart is 0 if there was no wait. */
+void lockstat_acquired(int kind, const char *name, uint64_t waitstart);
+void lockstat_released(const char *name, uint64_t holdstart);
+
+
+#endif /* _LOCKSTAT_H_ */
@@ -55,6 +55,16 @@ size_t mainbus_ramsize(void);
 /* Switch on an inter-processor interrupt. (Low-level.) */
 void mainbus_send_ipi(struct cpu *target);
 
+/*
+ * Stop this cpu's hardclock interrupts while it idles, and start them
+ * again; the start returns how many hardclocks were skipped.
+ */
+void mainbus_hardclock_stop(void);
+unsigned mainbus_hardclock_start(void);
+
+/* Cycles this cpu has run, for timestamps. */
+uint64_t mainbus_cycles(void);
+
 /*
  * The various ways to shut down the system. (These are very low-level
  * and should generally not be called directly - md_poweroff, for
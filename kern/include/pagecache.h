@@ -0,0 +1,58 @@
+#ifndef _PAGECACHE_H_
+#define _PAGECACHE_H_
+
+/*
+ * Per-vnode page cache for memory-mapped files.
+ *
+ * Each vnode that has been mmap'd gets a table of physical pages
+ * indexed by file page number. Every MAP_SHARED mapping of the file,
+ * in any address space, maps the same frame, so stores made through
+ * one mapping are immediately visible through all the others. Dirty
+ * pages are written back with VOP_WRITE by msync() and when the vnode
+ * loses its last reference.
+ *
+ * Note that ordinary read() and write() do not go through the cache;
+ * as on traditional Unix systems without a unified buffer cache,
+ * msync() is needed to make stores through a mapping visible to
+ * read().
+ *
+ *    pagecache_getpage - return the frame holding the page of VN at
+ *                      (page-aligned) OFFSET, reading it in if it is
+ *                      not cached. Bytes past EOF are zero. The frame
+ *                      is returned with a reference for the caller.
+ *                      WASREAD says whether the page had to be read
+ *                      from the file.
+ *
+ *    pagecache_markdirty - note that the page at OFFSET has been (or
+ *                      is about to be) written through a mapping.
+ *
+ *    pagecache_flush - write back dirty pages in [OFFSET, OFFSET+LEN).
+ *
+ *    pagecache_flush_async - the same, but done later from the work
+ *                      queue; any error is dropped. (If there is no
+ *                      memory to queue it, it is done right away.)
+ *
+ *    pagecache_destroy - write back everything and release the cache.
+ *                      Called when the vnode is being reclaimed.
+ */
+
+struct vnode;
+struct pagecache;
+
+/*
+ * Largest number of pages a file's cache can index. File page numbers
+ * are kept in an unsigned, and the table of them must not overflow
+ * when its size is computed in bytes. mmap refuses mappings that
+ * would reach past this.
+ */
+#define PAGECACHE_MAXPAGES  ((unsigned)-1 / sizeof(paddr_t))
+
+int pagecache_getpage(struct vnode *vn, off_t offset, paddr_t *ret,
+		      bool *wasread);
+void pagecache_markdirty(struct vnode *vn, off_t offset);
+int pagecache_flush(struct vnode *vn, off_t offset, off_t len);
+void pagecache_flush_async(struct vnode *vn, off_t offset, off_t len);
+void pagecache_destroy(struct vnode *vn);
+
+
+#endif /* _PAGECACHE_H_ */
@@ -0,0 +1,46 @@
+#ifndef _PERCPU_H_
+#define _PERCPU_H_
+
+/*
+ * Per-cpu buffers for the tracing and statistics code (tracepoints,
+ * the profiler, and the lock and syscall statistics).
+ *
+ * Each user defines a struct percpu with PERCPU_INITIALIZER, giving
+ * the size of one cpu's buffer. Buffers are allocated when collection
+ * is first turned on, for the cpus there are then, and kept. Each cpu
+ * updates only its own buffer, with interrupts off; a cpu without one
+ * (because it came up later) just doesn't collect.
+ *
+ *    percpu_alloc - give every cpu a buffer if it doesn't have one,
+ *                   and clear them all. Call with collection off.
+ *    percpu_zero  - clear every buffer there is.
+ *    percpu_get   - cpu CPU's buffer, or NULL if it has none.
+ *
+ * For dumping the buffers to a file:
+ *
+ *    percpu_openfile - open PATH for writing, creating it or
+ *                   truncating it. Close it with vfs_close.
+ *    percpu_write - write LEN bytes from BUF to VN at *POS, and
+ *                   advance *POS. A short write is ENOSPC.
+ */
+
+#include <platform/maxcpus.h>
+
+struct vnode;
+
+struct percpu {
+	size_t pc_size;			/* bytes per cpu */
+	void *pc_bufs[MAXCPUS];		/* NULL until allocated */
+};
+
+#define PERCPU_INITIALIZER(size) { (size), { NULL } }
+
+#define percpu_get(pc, cpu)	((pc)->pc_bufs[(cpu)])
+
+int percpu_alloc(struct percpu *pc);
+void percpu_zero(struct percpu *pc);
+int percpu_openfile(const char *path, struct vnode **ret);
+int percpu_write(struct vnode *vn, void *buf, size_t len, off_t *pos);
+
+
+#endif /* _PERCPU_H_ */
@@ -0,0 +1,47 @@
+#ifndef _PID_H_
+#define _PID_H_
+
+/*
+ * Process ids.
+ *
+ * The pid table maps pids to what the parent needs to know about a
+ * child: whether it has exited, and with what status. An entry lives
+ * from pid_alloc until the parent collects the status with pid_wait,
+ * or, if there is no parent to do that, until the process exits.
+ * Parent 0 means no parent (the kernel, which never waits).
+ *
+ * Allocation, lookup and release are all constant time: the table
+ * has PIDTABLE_SIZE slots, the pid in slot N is always N modulo
+ * PIDTABLE_SIZE, and free slots are kept on a FIFO list so that a pid
+ * is reused as late as possible.
+ *
+ *    pid_bootstrap - set up the table.
+ *    pid_alloc     - get a fresh pid with no parent. ENPROC if the
+ *                    table is full.
+ *    pid_setparent - make PARENT (or nobody, if 0) the parent of PID.
+ *    pid_exit      - PID has exited with STATUS (already encoded as
+ *                    for waitpid). Wakes up the parent, if any, and
+ *                    orphans PID's children.
+ *    pid_wait      - wait for PID, a child of PARENT, to exit, and
+ *                    copy its status out to STATUS (if not NULL).
+ *                    With WNOHANG, *RET is set to 0 instead of
+ *                    waiting if PID hasn't exited yet.
+ */
+
+#include <kern/limits.h>
+
+#define PIDTABLE_SIZE	512
+
+#if PIDTABLE_SIZE > __PID_MAX + 1 - __PID_MIN
+#error "PIDTABLE_SIZE is larger than the range of pids"
+#endif
+
+void pid_bootstrap(void);
+int pid_alloc(pid_t *ret);
+void pid_setparent(pid_t pid, pid_t parent);
+void pid_exit(pid_t pid, int status);
+int pid_wait(pid_t pid, pid_t parent, int options, userptr_t status,
+	     pid_t *ret);
+
+
+#endif /* _PID_H_ */
@@ -41,9 +41,8 @@
 
 struct addrspace;
 struct vnode;
-#ifdef UW
+struct filetable;
 struct semaphore;
-#endif // UW
 
 /*
  * Process structure.
@@ -52,6 +51,11 @@ struct proc {
 	char *p_name;			/* Name of this process */
 	struct spinlock p_lock;		/* Lock for this structure */
 	struct threadarray p_threads;	/* Threads in this process */
+	pid_t p_pid;			/* Process id, or 0 for none */
+	int p_exitstatus;		/* for waitpid, set by _exit */
+	unsigned p_cpu;			/* cpu it is counted on */
+	struct proc *p_reapnext;	/* link on the reaper's list */
+	struct semaphore *p_vforkwait;	/* vfork parent waiting on us */
 
 	/* VM */
 	struct addrspace *p_addrspace;	/* virtual address space */
@@ -59,14 +63,8 @@ struct proc {
 	/* VFS */
 	struct vnode *p_cwd;		/* current working directory */
 
-#ifdef UW
-  /* a vnode to refer to the console device */
-  /* this is a quick-and-dirty way to get console writes working */
-  /* you will probably need to change this when implementing file-related
-     system calls, since each process will need to keep track of all files
-     it has opened, not just the console. */
-  struct vnode *console;                /* a vnode for the console device */
-#endif
+	/* Open files */
+	struct filetable *p_filetable;	/* file descriptor table */
 
 	/* add more material here as needed */
 };
@@ -85,7 +83,17 @@ void proc_bootstrap(void);
 /* Create a fresh process for use by runprogram(). */
 struct proc *proc_create_runprogram(const char *name);
 
-/* Destroy a process. */
+/* Create the child for fork(), sharing the current process's open files. */
+struct proc *proc_create_fork(void);
+
+/*
+ * Let the parent of a vfork child run again, once the child is done
+ * with the parent's address space. Returns true if PROC was such a
+ * child, in which case the address space is not its to destroy.
+ */
+bool proc_endvfork(struct proc *proc);
+
+/* Destroy a process. Some of the work is left to the reaper. */
 void proc_destroy(struct proc *proc);
 
 /* Attach a thread to a process. Must not already have a process. */
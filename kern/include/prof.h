@@ -0,0 +1,33 @@
+#ifndef _PROF_H_
+#define _PROF_H_
+
+/*
+ * Statistical kernel profiler.
+ *
+ * While profiling is on, each hardclock records the PC it interrupted
+ * (kernel or user) in the current cpu's sample buffer. Buffers hold
+ * PROF_NSAMPLES each; once one fills, further samples on that cpu
+ * are only counted. Cpus idling with their clock stopped take no
+ * samples, so idle time does not show up.
+ *
+ *    prof_sample - take a sample at PC; called from the timer
+ *                  interrupt.
+ *    prof_start  - start profiling, from empty buffers.
+ *    prof_stop   - stop profiling.
+ *    prof_dump   - stop profiling and write the samples to the file
+ *                  PATH, in the format in <kern/prof.h>.
+ */
+
+#include <kern/prof.h>
+
+#define PROF_NSAMPLES	8192	/* per cpu */
+
+extern volatile bool prof_enabled;
+
+void prof_sample(vaddr_t pc);
+int prof_start(void);
+void prof_stop(void);
+int prof_dump(const char *path);
+
+
+#endif /* _PROF_H_ */
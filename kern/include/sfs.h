@@ -84,6 +84,9 @@ int sfs_rwblock(struct sfs_fs *sfs, struct uio *uio);
 int sfs_rblock(struct sfs_fs *sfs, void *data, uint32_t block);
 int sfs_wblock(struct sfs_fs *sfs, void *data, uint32_t block);
 
+/* Make the block I/O statistics visible (see counter.h) */
+void sfs_registercounters(void);
+
 /* Get root vnode */
 struct vnode *sfs_getroot(struct fs *fs);
 
@@ -37,6 +37,8 @@
 
 #include <spinlock.h>
 
+struct thread;
+
 /*
  * Dijkstra-style semaphore.
  *
@@ -74,8 +76,10 @@ void V(struct semaphore *);
  */
 struct lock {
         char *lk_name;
-        // add what you need here
-        // (don't forget to mark things volatile as needed)
+	struct wchan *lk_wchan;
+	struct spinlock lk_lock;	/* protects lk_holder */
+	struct thread *volatile lk_holder;	/* NULL if free */
+	uint64_t lk_holdstart;		/* for lockstat; 0 if not timed */
 };
 
 struct lock *lock_create(const char *name);
@@ -113,8 +117,7 @@ void lock_destroy(struct lock *);
 
 struct cv {
         char *cv_name;
-        // add what you need here
-        // (don't forget to mark things volatile as needed)
+	struct wchan *cv_wchan;
 };
 
 struct cv *cv_create(const char *name);
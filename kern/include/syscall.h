@@ -39,12 +39,19 @@ struct trapframe; /* from <machine/trapframe.h> */
 
 void syscall(struct trapframe *tf);
 
+/* Register the dispatcher's statistics counters. */
+void syscall_bootstrap(void);
+
+/* The name of call CALLNO, or NULL if it isn't implemented. */
+const char *syscall_name(int callno);
+
 /*
  * Support functions.
  */
 
-/* Helper for fork(). You write this. */
+/* Helpers for fork() and vfork(). */
 void enter_forked_process(struct trapframe *tf);
+void enter_vforked_process(struct trapframe *tf);
 
 /* Enter user mode. Does not return. */
 void enter_new_process(int argc, userptr_t argv, vaddr_t stackptr,
@@ -57,6 +64,7 @@ void enter_new_process(int argc, userptr_t argv, vaddr_t stackptr,
 
 int sys_reboot(int code);
 int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
+int sys_nanosleep(const_userptr_t user_req, userptr_t user_rem);
 
 #ifdef UW
 int sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval);
@@ -66,4 +74,17 @@ int sys_waitpid(pid_t pid, userptr_t status, int options, pid_t *retval);
 
 #endif // UW
 
+int sys_fork(struct trapframe *tf, pid_t *retval);
+int sys_vfork(struct trapframe *tf, pid_t *retval);
+int sys_execv(userptr_t progname, userptr_t argv);
+int sys_read(int fdesc, userptr_t ubuf, unsigned int nbytes, int *retval);
+int sys_open(userptr_t upath, int flags, mode_t mode, int *retval);
+int sys_close(int fdesc);
+int sys_lseek(int fdesc, off_t pos, int whence, off_t *retval);
+int sys_mmap(userptr_t addr, size_t len, int prot, int flags, int fd,
+	     off_t offset, int *retval);
+int sys_munmap(userptr_t addr, size_t len);
+int sys_msync(userptr_t addr, size_t len, int flags);
+int sys_sbrk(int amount, int *retval);
+
 #endif /* _SYSCALL_H_ */
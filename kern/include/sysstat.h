@@ -0,0 +1,42 @@
+#ifndef _SYSSTAT_H_
+#define _SYSSTAT_H_
+
+/*
+ * Per-system-call statistics.
+ *
+ * While turned on, each system call is counted by call number on
+ * entry. When it returns, its error status and latency are recorded
+ * too. Latency is measured with gettime() and kept as a log2
+ * histogram in microseconds. Calls that do not return (_exit, and
+ * execv when it works) are counted but not timed. When turned off it
+ * costs a test of sysstat_enabled per call.
+ *
+ *    sysstat_start - clear the statistics and start collecting.
+ *    sysstat_stop  - stop collecting.
+ *    sysstat_reset - clear the statistics, on or off.
+ *    sysstat_print - print a line per call seen: count, errors, and
+ *                    average, maximum and total time.
+ *    sysstat_printhist - print the latency histogram of one call, by
+ *                    number or by name.
+ *
+ *    sysstat_enter/sysstat_exit - the hooks called by syscall().
+ *                    sysstat_exit is passed the time from gettime()
+ *                    that sysstat_enter handed back.
+ */
+
+#define SYSSTAT_NCALLS		128	/* call numbers counted */
+#define SYSSTAT_NBUCKETS	24	/* <1us, 1us, 2-3us, ... 4s+ */
+
+extern volatile bool sysstat_enabled;
+
+int sysstat_start(void);
+void sysstat_stop(void);
+void sysstat_reset(void);
+void sysstat_print(void);
+int sysstat_printhist(const char *call);
+
+void sysstat_enter(int callno, time_t *secs, uint32_t *nsecs);
+void sysstat_exit(int callno, int err, time_t secs, uint32_t nsecs);
+
+
+#endif /* _SYSSTAT_H_ */
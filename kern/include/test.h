@@ -79,10 +79,11 @@ int printfile(int, char **);
 /* other tests */
 int malloctest(int, char **);
 int mallocstress(int, char **);
+int workqueuebench(int, char **);
 int nettest(int, char **);
 
 /* Routine for running a user-level program. */
-int runprogram(char *progname);
+int runprogram(char *progname, int nargs, char **args);
 
 /* Kernel menu system. */
 void menu(char *argstr);
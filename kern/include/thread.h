@@ -157,6 +157,12 @@ void thread_exit(void);
  */
 void thread_yield(void);
 
+/*
+ * Yield only if another thread is waiting to run on this cpu. Called
+ * from the timer interrupt.
+ */
+void thread_preempt(void);
+
 /*
  * Reshuffle the run queue. Called from the timer interrupt.
  */
@@ -0,0 +1,54 @@
+#ifndef _TIMER_H_
+#define _TIMER_H_
+
+/*
+ * Timers: call a function a given number of timer ticks from now.
+ * The timer ticks once every LT_GRANULARITY usec (see
+ * dev/lamebus/ltimer.h); this is the same tick that timerclock()
+ * counts.
+ *
+ * Pending timers are kept in a hierarchical timing wheel, so adding
+ * and cancelling take constant time and a tick costs only the timers
+ * that are due, not everything that is waiting. While no timers are
+ * pending the tick is switched off altogether (see timerclock_enable
+ * in clock.h), and the first timer added switches it back on.
+ *
+ * Timer functions are called from the timer interrupt, so they must
+ * not sleep. The struct timer belongs to the caller, who must keep it
+ * until it has fired or been cancelled.
+ *
+ *    timer_init   - set up T to call FUNC(DATA).
+ *    timer_add    - start T, to fire TICKS ticks from now (at least
+ *                   one, and at most what the wheel reaches, about
+ *                   46 hours at the usual tick). T must not already
+ *                   be pending.
+ *    timer_cancel - stop T if it is pending. Returns false if it
+ *                   wasn't, which includes if it has already fired
+ *                   or is firing right now.
+ *    timer_sleep  - put the current thread to sleep for TICKS ticks,
+ *                   however many that is.
+ *
+ *    timer_bootstrap - set up the wheel.
+ *    timer_tick   - advance the wheel by one tick; called by
+ *                   timerclock().
+ */
+
+struct timer {
+	struct timer *tm_next;		/* link in the wheel slot */
+	struct timer **tm_prevp;	/* what points to us */
+	uint32_t tm_expires;		/* tick to fire at */
+	void (*tm_func)(void *);
+	void *tm_data;
+	bool tm_pending;
+};
+
+void timer_init(struct timer *t, void (*func)(void *), void *data);
+void timer_add(struct timer *t, uint32_t ticks);
+bool timer_cancel(struct timer *t);
+void timer_sleep(uint32_t ticks);
+
+void timer_bootstrap(void);
+void timer_tick(void);
+
+
+#endif /* _TIMER_H_ */
@@ -0,0 +1,41 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+/*
+ * Kernel tracepoints.
+ *
+ * TRACE(EV, ARG1, ARG2) records event EV (a TREV_* code from
+ * <kern/trace.h>) with two words of detail, a cycle timestamp, and
+ * the current thread, in the current cpu's trace ring. When tracing
+ * is off it costs a test of trace_enabled. Each ring holds the last
+ * TRACE_NRECORDS events from its cpu; older ones are overwritten.
+ *
+ *    trace_start - start recording, from empty rings. FLAGS, if not
+ *                  NULL, are trace161 tracing flags to turn on for
+ *                  the duration as well.
+ *    trace_stop  - stop recording.
+ *    trace_dump  - stop recording and write the rings to the file
+ *                  PATH, in the format in <kern/trace.h>.
+ */
+
+#include <kern/trace.h>
+
+#define TRACE_NRECORDS	2048	/* per cpu */
+
+extern volatile bool trace_enabled;
+
+void trace_record(unsigned event, uint32_t arg1, uint32_t arg2);
+
+#define TRACE(ev, arg1, arg2) \
+	do { \
+		if (trace_enabled) { \
+			trace_record((ev), (uint32_t)(arg1), (uint32_t)(arg2)); \
+		} \
+	} while (0)
+
+int trace_start(const char *flags);
+void trace_stop(void);
+int trace_dump(const char *path);
+
+
+#endif /* _TRACE_H_ */
@@ -9,15 +9,17 @@
 /* Virtual memory stats */
 /* Tracks stats on user programs */
 
-/* NOTE !!!!!! WARNING !!!!!
- * All of the functions (except vmstats_print) whose names begin with '_'
- * assume that atomicity is ensured elsewhere
- * (i.e., outside of these routines) by acquiring stats_lock.
- * All of the functions whose names do not begin
- * with '_' ensure atomicity locally (except vmstats_print).
+/* The stats are kept in a counter set (see counter.h): each cpu
+ * counts in its own copy without locking, and the copies are added
+ * up when printed. They also show up in the "vm" lines of the
+ * counters: device.
  *
- * Generally you will use the functions whose names
- * do not begin with '_'.
+ * TLB misses that the UTLB handler refills straight from the page
+ * table never reach vm_fault and are not counted; TLB Faults and
+ * TLB Reloads cover only the misses vm_fault handles. A fault that
+ * finds its page already in a file's page cache counts as a reload,
+ * and "Page Faults from ELF" counts every fault that reads a file
+ * page in, mmap'd or not.
  */
 
 
@@ -36,23 +38,29 @@
 #define VMSTAT_ELF_FILE_READ          (7)
 #define VMSTAT_SWAP_FILE_READ         (8)
 #define VMSTAT_SWAP_FILE_WRITE        (9)
-#define VMSTAT_COUNT                 (10)
+#define VMSTAT_TLB_FLUSH_AVOIDED     (10)
+#define VMSTAT_ASID_ROLLOVER         (11)
+#define VMSTAT_TLB_SHOOTDOWN         (12)
+#define VMSTAT_TLB_SHOOTDOWN_DEFER   (13)
+#define VMSTAT_TLB_SHOOTDOWN_USEC    (14)
+#define VMSTAT_COUNT                 (15)
 
 /* ----------------------------------------------------------------------- */
 
-/* Initialize the statistics: must be called before using */
-void vmstats_init(void);                     /* uses locking */
-void _vmstats_init(void);                    /* atomicity must be ensured elsewhere */
+/* Initialize (or reset) the statistics: must be called before printing */
+void vmstats_init(void);
 
 /* Increment the specified count 
  * Example use: 
  *   vmstats_inc(VMSTAT_TLB_FAULT);
  *   vmstats_inc(VMSTAT_PAGE_FAULT_ZERO);
  */
-void vmstats_inc(unsigned int index);    /* uses locking */
-void _vmstats_inc(unsigned int index);   /* atomicity must be ensured elsewhere */
+void vmstats_inc(unsigned int index);
 
-/* Print the statistics: assumes that at least vmstats_init has been called */
-void vmstats_print(void);                    /* Does NOT use locking */
+/* Add AMOUNT to the specified count, for counts of things like time */
+void vmstats_add(unsigned int index, unsigned int amount);
+
+/* Print the statistics */
+void vmstats_print(void);
 
 #endif /* VM_STATS_H */
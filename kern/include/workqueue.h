@@ -0,0 +1,45 @@
+#ifndef _WORKQUEUE_H_
+#define _WORKQUEUE_H_
+
+/*
+ * Work queues: run a function later, in thread context, without
+ * making a thread for it.
+ *
+ * Each cpu has a queue and a fixed pool of WQ_NWORKERS kernel
+ * threads that take items off it in order, so no more than that many
+ * items from one cpu's queue run at once however many are queued.
+ * Items are queued on the current cpu's queue. Queueing takes only a
+ * spinlock and never sleeps or allocates, so it may be done from an
+ * interrupt handler; the function itself runs in a worker and may
+ * sleep.
+ *
+ * A struct work belongs to the caller, who must keep it around until
+ * its function has started. It can be queued again once it has been
+ * taken off the queue, including from its own function.
+ *
+ *    work_init      - set up W to call FUNC(DATA).
+ *    work_queue     - queue W on this cpu. Returns false (and does
+ *                     nothing) if W is already queued.
+ *    workqueue_bootstrap - set up the queues. Work queued before a
+ *                     cpu's workers start runs once they do.
+ *    workqueue_start - start the current cpu's workers. Called once
+ *                     on each cpu as it comes up.
+ */
+
+#define WQ_NWORKERS	2
+
+struct work {
+	struct work *w_next;		/* link on the queue */
+	void (*w_func)(void *);
+	void *w_data;
+	bool w_queued;
+};
+
+void work_init(struct work *w, void (*func)(void *), void *data);
+bool work_queue(struct work *w);
+
+void workqueue_bootstrap(void);
+void workqueue_start(void);
+
+
+#endif /* _WORKQUEUE_H_ */
@@ -0,0 +1,210 @@
+/*
+ * Statistics counters: registration, reading, and the counters:
+ * device. See counter.h.
+ */
+
+#define COUNTERINLINE
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <uio.h>
+#include <vfs.h>
+#include <device.h>
+#include <counter.h>
+
+/* Longest line counters_format produces */
+#define COUNTERS_LINEMAX	80
+
+static struct spinlock counters_lock = SPINLOCK_INITIALIZER;
+static struct counterset *counters_head;	/* protected by counters_lock */
+static struct counterset **counters_tailp = &counters_head;
+
+unsigned
+counter_read(struct counterset *cs, unsigned which)
+{
+	unsigned i, total;
+
+	KASSERT(which < cs->cs_num);
+
+	total = 0;
+	for (i=0; i<MAXCPUS; i++) {
+		total += cs->cs_counts[i * cs->cs_stride + which];
+	}
+	return total;
+}
+
+/*
+ * Sets are only ever added, at the end, so readers can walk the list
+ * without the lock.
+ */
+void
+counterset_register(struct counterset *cs)
+{
+	spinlock_acquire(&counters_lock);
+	if (!cs->cs_registered) {
+		cs->cs_registered = true;
+		cs->cs_next = NULL;
+		*counters_tailp = cs;
+		counters_tailp = &cs->cs_next;
+	}
+	spinlock_release(&counters_lock);
+}
+
+void
+counterset_reset(struct counterset *cs)
+{
+	unsigned i;
+
+	for (i=0; i<MAXCPUS * cs->cs_stride; i++) {
+		cs->cs_counts[i] = 0;
+	}
+}
+
+/*
+ * Format every registered set into BUF, one "set.counter value" line
+ * per counter. Returns the length, or the space needed if that's
+ * more than LEN.
+ */
+static
+size_t
+counters_format(char *buf, size_t len)
+{
+	struct counterset *cs;
+	size_t pos;
+	unsigned i;
+	int n;
+
+	pos = 0;
+	for (cs = counters_head; cs != NULL; cs = cs->cs_next) {
+		for (i=0; i<cs->cs_num; i++) {
+			if (pos + COUNTERS_LINEMAX > len) {
+				pos += COUNTERS_LINEMAX;
+				continue;
+			}
+			n = snprintf(buf + pos, COUNTERS_LINEMAX,
+				     "%s.%-30s %10u\n", cs->cs_name,
+				     cs->cs_names[i], counter_read(cs, i));
+			/* (truncated if it didn't fit) */
+			pos += n < COUNTERS_LINEMAX ? n : COUNTERS_LINEMAX - 1;
+		}
+	}
+	return pos;
+}
+
+void
+counters_print(void)
+{
+	struct counterset *cs;
+	unsigned i;
+
+	for (cs = counters_head; cs != NULL; cs = cs->cs_next) {
+		kprintf("%s:\n", cs->cs_name);
+		for (i=0; i<cs->cs_num; i++) {
+			kprintf("    %-30s %10u\n", cs->cs_names[i],
+				counter_read(cs, i));
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////
+//
+// counters: device
+//
+// Reading it gives the current totals as text, one counter per line,
+// like the menu command. Each read formats the whole thing afresh and
+// hands back the part at the file offset.
+
+static
+int
+countersdev_open(struct device *dev, int openflags)
+{
+	(void)dev;
+
+	if ((openflags & O_ACCMODE) != O_RDONLY) {
+		return EPERM;
+	}
+	return 0;
+}
+
+static
+int
+countersdev_close(struct device *dev)
+{
+	(void)dev;
+	return 0;
+}
+
+static
+int
+countersdev_io(struct device *dev, struct uio *uio)
+{
+	char *buf;
+	size_t len, need;
+	int result;
+
+	(void)dev;
+
+	if (uio->uio_rw != UIO_READ) {
+		return EPERM;
+	}
+
+	/* Sets may be registered while we allocate; go round again. */
+	len = 0;
+	buf = NULL;
+	while ((need = counters_format(buf, len)) > len) {
+		kfree(buf);
+		len = need;
+		buf = kmalloc(len);
+		if (buf == NULL) {
+			return ENOMEM;
+		}
+	}
+
+	result = 0;
+	if (uio->uio_offset < (off_t)need) {
+		result = uiomove(buf + uio->uio_offset,
+				 need - uio->uio_offset, uio);
+	}
+	kfree(buf);
+	return result;
+}
+
+static
+int
+countersdev_ioctl(struct device *dev, int op, userptr_t data)
+{
+	(void)dev;
+	(void)op;
+	(void)data;
+	return EINVAL;
+}
+
+void
+counters_bootstrap(void)
+{
+	struct device *dev;
+	int result;
+
+	dev = kmalloc(sizeof(*dev));
+	if (dev == NULL) {
+		panic("Could not add counters device: out of memory\n");
+	}
+
+	dev->d_open = countersdev_open;
+	dev->d_close = countersdev_close;
+	dev->d_io = countersdev_io;
+	dev->d_ioctl = countersdev_ioctl;
+	dev->d_blocks = 0;
+	dev->d_blocksize = 1;
+	dev->d_devnumber = 0; /* assigned by vfs_adddev */
+	dev->d_data = NULL;
+
+	result = vfs_adddev("counters", dev, 0);
+	if (result) {
+		panic("Could not add counters device: %s\n",
+		      strerror(result));
+	}
+}
@@ -33,10 +33,12 @@
 #include <lib.h>
 #include <spl.h>
 #include <thread.h>
+#include <cpu.h>
 #include <current.h>
 #include <synch.h>
 #include <mainbus.h>
 #include <vfs.h>          // for vfs_sync()
+#include <platform/maxcpus.h>
 
 
 /* Flags word for DEBUG() macro. */
@@ -48,6 +50,63 @@ static struct lock *kprintf_lock;
 /* Lock for polled kprintfs */
 static struct spinlock kprintf_spinlock;
 
+/*
+ * Log rings.
+ *
+ * Once a cpu has called kprintf_startlog, kprintf on that cpu formats
+ * straight into the cpu's own ring with interrupts off, taking no
+ * lock except to number the message, and returns; the klog thread
+ * prints messages from all the rings in number order later. So a
+ * DEBUG() doesn't wait for the serial port, and doesn't hold up
+ * kprintfs on other cpus either.
+ *
+ * The indexes run freely and are reduced mod KLOG_SIZE to index the
+ * buffer. Each record is a struct klog_hdr followed by the text,
+ * padded to KLOG_ALIGN. Records from kl_oldest to kl_tail have been
+ * printed and are kept for kprintf_dumplog until the space is needed;
+ * records from kl_tail to kl_head are waiting to be printed. Only
+ * the cpu itself moves kl_head and kl_oldest, and only the klog
+ * thread moves kl_tail. When a message would overwrite unprinted
+ * ones, a caller that can sleep drains the rings and prints it
+ * directly instead; one that holds a spinlock or is in an interrupt
+ * handler drops it and counts it.
+ */
+#define KLOG_SIZE	8192		/* per cpu; must be a power of 2 */
+#define KLOG_ALIGN	8
+#define KLOG_RECSIZE(len) ROUNDUP(sizeof(struct klog_hdr) + (len), KLOG_ALIGN)
+
+struct klog_hdr {
+	uint32_t kh_seq;		/* global message number */
+	uint32_t kh_len;		/* length of the text */
+};
+
+struct klog {
+	char *kl_buf;			/* NULL until kprintf_startlog */
+	volatile unsigned kl_head;	/* end of the newest record */
+	volatile unsigned kl_tail;	/* next record to print */
+	unsigned kl_oldest;		/* oldest record still kept */
+	unsigned kl_dropped;		/* messages that didn't fit */
+};
+
+/* State for klog_send while formatting one message */
+struct klog_writer {
+	struct klog *kw_klog;
+	unsigned kw_pos;		/* where the next char goes */
+	bool kw_ok;			/* false once out of room */
+};
+
+static struct klog klogs[MAXCPUS];
+static struct spinlock klog_seqlock;	/* protects klog_seq */
+static uint32_t klog_seq;
+static struct semaphore *klog_sem;	/* wakes the klog thread */
+static volatile bool klog_wakeup;	/* klog_sem already V'd */
+static struct lock *klog_drainlock;	/* one printer at a time */
+static volatile bool klog_stopped;	/* shutdown or panic */
+static volatile bool klog_dumping;	/* keep printed records */
+
+static bool klog_drainone(void);
+static void klog_thread(void *, unsigned long);
+
 
 /*
  * Warning: all this has to work from interrupt handlers and when
@@ -69,6 +128,39 @@ kprintf_bootstrap(void)
 		panic("Could not create kprintf_lock\n");
 	}
 	spinlock_init(&kprintf_spinlock);
+
+	spinlock_init(&klog_seqlock);
+	klog_sem = sem_create("klog", 0);
+	klog_drainlock = lock_create("klog");
+	if (klog_sem == NULL || klog_drainlock == NULL) {
+		panic("Could not create klog synchronization\n");
+	}
+	if (thread_fork("klog", NULL, klog_thread, NULL, 0)) {
+		panic("Could not start klog thread\n");
+	}
+}
+
+/*
+ * Give the current cpu a log ring, so its kprintfs stop waiting for
+ * the console. Called once on each cpu as it comes up.
+ */
+void
+kprintf_startlog(void)
+{
+	struct klog *kl = &klogs[curcpu->c_number];
+	char *buf;
+
+	KASSERT(kl->kl_buf == NULL);
+
+	buf = kmalloc(KLOG_SIZE);
+	if (buf == NULL) {
+		/* Not fatal; this cpu just keeps printing directly. */
+		kprintf("cpu%u: no memory for log ring\n", curcpu->c_number);
+		return;
+	}
+	kl->kl_head = kl->kl_tail = kl->kl_oldest = 0;
+	kl->kl_dropped = 0;
+	kl->kl_buf = buf;
 }
 
 /*
@@ -87,6 +179,281 @@ console_send(void *junk, const char *data, size_t len)
 	}
 }
 
+static
+struct klog_hdr *
+klog_hdrat(struct klog *kl, unsigned pos)
+{
+	return (struct klog_hdr *)(kl->kl_buf + pos % KLOG_SIZE);
+}
+
+/*
+ * Make sure the ring has space up to index END, discarding printed
+ * records as needed. Fails if that would mean losing unprinted ones.
+ */
+static
+bool
+klog_makeroom(struct klog *kl, unsigned end)
+{
+	while (end - kl->kl_oldest > KLOG_SIZE) {
+		if (kl->kl_oldest == kl->kl_tail || klog_dumping) {
+			return false;
+		}
+		kl->kl_oldest += KLOG_RECSIZE(klog_hdrat(kl, kl->kl_oldest)->kh_len);
+	}
+	return true;
+}
+
+/*
+ * Append characters to the message being formatted. Backend for
+ * __vprintf.
+ */
+static
+void
+klog_send(void *vkw, const char *data, size_t len)
+{
+	struct klog_writer *kw = vkw;
+	struct klog *kl = kw->kw_klog;
+	size_t i;
+
+	for (i=0; i<len && kw->kw_ok; i++) {
+		kw->kw_ok = klog_makeroom(kl, kw->kw_pos + 1);
+		if (kw->kw_ok) {
+			kl->kl_buf[kw->kw_pos % KLOG_SIZE] = data[i];
+			kw->kw_pos++;
+		}
+	}
+}
+
+/*
+ * Format a message into the current cpu's ring and wake the klog
+ * thread. If the caller holds a spinlock, waking it could deadlock,
+ * so leave that to kprintf_poll. If the ring is full of unprinted
+ * messages and the caller can sleep, print everything waiting and
+ * then this message directly, so nothing is lost.
+ */
+static
+int
+klog_vprintf(const char *fmt, va_list ap)
+{
+	struct klog_writer kw;
+	struct klog_hdr *kh;
+	struct klog *kl;
+	unsigned start, len;
+	bool canwake, cansleep, logged;
+	va_list ap2;
+	int chars, spl;
+
+	canwake = curthread->t_iplhigh_count ==
+		(curthread->t_in_interrupt ? 1 : 0);
+	cansleep = !curthread->t_in_interrupt &&
+		curthread->t_iplhigh_count == 0;
+
+	va_copy(ap2, ap);
+	spl = splhigh();
+	kl = &klogs[curcpu->c_number];
+	start = kl->kl_head;
+
+	kw.kw_klog = kl;
+	kw.kw_pos = start + sizeof(struct klog_hdr);
+	kw.kw_ok = klog_makeroom(kl, kw.kw_pos);
+	chars = __vprintf(klog_send, &kw, fmt, ap);
+
+	len = kw.kw_pos - start - sizeof(struct klog_hdr);
+	logged = kw.kw_ok && klog_makeroom(kl, start + KLOG_RECSIZE(len));
+	if (logged) {
+		kh = klog_hdrat(kl, start);
+		kh->kh_len = len;
+		spinlock_acquire(&klog_seqlock);
+		kh->kh_seq = klog_seq++;
+		spinlock_release(&klog_seqlock);
+		/* publish it */
+		kl->kl_head = start + KLOG_RECSIZE(len);
+	}
+	else if (!cansleep) {
+		kl->kl_dropped++;
+	}
+	splx(spl);
+
+	if (!logged && cansleep) {
+		/* Everything logged before it goes first. */
+		lock_acquire(klog_drainlock);
+		while (klog_drainone()) {
+			/* nothing */
+		}
+		putch_prepare();
+		__vprintf(console_send, NULL, fmt, ap2);
+		putch_complete();
+		lock_release(klog_drainlock);
+	}
+	else if (canwake && !klog_wakeup) {
+		klog_wakeup = true;
+		V(klog_sem);
+	}
+	va_end(ap2);
+	return chars;
+}
+
+/*
+ * Print LEN characters of a record's text starting at index POS.
+ */
+static
+void
+klog_output(struct klog *kl, unsigned pos, unsigned len)
+{
+	unsigned off, first;
+
+	off = pos % KLOG_SIZE;
+	first = len < KLOG_SIZE - off ? len : KLOG_SIZE - off;
+
+	putch_prepare();
+	console_send(NULL, kl->kl_buf + off, first);
+	console_send(NULL, kl->kl_buf, len - first);
+	putch_complete();
+}
+
+/*
+ * Print the lowest-numbered waiting message from any cpu. Returns
+ * false if there wasn't one. Called with klog_drainlock held, except
+ * when panicking.
+ */
+static
+bool
+klog_drainone(void)
+{
+	struct klog *kl, *best;
+	struct klog_hdr *kh, *besthdr;
+	unsigned i;
+
+	best = NULL;
+	besthdr = NULL;
+	for (i=0; i<MAXCPUS; i++) {
+		kl = &klogs[i];
+		if (kl->kl_buf == NULL || kl->kl_tail == kl->kl_head) {
+			continue;
+		}
+		kh = klog_hdrat(kl, kl->kl_tail);
+		if (best == NULL || (int32_t)(kh->kh_seq - besthdr->kh_seq) < 0) {
+			best = kl;
+			besthdr = kh;
+		}
+	}
+	if (best == NULL) {
+		return false;
+	}
+
+	klog_output(best, best->kl_tail + sizeof(struct klog_hdr),
+		    besthdr->kh_len);
+	best->kl_tail += KLOG_RECSIZE(besthdr->kh_len);
+	return true;
+}
+
+/*
+ * The klog thread. Everything else that is runnable goes first: it
+ * gets out of the way between messages.
+ */
+static
+void
+klog_thread(void *junk1, unsigned long junk2)
+{
+	(void)junk1;
+	(void)junk2;
+
+	while (1) {
+		P(klog_sem);
+		klog_wakeup = false;
+
+		lock_acquire(klog_drainlock);
+		while (klog_drainone()) {
+			thread_preempt();
+		}
+		lock_release(klog_drainlock);
+	}
+}
+
+/*
+ * Wake the klog thread for messages that were logged without waking
+ * it. Called from hardclock, and by a cpu about to stop its clock to
+ * idle. Any cpu's hardclock may be stopped, so look at every ring.
+ */
+void
+kprintf_poll(void)
+{
+	struct klog *kl;
+	unsigned i;
+
+	if (klog_wakeup) {
+		return;
+	}
+	for (i=0; i<MAXCPUS; i++) {
+		kl = &klogs[i];
+		if (kl->kl_buf != NULL && kl->kl_tail != kl->kl_head) {
+			klog_wakeup = true;
+			V(klog_sem);
+			return;
+		}
+	}
+}
+
+/*
+ * Go back to printing directly, and print what's still in the rings.
+ * For shutdown.
+ */
+void
+kprintf_stoplog(void)
+{
+	klog_stopped = true;
+
+	lock_acquire(klog_drainlock);
+	while (klog_drainone()) {
+		/* nothing */
+	}
+	lock_release(klog_drainlock);
+}
+
+/*
+ * Print each cpu's ring: the messages still kept there after being
+ * printed, newest last, and how many were dropped.
+ */
+void
+kprintf_dumplog(void)
+{
+	struct klog *kl;
+	struct klog_hdr *kh;
+	unsigned i, pos;
+	char line[64];
+
+	lock_acquire(klog_drainlock);
+	/* Print what's waiting first, and keep producers off the rest. */
+	while (klog_drainone()) {
+		/* nothing */
+	}
+	klog_dumping = true;
+
+	for (i=0; i<MAXCPUS; i++) {
+		kl = &klogs[i];
+		if (kl->kl_buf == NULL) {
+			continue;
+		}
+		/* Not kprintf, which would only queue it in the ring. */
+		snprintf(line, sizeof(line), "---- cpu%u log (%u dropped) ----\n",
+			 i, kl->kl_dropped);
+		console_send(NULL, line, strlen(line));
+		for (pos = kl->kl_oldest; pos != kl->kl_tail;
+		     pos += KLOG_RECSIZE(kh->kh_len)) {
+			kh = klog_hdrat(kl, pos);
+			if (kh->kh_len > KLOG_SIZE) {
+				/* overwritten under us */
+				break;
+			}
+			klog_output(kl, pos + sizeof(struct klog_hdr),
+				    kh->kh_len);
+		}
+	}
+
+	klog_dumping = false;
+	lock_release(klog_drainlock);
+}
+
 /*
  * Printf to the console.
  */
@@ -97,6 +464,14 @@ kprintf(const char *fmt, ...)
 	va_list ap;
 	bool dolock;
 
+	if (klog_sem != NULL && !klog_stopped &&
+	    klogs[curcpu->c_number].kl_buf != NULL) {
+		va_start(ap, fmt);
+		chars = klog_vprintf(fmt, ap);
+		va_end(ap);
+		return chars;
+	}
+
 	dolock = kprintf_lock != NULL
 		&& curthread->t_in_interrupt == false
 		&& curthread->t_iplhigh_count == 0;
@@ -157,6 +532,7 @@ panic(const char *fmt, ...)
 		 * switches. So turn interrupts off on this CPU.
 		 */
 		splhigh();
+		klog_stopped = true;
 	}
 
 	if (evil == 1) {
@@ -169,6 +545,11 @@ panic(const char *fmt, ...)
 	if (evil == 2) {
 		evil = 3;
 
+		/* Print what was logged before it. */
+		while (klog_drainone()) {
+			/* nothing */
+		}
+
 		/* Print the message. */
 		kprintf("panic: ");
 		putch_prepare();
@@ -0,0 +1,79 @@
+/*
+ * Per-cpu buffers for tracing and statistics. See percpu.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <lib.h>
+#include <cpu.h>
+#include <uio.h>
+#include <vfs.h>
+#include <vnode.h>
+#include <percpu.h>
+
+int
+percpu_alloc(struct percpu *pc)
+{
+	unsigned i, ncpus;
+
+	ncpus = cpu_count();
+	for (i=0; i<ncpus; i++) {
+		if (pc->pc_bufs[i] == NULL) {
+			pc->pc_bufs[i] = kmalloc(pc->pc_size);
+			if (pc->pc_bufs[i] == NULL) {
+				return ENOMEM;
+			}
+		}
+	}
+
+	percpu_zero(pc);
+	return 0;
+}
+
+void
+percpu_zero(struct percpu *pc)
+{
+	unsigned i;
+
+	for (i=0; i<MAXCPUS; i++) {
+		if (pc->pc_bufs[i] != NULL) {
+			bzero(pc->pc_bufs[i], pc->pc_size);
+		}
+	}
+}
+
+int
+percpu_openfile(const char *path, struct vnode **ret)
+{
+	char *pathcopy;
+	int result;
+
+	/* vfs_open destroys the string it's passed */
+	pathcopy = kstrdup(path);
+	if (pathcopy == NULL) {
+		return ENOMEM;
+	}
+	result = vfs_open(pathcopy, O_WRONLY|O_CREAT|O_TRUNC, 0664, ret);
+	kfree(pathcopy);
+	return result;
+}
+
+int
+percpu_write(struct vnode *vn, void *buf, size_t len, off_t *pos)
+{
+	struct iovec iov;
+	struct uio ku;
+	int result;
+
+	uio_kinit(&iov, &ku, buf, len, *pos, UIO_WRITE);
+	result = VOP_WRITE(vn, &ku);
+	if (result) {
+		return result;
+	}
+	if (ku.uio_resid != 0) {
+		return ENOSPC;
+	}
+	*pos = ku.uio_offset;
+	return 0;
+}
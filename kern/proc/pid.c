@@ -0,0 +1,308 @@
+/*
+ * Process id table. See pid.h.
+ *
+ * Each slot is either free, on the free list, or holds the pid of a
+ * live or exited process that somebody may still want to wait for.
+ * A process's children are on a doubly-linked sibling list running
+ * through the table (by slot number), so exit can orphan them and
+ * waitpid can unlink a child without searching.
+ *
+ * Everything is protected by pid_lock. Each slot has a CV, on which
+ * the parent waits for the child; it is made the first time the slot
+ * is used and kept after that.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/wait.h>
+#include <limits.h>
+#include <lib.h>
+#include <synch.h>
+#include <copyinout.h>
+#include <pid.h>
+
+#define NOSLOT		(-1)
+#define PIDSLOT(pid)	((int)((pid) % PIDTABLE_SIZE))
+
+struct pidinfo {
+	pid_t pi_pid;		/* pid in this slot (or last, if free) */
+	bool pi_inuse;
+	bool pi_exited;
+	int pi_status;		/* waitpid status, once exited */
+	pid_t pi_ppid;		/* parent, or 0 for none */
+	int pi_child;		/* first child's slot */
+	int pi_prevsib;		/* parent's other children */
+	int pi_nextsib;
+	int pi_nextfree;	/* free list */
+	struct cv *pi_cv;	/* the parent waits here */
+};
+
+static struct pidinfo pidtable[PIDTABLE_SIZE];
+static int pid_freehead, pid_freetail;
+static struct lock *pid_lock;
+
+void
+pid_bootstrap(void)
+{
+	struct pidinfo *pi;
+	int i;
+
+	pid_lock = lock_create("pid_lock");
+	if (pid_lock == NULL) {
+		panic("pid_bootstrap: lock_create failed\n");
+	}
+
+	/*
+	 * Start every slot one lap early, so its first pid is the
+	 * lowest one that is legal and lands in the slot.
+	 */
+	for (i=0; i<PIDTABLE_SIZE; i++) {
+		pi = &pidtable[i];
+		pi->pi_pid = i - PIDTABLE_SIZE;
+		while (pi->pi_pid + PIDTABLE_SIZE < PID_MIN) {
+			pi->pi_pid += PIDTABLE_SIZE;
+		}
+		pi->pi_inuse = false;
+		pi->pi_cv = NULL;
+		pi->pi_nextfree = (i + 1 < PIDTABLE_SIZE) ? i + 1 : NOSLOT;
+	}
+	pid_freehead = 0;
+	pid_freetail = PIDTABLE_SIZE - 1;
+}
+
+/*
+ * Find the entry for PID, or NULL if there is none.
+ */
+static
+struct pidinfo *
+pid_lookup(pid_t pid)
+{
+	struct pidinfo *pi;
+
+	if (pid < PID_MIN || pid > PID_MAX) {
+		return NULL;
+	}
+	pi = &pidtable[PIDSLOT(pid)];
+	if (!pi->pi_inuse || pi->pi_pid != pid) {
+		return NULL;
+	}
+	return pi;
+}
+
+/*
+ * Take PI off its parent's list of children.
+ */
+static
+void
+pid_unlink(struct pidinfo *pi)
+{
+	struct pidinfo *parent;
+
+	if (pi->pi_ppid == 0) {
+		return;
+	}
+	parent = pid_lookup(pi->pi_ppid);
+	KASSERT(parent != NULL);
+
+	if (pi->pi_prevsib == NOSLOT) {
+		parent->pi_child = pi->pi_nextsib;
+	}
+	else {
+		pidtable[pi->pi_prevsib].pi_nextsib = pi->pi_nextsib;
+	}
+	if (pi->pi_nextsib != NOSLOT) {
+		pidtable[pi->pi_nextsib].pi_prevsib = pi->pi_prevsib;
+	}
+	pi->pi_ppid = 0;
+}
+
+/*
+ * Put PI's slot at the end of the free list.
+ */
+static
+void
+pid_release(struct pidinfo *pi)
+{
+	int slot;
+
+	KASSERT(pi->pi_ppid == 0);
+	KASSERT(pi->pi_child == NOSLOT);
+
+	slot = pi - pidtable;
+	pi->pi_inuse = false;
+	pi->pi_nextfree = NOSLOT;
+	if (pid_freetail == NOSLOT) {
+		pid_freehead = slot;
+	}
+	else {
+		pidtable[pid_freetail].pi_nextfree = slot;
+	}
+	pid_freetail = slot;
+}
+
+int
+pid_alloc(pid_t *ret)
+{
+	struct pidinfo *pi;
+	int slot;
+
+	lock_acquire(pid_lock);
+
+	slot = pid_freehead;
+	if (slot == NOSLOT) {
+		lock_release(pid_lock);
+		return ENPROC;
+	}
+	pi = &pidtable[slot];
+
+	if (pi->pi_cv == NULL) {
+		pi->pi_cv = cv_create("pid");
+		if (pi->pi_cv == NULL) {
+			lock_release(pid_lock);
+			return ENOMEM;
+		}
+	}
+
+	pid_freehead = pi->pi_nextfree;
+	if (pid_freehead == NOSLOT) {
+		pid_freetail = NOSLOT;
+	}
+
+	/* Next lap's pid for this slot, wrapping at PID_MAX. */
+	pi->pi_pid += PIDTABLE_SIZE;
+	if (pi->pi_pid > PID_MAX) {
+		pi->pi_pid = slot;
+		while (pi->pi_pid < PID_MIN) {
+			pi->pi_pid += PIDTABLE_SIZE;
+		}
+	}
+	KASSERT(PIDSLOT(pi->pi_pid) == slot);
+
+	pi->pi_inuse = true;
+	pi->pi_exited = false;
+	pi->pi_status = 0;
+	pi->pi_ppid = 0;
+	pi->pi_child = NOSLOT;
+	pi->pi_prevsib = NOSLOT;
+	pi->pi_nextsib = NOSLOT;
+
+	*ret = pi->pi_pid;
+	lock_release(pid_lock);
+	return 0;
+}
+
+void
+pid_setparent(pid_t pid, pid_t parent)
+{
+	struct pidinfo *pi, *ppi;
+	int slot;
+
+	lock_acquire(pid_lock);
+	pi = pid_lookup(pid);
+	KASSERT(pi != NULL);
+	KASSERT(!pi->pi_exited);
+
+	pid_unlink(pi);
+	if (parent != 0) {
+		ppi = pid_lookup(parent);
+		KASSERT(ppi != NULL);
+		slot = pi - pidtable;
+		pi->pi_ppid = parent;
+		pi->pi_prevsib = NOSLOT;
+		pi->pi_nextsib = ppi->pi_child;
+		if (ppi->pi_child != NOSLOT) {
+			pidtable[ppi->pi_child].pi_prevsib = slot;
+		}
+		ppi->pi_child = slot;
+	}
+	lock_release(pid_lock);
+}
+
+void
+pid_exit(pid_t pid, int status)
+{
+	struct pidinfo *pi, *child;
+	int slot, next;
+
+	lock_acquire(pid_lock);
+	pi = pid_lookup(pid);
+	KASSERT(pi != NULL);
+	KASSERT(!pi->pi_exited);
+
+	/*
+	 * Orphan the children. Those that have exited already were
+	 * only waiting for us, so they can go now.
+	 */
+	for (slot = pi->pi_child; slot != NOSLOT; slot = next) {
+		child = &pidtable[slot];
+		next = child->pi_nextsib;
+		child->pi_ppid = 0;
+		if (child->pi_exited) {
+			pid_release(child);
+		}
+	}
+	pi->pi_child = NOSLOT;
+
+	pi->pi_exited = true;
+	pi->pi_status = status;
+	if (pi->pi_ppid == 0) {
+		pid_release(pi);
+	}
+	else {
+		cv_broadcast(pi->pi_cv, pid_lock);
+	}
+	lock_release(pid_lock);
+}
+
+int
+pid_wait(pid_t pid, pid_t parent, int options, userptr_t status,
+	 pid_t *ret)
+{
+	struct pidinfo *pi;
+	int exitstatus;
+	int result;
+
+	if ((options & ~WNOHANG) != 0) {
+		return EINVAL;
+	}
+
+	lock_acquire(pid_lock);
+	pi = pid_lookup(pid);
+	if (pi == NULL) {
+		lock_release(pid_lock);
+		return ESRCH;
+	}
+	if (pi->pi_ppid != parent) {
+		lock_release(pid_lock);
+		return ECHILD;
+	}
+
+	while (!pi->pi_exited) {
+		if (options & WNOHANG) {
+			lock_release(pid_lock);
+			*ret = 0;
+			return 0;
+		}
+		cv_wait(pi->pi_cv, pid_lock);
+	}
+
+	exitstatus = pi->pi_status;
+	pid_unlink(pi);
+	pid_release(pi);
+	lock_release(pid_lock);
+
+	/*
+	 * Copy the status out only after dropping pid_lock, so a fault
+	 * here doesn't hold up every fork, exit, and waitpid. The child
+	 * is reaped even if this fails.
+	 */
+	if (status != NULL) {
+		result = copyout(&exitstatus, status, sizeof(int));
+		if (result) {
+			return result;
+		}
+	}
+
+	*ret = pid;
+	return 0;
+}
@@ -43,13 +43,20 @@
  */
 
 #include <types.h>
+#include <limits.h>
 #include <proc.h>
 #include <current.h>
 #include <addrspace.h>
 #include <vnode.h>
 #include <vfs.h>
 #include <synch.h>
+#include <file.h>
+#include <pid.h>
+#include <workqueue.h>
+#include <cpu.h>
+#include <platform/maxcpus.h>
 #include <kern/fcntl.h>  
+#include <kern/unistd.h>
 
 /*
  * The process for the kernel; this holds all the kernel-only threads.
@@ -60,16 +67,34 @@ struct proc *kproc;
  * Mechanism for making the kernel menu thread sleep while processes are running
  */
 #ifdef UW
-/* count of the number of processes, excluding kproc */
-static volatile unsigned int proc_count;
-/* provides mutual exclusion for proc_count */
-/* it would be better to use a lock here, but we use a semaphore because locks are not implemented in the base kernel */ 
-static struct semaphore *proc_count_mutex;
 /* used to signal the kernel menu thread when there are no processes */
 struct semaphore *no_proc_sem;   
+/* number of cpus whose pc_nprocs is nonzero; protected by proc_busy_lock */
+static unsigned proc_busycpus;
+static struct spinlock proc_busy_lock;
 #endif  // UW
 
+/*
+ * Per-cpu process bookkeeping, so that fork and exit don't all
+ * serialize on one counter.
+ *
+ * Each process is counted on the cpu that created it (p_cpu), so
+ * every pc_nprocs is exact and the system is empty exactly when all
+ * of them are zero. proc_busycpus tracks that, and only needs its
+ * lock when a cpu's count goes between zero and nonzero.
+ *
+ * Exiting processes go on the list of the cpu they exit on, and
+ * pc_reapwork, queued when the list stops being empty, frees their
+ * address spaces and proc structures in batches, off the exit path.
+ */
+struct proccpu {
+	struct spinlock pc_lock;
+	unsigned pc_nprocs;		/* processes counted here */
+	struct proc *pc_dead;		/* waiting for the reaper */
+	struct work pc_reapwork;	/* runs proc_reap */
+};
 
+static struct proccpu proccpus[MAXCPUS];
 
 /*
  * Create a proc structure.
@@ -92,6 +117,11 @@ proc_create(const char *name)
 
 	threadarray_init(&proc->p_threads);
 	spinlock_init(&proc->p_lock);
+	proc->p_pid = 0;
+	proc->p_exitstatus = 0;
+	proc->p_cpu = 0;
+	proc->p_reapnext = NULL;
+	proc->p_vforkwait = NULL;
 
 	/* VM fields */
 	proc->p_addrspace = NULL;
@@ -99,11 +129,71 @@ proc_create(const char *name)
 	/* VFS fields */
 	proc->p_cwd = NULL;
 
+	/* Open files */
+	proc->p_filetable = NULL;
+
+	return proc;
+}
+
+/*
+ * Free what is left of a dead process: its address space, if it
+ * still has one, and the structure itself.
+ */
+static
+void
+proc_free(struct proc *proc)
+{
 #ifdef UW
-	proc->console = NULL;
+	if (proc->p_addrspace) {
+		as_destroy(proc->p_addrspace);
+		proc->p_addrspace = NULL;
+	}
 #endif // UW
 
-	return proc;
+	threadarray_cleanup(&proc->p_threads);
+	spinlock_cleanup(&proc->p_lock);
+
+	kfree(proc->p_name);
+	kfree(proc);
+}
+
+/*
+ * Reaper: free the dead processes on PC's list, a list at a time.
+ * Runs from the work queue.
+ */
+static
+void
+proc_reap(void *vpc)
+{
+	struct proccpu *pc = vpc;
+	struct proc *dead, *next;
+
+	spinlock_acquire(&pc->pc_lock);
+	dead = pc->pc_dead;
+	pc->pc_dead = NULL;
+	spinlock_release(&pc->pc_lock);
+
+	for (; dead != NULL; dead = next) {
+		next = dead->p_reapnext;
+		proc_free(dead);
+	}
+}
+
+bool
+proc_endvfork(struct proc *proc)
+{
+	struct semaphore *sem;
+
+	spinlock_acquire(&proc->p_lock);
+	sem = proc->p_vforkwait;
+	proc->p_vforkwait = NULL;
+	spinlock_release(&proc->p_lock);
+
+	if (sem == NULL) {
+		return false;
+	}
+	V(sem);
+	return true;
 }
 
 /*
@@ -112,9 +202,15 @@ proc_create(const char *name)
 void
 proc_destroy(struct proc *proc)
 {
+#ifdef UW
+	struct proccpu *pc;
+	bool wasempty, lastproc;
+#endif // UW
+
 	/*
          * note: some parts of the process structure, such as the address space,
-         *  are destroyed in sys_exit, before we get here
+         *  are detached in sys_exit, before we get here; the address space
+         *  is freed afterwards by the reaper
          *
          * note: depending on where this function is called from, curproc may not
          * be defined because the calling thread may have already detached itself
@@ -123,6 +219,7 @@ proc_destroy(struct proc *proc)
 
 	KASSERT(proc != NULL);
 	KASSERT(proc != kproc);
+	KASSERT(proc->p_vforkwait == NULL);
 
 	/*
 	 * We don't take p_lock in here because we must have the only
@@ -157,34 +254,58 @@ proc_destroy(struct proc *proc)
 	}
 #endif // UW
 
-#ifdef UW
-	if (proc->console) {
-	  vfs_close(proc->console);
+	if (proc->p_filetable) {
+		filetable_destroy(proc->p_filetable);
+		proc->p_filetable = NULL;
 	}
-#endif // UW
-
-	threadarray_cleanup(&proc->p_threads);
-	spinlock_cleanup(&proc->p_lock);
 
-	kfree(proc->p_name);
-	kfree(proc);
+	/* Hand the exit status to the parent, or free the pid. */
+	if (proc->p_pid != 0) {
+		pid_exit(proc->p_pid, proc->p_exitstatus);
+	}
 
 #ifdef UW
-	/* decrement the process count */
+	/* decrement the process count on the cpu that counted it */
         /* note: kproc is not included in the process count, but proc_destroy
 	   is never called on kproc (see KASSERT above), so we're OK to decrement
-	   the proc_count unconditionally here */
-	P(proc_count_mutex); 
-	KASSERT(proc_count > 0);
-	proc_count--;
+	   the count unconditionally here */
+	pc = &proccpus[proc->p_cpu];
+	lastproc = false;
+	spinlock_acquire(&pc->pc_lock);
+	KASSERT(pc->pc_nprocs > 0);
+	pc->pc_nprocs--;
+	if (pc->pc_nprocs == 0) {
+		spinlock_acquire(&proc_busy_lock);
+		KASSERT(proc_busycpus > 0);
+		proc_busycpus--;
+		lastproc = (proc_busycpus == 0);
+		spinlock_release(&proc_busy_lock);
+	}
+	spinlock_release(&pc->pc_lock);
+
 	/* signal the kernel menu thread if the process count has reached zero */
-	if (proc_count == 0) {
+	if (lastproc) {
 	  V(no_proc_sem);
 	}
-	V(proc_count_mutex);
-#endif // UW
-	
 
+	/* leave the rest to the reaper */
+	pc = &proccpus[curcpu->c_number];
+	spinlock_acquire(&pc->pc_lock);
+	wasempty = (pc->pc_dead == NULL);
+	proc->p_reapnext = pc->pc_dead;
+	pc->pc_dead = proc;
+	spinlock_release(&pc->pc_lock);
+
+	if (wasempty) {
+		work_queue(&pc->pc_reapwork);
+	}
+#else
+	threadarray_cleanup(&proc->p_threads);
+	spinlock_cleanup(&proc->p_lock);
+
+	kfree(proc->p_name);
+	kfree(proc);
+#endif // UW
 }
 
 /*
@@ -193,16 +314,24 @@ proc_destroy(struct proc *proc)
 void
 proc_bootstrap(void)
 {
+#ifdef UW
+  unsigned i;
+#endif // UW
+
+  pid_bootstrap();
   kproc = proc_create("[kernel]");
   if (kproc == NULL) {
     panic("proc_create for kproc failed\n");
   }
 #ifdef UW
-  proc_count = 0;
-  proc_count_mutex = sem_create("proc_count_mutex",1);
-  if (proc_count_mutex == NULL) {
-    panic("could not create proc_count_mutex semaphore\n");
+  for (i=0; i<MAXCPUS; i++) {
+    spinlock_init(&proccpus[i].pc_lock);
+    proccpus[i].pc_nprocs = 0;
+    proccpus[i].pc_dead = NULL;
+    work_init(&proccpus[i].pc_reapwork, proc_reap, &proccpus[i]);
   }
+  proc_busycpus = 0;
+  spinlock_init(&proc_busy_lock);
   no_proc_sem = sem_create("no_proc_sem",0);
   if (no_proc_sem == NULL) {
     panic("could not create no_proc_sem semaphore\n");
@@ -211,33 +340,49 @@ proc_bootstrap(void)
 }
 
 /*
- * Create a fresh proc for use by runprogram.
- *
- * It will have no address space and will inherit the current
- * process's (that is, the kernel menu's) current directory.
+ * Open the console as file descriptor FD of PROC.
  */
+static
+int
+proc_openconsole(struct proc *proc, int fd, int openflags)
+{
+	struct openfile *of;
+	char path[5];
+	int placed, result;
+
+	/* vfs_open destroys the path, so it needs a fresh copy each time */
+	strcpy(path, "con:");
+	result = openfile_open(path, openflags, 0, &of);
+	if (result) {
+		return result;
+	}
+	result = filetable_place(proc->p_filetable, of, &placed);
+	if (result) {
+		openfile_decref(of);
+		return result;
+	}
+	KASSERT(placed == fd);
+	return 0;
+}
+
+/*
+ * Create a fresh user proc, with no address space and no file table.
+ * It inherits the current process's current directory and gets a pid.
+ */
+static
 struct proc *
-proc_create_runprogram(const char *name)
+proc_create_user(const char *name)
 {
 	struct proc *proc;
-	char *console_path;
+#ifdef UW
+	struct proccpu *pc;
+#endif // UW
+	int result;
 
 	proc = proc_create(name);
 	if (proc == NULL) {
 		return NULL;
 	}
-
-#ifdef UW
-	/* open the console - this should always succeed */
-	console_path = kstrdup("con:");
-	if (console_path == NULL) {
-	  panic("unable to copy console path name during process creation\n");
-	}
-	if (vfs_open(console_path,O_WRONLY,0,&(proc->console))) {
-	  panic("unable to open the console during process creation\n");
-	}
-	kfree(console_path);
-#endif // UW
 	  
 	/* VM fields */
 
@@ -263,14 +408,93 @@ proc_create_runprogram(const char *name)
 #endif // UW
 
 #ifdef UW
-	/* increment the count of processes */
+	/* increment the count of processes, on this cpu */
         /* we are assuming that all procs, including those created by fork(),
-           are created using a call to proc_create_runprogram  */
-	P(proc_count_mutex); 
-	proc_count++;
-	V(proc_count_mutex);
+           are created using a call to proc_create_user  */
+	proc->p_cpu = curcpu->c_number;
+	pc = &proccpus[proc->p_cpu];
+	spinlock_acquire(&pc->pc_lock);
+	if (pc->pc_nprocs == 0) {
+		spinlock_acquire(&proc_busy_lock);
+		proc_busycpus++;
+		spinlock_release(&proc_busy_lock);
+	}
+	pc->pc_nprocs++;
+	spinlock_release(&pc->pc_lock);
 #endif // UW
 
+	/*
+	 * The pid starts out with no parent; fork supplies one. This
+	 * and the open files come after the process is counted so that
+	 * proc_destroy can clean up on failure.
+	 */
+	result = pid_alloc(&proc->p_pid);
+	if (result) {
+		proc_destroy(proc);
+		return NULL;
+	}
+
+	return proc;
+}
+
+/*
+ * Create a fresh proc for use by runprogram.
+ *
+ * It will have no address space and will inherit the current
+ * process's (that is, the kernel menu's) current directory.
+ */
+struct proc *
+proc_create_runprogram(const char *name)
+{
+	struct proc *proc;
+	int result;
+
+	proc = proc_create_user(name);
+	if (proc == NULL) {
+		return NULL;
+	}
+
+	/* Open files: stdin, stdout, and stderr on the console. */
+	proc->p_filetable = filetable_create();
+	if (proc->p_filetable == NULL) {
+		proc_destroy(proc);
+		return NULL;
+	}
+	result = proc_openconsole(proc, STDIN_FILENO, O_RDONLY);
+	if (!result) {
+		result = proc_openconsole(proc, STDOUT_FILENO, O_WRONLY);
+	}
+	if (!result) {
+		result = proc_openconsole(proc, STDERR_FILENO, O_WRONLY);
+	}
+	if (result) {
+		proc_destroy(proc);
+		return NULL;
+	}
+
+	return proc;
+}
+
+/*
+ * Create the child for fork or vfork. It shares the current process's
+ * open files and has no address space yet.
+ */
+struct proc *
+proc_create_fork(void)
+{
+	struct proc *proc;
+
+	proc = proc_create_user(curproc->p_name);
+	if (proc == NULL) {
+		return NULL;
+	}
+
+	proc->p_filetable = filetable_copy(curproc->p_filetable);
+	if (proc->p_filetable == NULL) {
+		proc_destroy(proc);
+		return NULL;
+	}
+
 	return proc;
 }
 
@@ -42,6 +42,8 @@
 #include <proc.h>
 #include <current.h>
 #include <synch.h>
+#include <workqueue.h>
+#include <counter.h>
 #include <vm.h>
 #include <mainbus.h>
 #include <vfs.h>
@@ -107,10 +109,14 @@ boot(void)
 
 	/* Early initialization. */
 	ram_bootstrap();
+	kheap_bootstrap();
 	proc_bootstrap();
+	syscall_bootstrap();
 	thread_bootstrap();
+	workqueue_bootstrap();
 	hardclock_bootstrap();
 	vfs_bootstrap();
+	counters_bootstrap();
 
 	/* Probe and initialize devices. Interrupts should come on. */
 	kprintf("Device probe...\n");
@@ -125,6 +131,8 @@ boot(void)
 	vm_bootstrap();
 	kprintf_bootstrap();
 	thread_start_cpus();
+	workqueue_start();
+	kprintf_startlog();
 
 	/* Default bootfs - but ignore failure, in case emu0 doesn't exist */
 	vfs_setbootfs("emu0");
@@ -153,6 +161,8 @@ shutdown(void)
 
 	thread_shutdown();
 
+	kprintf_stoplog();
+	putch_drain();
 	splhigh();
 }
 
@@ -35,6 +35,12 @@
 #include <lib.h>
 #include <uio.h>
 #include <clock.h>
+#include <cpu.h>
+#include <counter.h>
+#include <trace.h>
+#include <prof.h>
+#include <lockstat.h>
+#include <sysstat.h>
 #include <thread.h>
 #include <proc.h>
 #include <synch.h>
@@ -74,11 +80,8 @@ getinterval(time_t s1, uint32_t ns1, time_t s2, uint32_t ns2,
 
 /*
  * Function for a thread that runs an arbitrary userlevel program by
- * name.
- *
- * Note: this cannot pass arguments to the program. You may wish to 
- * change it so it can, because that will make testing much easier
- * in the future.
+ * name. The remaining words of the command are passed to the program
+ * as its arguments.
  *
  * It copies the program name because runprogram destroys the copy
  * it gets by passing it to vfs_open(). 
@@ -93,16 +96,12 @@ cmd_progthread(void *ptr, unsigned long nargs)
 
 	KASSERT(nargs >= 1);
 
-	if (nargs > 2) {
-		kprintf("Warning: argument passing from menu not supported\n");
-	}
-
 	/* Hope we fit. */
 	KASSERT(strlen(args[0]) < sizeof(progname));
 
 	strcpy(progname, args[0]);
 
-	result = runprogram(progname);
+	result = runprogram(progname, nargs, args);
 	if (result) {
 		kprintf("Running program %s failed: %s\n", args[0],
 			strerror(result));
@@ -396,6 +395,127 @@ cmd_kheapstats(int nargs, char **args)
 	return 0;
 }
 
+/*
+ * Command for tracepoints: trace on [trace161-flags], trace off,
+ * trace dump [file].
+ */
+static
+int
+cmd_trace(int nargs, char **args)
+{
+	if (nargs >= 2 && nargs <= 3 && !strcmp(args[1], "on")) {
+		return trace_start(nargs == 3 ? args[2] : NULL);
+	}
+	if (nargs == 2 && !strcmp(args[1], "off")) {
+		trace_stop();
+		return 0;
+	}
+	if (nargs >= 2 && nargs <= 3 && !strcmp(args[1], "dump")) {
+		return trace_dump(nargs == 3 ? args[2] : "emu0:trace.out");
+	}
+	kprintf("Usage: trace on [trace161-flags] | off | dump [file]\n");
+	return EINVAL;
+}
+
+static
+int
+cmd_prof(int nargs, char **args)
+{
+	if (nargs == 2 && !strcmp(args[1], "on")) {
+		return prof_start();
+	}
+	if (nargs == 2 && !strcmp(args[1], "off")) {
+		prof_stop();
+		return 0;
+	}
+	if (nargs >= 2 && nargs <= 3 && !strcmp(args[1], "dump")) {
+		return prof_dump(nargs == 3 ? args[2] : "emu0:prof.out");
+	}
+	kprintf("Usage: prof on | off | dump [file]\n");
+	return EINVAL;
+}
+
+static
+int
+cmd_lockstat(int nargs, char **args)
+{
+	if (nargs == 2 && !strcmp(args[1], "on")) {
+		return lockstat_start();
+	}
+	if (nargs == 2 && !strcmp(args[1], "off")) {
+		lockstat_stop();
+		return 0;
+	}
+	if (nargs == 1 || (nargs == 2 && atoi(args[1]) > 0)) {
+		lockstat_print(nargs == 2 ? atoi(args[1]) : 20);
+		return 0;
+	}
+	kprintf("Usage: lockstat on | off | [count]\n");
+	return EINVAL;
+}
+
+static
+int
+cmd_sysstat(int nargs, char **args)
+{
+	if (nargs == 2 && !strcmp(args[1], "on")) {
+		return sysstat_start();
+	}
+	if (nargs == 2 && !strcmp(args[1], "off")) {
+		sysstat_stop();
+		return 0;
+	}
+	if (nargs == 2 && !strcmp(args[1], "reset")) {
+		sysstat_reset();
+		return 0;
+	}
+	if (nargs == 1) {
+		sysstat_print();
+		return 0;
+	}
+	if (nargs == 2) {
+		return sysstat_printhist(args[1]);
+	}
+	kprintf("Usage: sysstat on | off | reset | [call]\n");
+	return EINVAL;
+}
+
+static
+int
+cmd_counters(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	counters_print();
+
+	return 0;
+}
+
+static
+int
+cmd_klog(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	kprintf_dumplog();
+
+	return 0;
+}
+
+static
+int
+cmd_tickstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	cpu_printtickstats();
+
+	return 0;
+}
+
 static
 int
 cmd_dbthreads(int nargs, char **args)
@@ -469,6 +589,7 @@ static const char *testmenu[] = {
 	"[bt]  Bitmap test                   ",
 	"[km1] Kernel malloc test            ",
 	"[km2] kmalloc stress test           ",
+	"[wq]  Work queue benchmark          ",
 	"[tt1] Thread test 1                 ",
 	"[tt2] Thread test 2                 ",
 	"[tt3] Thread test 3                 ",
@@ -518,6 +639,13 @@ static const char *mainmenu[] = {
 #endif /* UW */
 #endif
 	"[kh] Kernel heap stats              ",
+	"[ts] Timer tick stats               ",
+	"[klog] Dump kprintf log rings       ",
+	"[cnt] Statistics counters           ",
+	"[trace] Tracepoints: on/off/dump    ",
+	"[prof] Profiler: on/off/dump        ",
+	"[lockstat] Lock stats: on/off/[n]   ",
+	"[sysstat] Syscall stats             ",
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -575,12 +703,20 @@ static struct {
 
 	/* stats */
 	{ "kh",         cmd_kheapstats },
+	{ "ts",		cmd_tickstats },
+	{ "klog",	cmd_klog },
+	{ "cnt",	cmd_counters },
+	{ "trace",	cmd_trace },
+	{ "prof",	cmd_prof },
+	{ "lockstat",	cmd_lockstat },
+	{ "sysstat",	cmd_sysstat },
 
 	/* base system tests */
 	{ "at",		arraytest },
 	{ "bt",		bitmaptest },
 	{ "km1",	malloctest },
 	{ "km2",	mallocstress },
+	{ "wq",		workqueuebench },
 #if OPT_NET
 	{ "net",	nettest },
 #endif
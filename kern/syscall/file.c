@@ -0,0 +1,157 @@
+/*
+ * Open file objects and per-process file tables. See file.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <lib.h>
+#include <synch.h>
+#include <vfs.h>
+#include <file.h>
+
+int
+openfile_open(char *path, int openflags, mode_t mode, struct openfile **ret)
+{
+	struct openfile *of;
+	int result;
+
+	of = kmalloc(sizeof(*of));
+	if (of == NULL) {
+		return ENOMEM;
+	}
+	of->of_mutex = sem_create("openfile", 1);
+	if (of->of_mutex == NULL) {
+		kfree(of);
+		return ENOMEM;
+	}
+
+	result = vfs_open(path, openflags, mode, &of->of_vnode);
+	if (result) {
+		sem_destroy(of->of_mutex);
+		kfree(of);
+		return result;
+	}
+
+	of->of_accmode = openflags & O_ACCMODE;
+	of->of_offset = 0;
+	spinlock_init(&of->of_lock);
+	of->of_refcount = 1;
+
+	*ret = of;
+	return 0;
+}
+
+void
+openfile_incref(struct openfile *of)
+{
+	spinlock_acquire(&of->of_lock);
+	of->of_refcount++;
+	spinlock_release(&of->of_lock);
+}
+
+void
+openfile_decref(struct openfile *of)
+{
+	bool last;
+
+	spinlock_acquire(&of->of_lock);
+	KASSERT(of->of_refcount > 0);
+	of->of_refcount--;
+	last = (of->of_refcount == 0);
+	spinlock_release(&of->of_lock);
+
+	if (!last) {
+		return;
+	}
+
+	vfs_close(of->of_vnode);
+	spinlock_cleanup(&of->of_lock);
+	sem_destroy(of->of_mutex);
+	kfree(of);
+}
+
+struct filetable *
+filetable_create(void)
+{
+	struct filetable *ft;
+	int i;
+
+	ft = kmalloc(sizeof(*ft));
+	if (ft == NULL) {
+		return NULL;
+	}
+	for (i=0; i<OPEN_MAX; i++) {
+		ft->ft_files[i] = NULL;
+	}
+	return ft;
+}
+
+void
+filetable_destroy(struct filetable *ft)
+{
+	int i;
+
+	for (i=0; i<OPEN_MAX; i++) {
+		if (ft->ft_files[i] != NULL) {
+			openfile_decref(ft->ft_files[i]);
+			ft->ft_files[i] = NULL;
+		}
+	}
+	kfree(ft);
+}
+
+struct filetable *
+filetable_copy(struct filetable *ft)
+{
+	struct filetable *newft;
+	int i;
+
+	newft = filetable_create();
+	if (newft == NULL) {
+		return NULL;
+	}
+	for (i=0; i<OPEN_MAX; i++) {
+		if (ft->ft_files[i] != NULL) {
+			openfile_incref(ft->ft_files[i]);
+			newft->ft_files[i] = ft->ft_files[i];
+		}
+	}
+	return newft;
+}
+
+int
+filetable_place(struct filetable *ft, struct openfile *of, int *fd)
+{
+	int i;
+
+	for (i=0; i<OPEN_MAX; i++) {
+		if (ft->ft_files[i] == NULL) {
+			ft->ft_files[i] = of;
+			*fd = i;
+			return 0;
+		}
+	}
+	return EMFILE;
+}
+
+int
+filetable_get(struct filetable *ft, int fd, struct openfile **ret)
+{
+	if (fd < 0 || fd >= OPEN_MAX || ft->ft_files[fd] == NULL) {
+		return EBADF;
+	}
+	*ret = ft->ft_files[fd];
+	return 0;
+}
+
+struct openfile *
+filetable_remove(struct filetable *ft, int fd)
+{
+	struct openfile *of;
+
+	KASSERT(fd >= 0 && fd < OPEN_MAX);
+	of = ft->ft_files[fd];
+	ft->ft_files[fd] = NULL;
+	return of;
+}
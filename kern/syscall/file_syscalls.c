@@ -1,60 +1,207 @@
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/seek.h>
+#include <kern/stat.h>
 #include <kern/unistd.h>
 #include <lib.h>
+#include <limits.h>
 #include <uio.h>
+#include <synch.h>
 #include <syscall.h>
 #include <vnode.h>
 #include <vfs.h>
 #include <current.h>
 #include <proc.h>
+#include <file.h>
+#include <copyinout.h>
 
-/* handler for write() system call                  */
 /*
- * n.b.
- * This implementation handles only writes to standard output 
- * and standard error, both of which go to the console.
- * Also, it does not provide any synchronization, so writes
- * are not atomic.
+ * Common code for read() and write(): move NBYTES between the user
+ * buffer UBUF and the file open as FDESC, starting at (and advancing)
+ * the file's seek position.
  *
- * You will need to improve this implementation
+ * The openfile's mutex is held across the I/O so that processes
+ * sharing a file after fork see each transfer happen atomically with
+ * respect to the seek position.
  */
-
+static
 int
-sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval)
+file_io(int fdesc, userptr_t ubuf, unsigned int nbytes, enum uio_rw rw,
+	int *retval)
 {
+  struct openfile *of;
   struct iovec iov;
   struct uio u;
   int res;
 
-  DEBUG(DB_SYSCALL,"Syscall: write(%d,%x,%d)\n",fdesc,(unsigned int)ubuf,nbytes);
-  
-  /* only stdout and stderr writes are currently implemented */
-  if (!((fdesc==STDOUT_FILENO)||(fdesc==STDERR_FILENO))) {
-    return EUNIMP;
-  }
   KASSERT(curproc != NULL);
-  KASSERT(curproc->console != NULL);
   KASSERT(curproc->p_addrspace != NULL);
 
+  res = filetable_get(curproc->p_filetable, fdesc, &of);
+  if (res) {
+    return res;
+  }
+  if ((rw == UIO_READ && of->of_accmode == O_WRONLY) ||
+      (rw == UIO_WRITE && of->of_accmode == O_RDONLY)) {
+    return EBADF;
+  }
+
+  P(of->of_mutex);
+
   /* set up a uio structure to refer to the user program's buffer (ubuf) */
   iov.iov_ubase = ubuf;
   iov.iov_len = nbytes;
   u.uio_iov = &iov;
   u.uio_iovcnt = 1;
-  u.uio_offset = 0;  /* not needed for the console */
+  u.uio_offset = of->of_offset;
   u.uio_resid = nbytes;
   u.uio_segflg = UIO_USERSPACE;
-  u.uio_rw = UIO_WRITE;
+  u.uio_rw = rw;
   u.uio_space = curproc->p_addrspace;
 
-  res = VOP_WRITE(curproc->console,&u);
+  if (rw == UIO_READ) {
+    res = VOP_READ(of->of_vnode, &u);
+  }
+  else {
+    res = VOP_WRITE(of->of_vnode, &u);
+  }
   if (res) {
+    V(of->of_mutex);
     return res;
   }
 
-  /* pass back the number of bytes actually written */
+  of->of_offset = u.uio_offset;
+  V(of->of_mutex);
+
+  /* pass back the number of bytes actually transferred */
   *retval = nbytes - u.uio_resid;
   KASSERT(*retval >= 0);
   return 0;
 }
+
+/* handler for write() system call                  */
+int
+sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval)
+{
+  DEBUG(DB_SYSCALL,"Syscall: write(%d,%x,%d)\n",fdesc,(unsigned int)ubuf,nbytes);
+
+  return file_io(fdesc, ubuf, nbytes, UIO_WRITE, retval);
+}
+
+/* handler for read() system call                  */
+int
+sys_read(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval)
+{
+  DEBUG(DB_SYSCALL,"Syscall: read(%d,%x,%d)\n",fdesc,(unsigned int)ubuf,nbytes);
+
+  return file_io(fdesc, ubuf, nbytes, UIO_READ, retval);
+}
+
+/* handler for open() system call                  */
+int
+sys_open(userptr_t upath, int flags, mode_t mode, int *retval)
+{
+  struct openfile *of;
+  char *path;
+  int res;
+
+  if ((flags & O_ACCMODE) == O_ACCMODE) {
+    return EINVAL;
+  }
+
+  path = kmalloc(PATH_MAX);
+  if (path == NULL) {
+    return ENOMEM;
+  }
+  res = copyinstr(upath, path, PATH_MAX, NULL);
+  if (res) {
+    kfree(path);
+    return res;
+  }
+
+  DEBUG(DB_SYSCALL,"Syscall: open(%s,%d)\n",path,flags);
+
+  res = openfile_open(path, flags, mode, &of);
+  kfree(path);
+  if (res) {
+    return res;
+  }
+
+  res = filetable_place(curproc->p_filetable, of, retval);
+  if (res) {
+    openfile_decref(of);
+    return res;
+  }
+  return 0;
+}
+
+/* handler for close() system call                  */
+int
+sys_close(int fdesc)
+{
+  struct openfile *of;
+  int res;
+
+  DEBUG(DB_SYSCALL,"Syscall: close(%d)\n",fdesc);
+
+  res = filetable_get(curproc->p_filetable, fdesc, &of);
+  if (res) {
+    return res;
+  }
+  of = filetable_remove(curproc->p_filetable, fdesc);
+  openfile_decref(of);
+  return 0;
+}
+
+/* handler for lseek() system call                  */
+int
+sys_lseek(int fdesc, off_t pos, int whence, off_t *retval)
+{
+  struct openfile *of;
+  struct stat st;
+  off_t newpos;
+  int res;
+
+  res = filetable_get(curproc->p_filetable, fdesc, &of);
+  if (res) {
+    return res;
+  }
+
+  P(of->of_mutex);
+  switch (whence) {
+  case SEEK_SET:
+    newpos = pos;
+    break;
+  case SEEK_CUR:
+    newpos = of->of_offset + pos;
+    break;
+  case SEEK_END:
+    res = VOP_STAT(of->of_vnode, &st);
+    if (res) {
+      V(of->of_mutex);
+      return res;
+    }
+    newpos = st.st_size + pos;
+    break;
+  default:
+    V(of->of_mutex);
+    return EINVAL;
+  }
+
+  if (newpos < 0) {
+    V(of->of_mutex);
+    return EINVAL;
+  }
+  res = VOP_TRYSEEK(of->of_vnode, newpos);
+  if (res) {
+    V(of->of_mutex);
+    return res;
+  }
+
+  of->of_offset = newpos;
+  V(of->of_mutex);
+
+  *retval = newpos;
+  return 0;
+}
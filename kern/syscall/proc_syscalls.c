@@ -7,38 +7,41 @@
 #include <current.h>
 #include <proc.h>
 #include <thread.h>
+#include <synch.h>
 #include <addrspace.h>
 #include <copyinout.h>
-
-  /* this implementation of sys__exit does not do anything with the exit code */
-  /* this needs to be fixed to get exit() and waitpid() working properly */
+#include <pid.h>
+#include <mips/trapframe.h>
 
 void sys__exit(int exitcode) {
 
   struct addrspace *as;
   struct proc *p = curproc;
-  /* for now, just include this to keep the compiler from complaining about
-     an unused variable */
-  (void)exitcode;
 
   DEBUG(DB_SYSCALL,"Syscall: _exit(%d)\n",exitcode);
 
   KASSERT(curproc->p_addrspace != NULL);
-  as_deactivate();
   /*
-   * clear p_addrspace before calling as_destroy. Otherwise if
-   * as_destroy sleeps (which is quite possible) when we
-   * come back we'll be calling as_activate on a
-   * half-destroyed address space. This tends to be
-   * messily fatal.
+   * clear p_addrspace before deactivating, so that a context switch
+   * can't bring the address space back; nothing may be running it
+   * when the reaper destroys it.
    */
   as = curproc_setas(NULL);
-  as_destroy(as);
+  as_deactivate();
 
   /* detach this thread from its process */
   /* note: curproc cannot be used after this call */
   proc_remthread(curthread);
 
+  /* the reaper frees the address space along with the proc, unless
+     it belongs to a vfork parent */
+  if (!proc_endvfork(p)) {
+    p->p_addrspace = as;
+  }
+
+  /* proc_destroy() passes this on to the parent's waitpid */
+  p->p_exitstatus = _MKWAIT_EXIT(exitcode);
+
   /* if this is the last user process in the system, proc_destroy()
      will wake up the kernel menu thread */
   proc_destroy(p);
@@ -49,46 +52,137 @@ void sys__exit(int exitcode) {
 }
 
 
-/* stub handler for getpid() system call                */
+/* handler for getpid() system call                */
 int
 sys_getpid(pid_t *retval)
 {
-  /* for now, this is just a stub that always returns a PID of 1 */
-  /* you need to fix this to make it work properly */
-  *retval = 1;
+  *retval = curproc->p_pid;
   return(0);
 }
 
-/* stub handler for waitpid() system call                */
+/* entry point of the child's thread: tf is the trapframe copy from sys_fork */
+static
+void
+fork_child_entry(void *tf, unsigned long unused)
+{
+  (void)unused;
+  enter_forked_process(tf);
+}
 
+/* handler for fork() system call                */
 int
-sys_waitpid(pid_t pid,
-	    userptr_t status,
-	    int options,
-	    pid_t *retval)
+sys_fork(struct trapframe *tf, pid_t *retval)
 {
-  int exitstatus;
+  struct proc *child;
+  struct trapframe *childtf;
   int result;
 
-  /* this is just a stub implementation that always reports an
-     exit status of 0, regardless of the actual exit status of
-     the specified process.   
-     In fact, this will return 0 even if the specified process
-     is still running, and even if it never existed in the first place.
+  DEBUG(DB_SYSCALL,"Syscall: fork()\n");
 
-     Fix this!
-  */
+  child = proc_create_fork();
+  if (child == NULL) {
+    return ENOMEM;
+  }
 
-  if (options != 0) {
-    return(EINVAL);
+  result = as_copy(curproc_getas(), &child->p_addrspace);
+  if (result) {
+    proc_destroy(child);
+    return result;
+  }
+
+  childtf = kmalloc(sizeof(*childtf));
+  if (childtf == NULL) {
+    result = ENOMEM;
+    goto fail;
   }
-  /* for now, just pretend the exitstatus is 0 */
-  exitstatus = 0;
-  result = copyout((void *)&exitstatus,status,sizeof(int));
+  *childtf = *tf;
+
+  /* the child may run, and even exit, before thread_fork returns */
+  *retval = child->p_pid;
+  pid_setparent(child->p_pid, curproc->p_pid);
+
+  result = thread_fork(curthread->t_name, child, fork_child_entry, childtf, 0);
   if (result) {
-    return(result);
+    /* nobody is going to wait for it now */
+    pid_setparent(child->p_pid, 0);
+    kfree(childtf);
+    goto fail;
   }
-  *retval = pid;
   return(0);
+
+ fail:
+  /* this frees the child's address space too */
+  proc_destroy(child);
+  return result;
+}
+
+/* entry point of a vfork child's thread: tf is the parent's trapframe */
+static
+void
+vfork_child_entry(void *tf, unsigned long unused)
+{
+  (void)unused;
+  enter_vforked_process(tf);
+}
+
+/*
+ * handler for vfork() system call: like fork, but the child runs in
+ * the parent's address space and the parent sleeps until the child
+ * calls execv or _exit, so nothing needs to be copied.
+ */
+int
+sys_vfork(struct trapframe *tf, pid_t *retval)
+{
+  struct proc *child;
+  struct semaphore *done;
+  int result;
+
+  DEBUG(DB_SYSCALL,"Syscall: vfork()\n");
+
+  child = proc_create_fork();
+  if (child == NULL) {
+    return ENOMEM;
+  }
+
+  done = sem_create("vfork", 0);
+  if (done == NULL) {
+    proc_destroy(child);
+    return ENOMEM;
+  }
+
+  child->p_addrspace = curproc_getas();
+  child->p_vforkwait = done;
+
+  *retval = child->p_pid;
+  pid_setparent(child->p_pid, curproc->p_pid);
+
+  /* tf stays put on our stack while we sleep, so the child can copy it */
+  result = thread_fork(curthread->t_name, child, vfork_child_entry, tf, 0);
+  if (result) {
+    pid_setparent(child->p_pid, 0);
+    child->p_addrspace = NULL;
+    child->p_vforkwait = NULL;
+    goto fail;
+  }
+
+  P(done);
+  sem_destroy(done);
+  return(0);
+
+ fail:
+  sem_destroy(done);
+  proc_destroy(child);
+  return result;
+}
+
+/* handler for waitpid() system call: only children can be waited for */
+
+int
+sys_waitpid(pid_t pid,
+	    userptr_t status,
+	    int options,
+	    pid_t *retval)
+{
+  return pid_wait(pid, curproc->p_pid, options, status, retval);
 }
 
@@ -28,45 +28,171 @@
  */
 
 /*
- * Sample/test code for running a user program.  You can use this for
- * reference when implementing the execv() system call. Remember though
- * that execv() needs to do more than this function does.
+ * Running user programs: runprogram, for the kernel menu, and the
+ * execv() system call. Both go through exec_common.
  */
 
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/fcntl.h>
 #include <lib.h>
+#include <limits.h>
 #include <proc.h>
 #include <current.h>
 #include <addrspace.h>
 #include <vm.h>
 #include <vfs.h>
+#include <copyinout.h>
 #include <syscall.h>
 #include <test.h>
 
 /*
- * Load program "progname" and start running it in usermode.
- * Does not return except on error.
+ * Argument staging.
  *
- * Calls vfs_open on progname and thus may destroy it.
+ * The argument strings are gathered into a single ARG_MAX buffer,
+ * packed end to end, exactly as they will appear on the new user
+ * stack. argbuf_copyout then appends the argv array (the strings are
+ * already in order, so the pointers are found by walking them) and
+ * copies the whole image out at once. The strings are copied once on
+ * the way in and once on the way out, and never in between.
+ *
+ * ARG_MAX bounds the whole image, pointers included.
  */
+struct argbuf {
+	char *ab_buf;		/* ARG_MAX bytes */
+	size_t ab_strlen;	/* bytes of strings so far */
+	int ab_argc;		/* number of strings */
+};
+
+static
 int
-runprogram(char *progname)
+argbuf_init(struct argbuf *ab)
 {
-	struct addrspace *as;
-	struct vnode *v;
-	vaddr_t entrypoint, stackptr;
+	ab->ab_buf = kmalloc(ARG_MAX);
+	if (ab->ab_buf == NULL) {
+		return ENOMEM;
+	}
+	ab->ab_strlen = 0;
+	ab->ab_argc = 0;
+	return 0;
+}
+
+static
+void
+argbuf_cleanup(struct argbuf *ab)
+{
+	kfree(ab->ab_buf);
+	ab->ab_buf = NULL;
+}
+
+/*
+ * Room left for the next string: leave space for its argv slot, the
+ * terminating NULL, and alignment padding.
+ */
+static
+size_t
+argbuf_room(struct argbuf *ab)
+{
+	size_t used;
+
+	used = ab->ab_strlen + (ab->ab_argc + 2) * sizeof(userptr_t) +
+		sizeof(userptr_t) - 1;
+	return used < ARG_MAX ? ARG_MAX - used : 0;
+}
+
+/*
+ * Add a string from user space.
+ */
+static
+int
+argbuf_addin(struct argbuf *ab, const_userptr_t ustr)
+{
+	size_t got;
 	int result;
 
-	/* Open the file. */
-	result = vfs_open(progname, O_RDONLY, 0, &v);
+	result = copyinstr(ustr, ab->ab_buf + ab->ab_strlen, argbuf_room(ab),
+			   &got);
+	if (result == ENAMETOOLONG) {
+		return E2BIG;
+	}
 	if (result) {
 		return result;
 	}
+	ab->ab_strlen += got;
+	ab->ab_argc++;
+	return 0;
+}
 
-	/* We should be a new process. */
-	KASSERT(curproc_getas() == NULL);
+/*
+ * Add a string from the kernel.
+ */
+static
+int
+argbuf_addk(struct argbuf *ab, const char *str)
+{
+	size_t len;
+
+	len = strlen(str) + 1;
+	if (len > argbuf_room(ab)) {
+		return E2BIG;
+	}
+	memcpy(ab->ab_buf + ab->ab_strlen, str, len);
+	ab->ab_strlen += len;
+	ab->ab_argc++;
+	return 0;
+}
+
+/*
+ * Lay the arguments out below *STACKPTR in the current address space
+ * and update *STACKPTR. Hands back the user address of argv.
+ */
+static
+int
+argbuf_copyout(struct argbuf *ab, vaddr_t *stackptr, userptr_t *argvret)
+{
+	size_t strspace, total, offset;
+	userptr_t *argv;
+	vaddr_t base;
+	int i;
+
+	strspace = ROUNDUP(ab->ab_strlen, sizeof(userptr_t));
+	total = strspace + (ab->ab_argc + 1) * sizeof(userptr_t);
+	KASSERT(total <= ARG_MAX);
+	/* The stack pointer must stay 8-aligned. */
+	base = (*stackptr - total) & ~(vaddr_t)7;
+
+	bzero(ab->ab_buf + ab->ab_strlen, strspace - ab->ab_strlen);
+	argv = (userptr_t *)(ab->ab_buf + strspace);
+	offset = 0;
+	for (i=0; i<ab->ab_argc; i++) {
+		argv[i] = (userptr_t)(base + offset);
+		offset += strlen(ab->ab_buf + offset) + 1;
+	}
+	argv[ab->ab_argc] = NULL;
+
+	*stackptr = base;
+	*argvret = (userptr_t)(base + strspace);
+	return copyout(ab->ab_buf, (userptr_t)base, total);
+}
+
+/*
+ * Replace the current process's image with the program open as V,
+ * passing it the arguments in AB. Consumes V. On success, frees AB
+ * and does not return; on failure the old image is left intact.
+ *
+ * The old address space (if any) is torn down with as_destroy only
+ * after the new one is completely set up, just as exit does it. If
+ * it was borrowed from a vfork parent, it is handed back instead.
+ */
+static
+int
+exec_common(struct vnode *v, struct argbuf *ab)
+{
+	struct addrspace *as, *oldas;
+	vaddr_t entrypoint, stackptr;
+	userptr_t argv;
+	int argc;
+	int result;
 
 	/* Create a new address space. */
 	as = as_create();
@@ -76,33 +202,150 @@ runprogram(char *progname)
 	}
 
 	/* Switch to it and activate it. */
-	curproc_setas(as);
+	oldas = curproc_setas(as);
 	as_activate();
 
 	/* Load the executable. */
 	result = load_elf(v, &entrypoint);
-	if (result) {
-		/* p_addrspace will go away when curproc is destroyed */
-		vfs_close(v);
-		return result;
-	}
 
 	/* Done with the file now. */
 	vfs_close(v);
 
+	if (result) {
+		goto fail;
+	}
+
 	/* Define the user stack in the address space */
 	result = as_define_stack(as, &stackptr);
 	if (result) {
-		/* p_addrspace will go away when curproc is destroyed */
-		return result;
+		goto fail;
+	}
+
+	/* Put the arguments on it. */
+	result = argbuf_copyout(ab, &stackptr, &argv);
+	if (result) {
+		goto fail;
+	}
+	argc = ab->ab_argc;
+	argbuf_cleanup(ab);
+
+	/* Now there's no going back. */
+	if (oldas != NULL && !proc_endvfork(curproc)) {
+		as_destroy(oldas);
 	}
 
 	/* Warp to user mode. */
-	enter_new_process(0 /*argc*/, NULL /*userspace addr of argv*/,
-			  stackptr, entrypoint);
+	enter_new_process(argc, argv, stackptr, entrypoint);
 	
 	/* enter_new_process does not return. */
 	panic("enter_new_process returned\n");
 	return EINVAL;
+
+ fail:
+	curproc_setas(oldas);
+	as_activate();
+	as_destroy(as);
+	return result;
 }
 
+/*
+ * Load program "progname" and start running it in usermode, with
+ * the NARGS arguments in ARGS (ARGS[0] being the program name).
+ * Does not return except on error.
+ *
+ * Calls vfs_open on progname and thus may destroy it.
+ */
+int
+runprogram(char *progname, int nargs, char **args)
+{
+	struct argbuf ab;
+	struct vnode *v;
+	int i, result;
+
+	/* We should be a new process. */
+	KASSERT(curproc_getas() == NULL);
+
+	result = argbuf_init(&ab);
+	if (result) {
+		return result;
+	}
+	for (i=0; i<nargs; i++) {
+		result = argbuf_addk(&ab, args[i]);
+		if (result) {
+			argbuf_cleanup(&ab);
+			return result;
+		}
+	}
+
+	/* Open the file. */
+	result = vfs_open(progname, O_RDONLY, 0, &v);
+	if (result) {
+		argbuf_cleanup(&ab);
+		return result;
+	}
+
+	result = exec_common(v, &ab);
+	/* p_addrspace, if any, will go away when curproc is destroyed */
+	argbuf_cleanup(&ab);
+	return result;
+}
+
+/*
+ * The execv system call.
+ */
+int
+sys_execv(userptr_t uprogname, userptr_t uargv)
+{
+	struct argbuf ab;
+	struct vnode *v;
+	userptr_t uarg;
+	char *progname;
+	int i, result;
+
+	progname = kmalloc(PATH_MAX);
+	if (progname == NULL) {
+		return ENOMEM;
+	}
+	result = copyinstr(uprogname, progname, PATH_MAX, NULL);
+	if (result) {
+		kfree(progname);
+		return result;
+	}
+
+	result = argbuf_init(&ab);
+	if (result) {
+		kfree(progname);
+		return result;
+	}
+	for (i=0; ; i++) {
+		result = copyin(uargv + i * sizeof(userptr_t), &uarg,
+				sizeof(uarg));
+		if (result) {
+			goto fail;
+		}
+		if (uarg == NULL) {
+			break;
+		}
+		result = argbuf_addin(&ab, uarg);
+		if (result) {
+			goto fail;
+		}
+	}
+
+	/* Open the file. */
+	result = vfs_open(progname, O_RDONLY, 0, &v);
+	if (result) {
+		goto fail;
+	}
+	kfree(progname);
+	progname = NULL;
+
+	result = exec_common(v, &ab);
+
+ fail:
+	if (progname != NULL) {
+		kfree(progname);
+	}
+	argbuf_cleanup(&ab);
+	return result;
+}
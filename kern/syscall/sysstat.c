@@ -0,0 +1,258 @@
+/*
+ * Per-system-call counters and latency histograms. See sysstat.h.
+ *
+ * Each cpu has its own table, updated with interrupts off; the
+ * printing functions add the tables up.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <cpu.h>
+#include <current.h>
+#include <spl.h>
+#include <clock.h>
+#include <syscall.h>
+#include <percpu.h>
+#include <sysstat.h>
+
+struct sysstat {
+	unsigned ss_calls;
+	unsigned ss_returns;		/* calls timed */
+	unsigned ss_errors;
+	uint32_t ss_maxus;
+	uint64_t ss_totalus;
+	unsigned ss_buckets[SYSSTAT_NBUCKETS];
+};
+
+volatile bool sysstat_enabled;
+static struct percpu sysstats =
+	PERCPU_INITIALIZER(SYSSTAT_NCALLS * sizeof(struct sysstat));
+
+/*
+ * Get this cpu's entry for CALLNO, or NULL. Interrupts must be off.
+ */
+static
+struct sysstat *
+sysstat_get(int callno)
+{
+	struct sysstat *table;
+
+	if (callno < 0 || callno >= SYSSTAT_NCALLS) {
+		return NULL;
+	}
+	table = percpu_get(&sysstats, curcpu->c_number);
+	if (table == NULL) {
+		return NULL;
+	}
+	return &table[callno];
+}
+
+void
+sysstat_enter(int callno, time_t *secs, uint32_t *nsecs)
+{
+	struct sysstat *ss;
+	int spl;
+
+	spl = splhigh();
+	ss = sysstat_get(callno);
+	if (ss != NULL) {
+		ss->ss_calls++;
+	}
+	splx(spl);
+
+	gettime(secs, nsecs);
+}
+
+void
+sysstat_exit(int callno, int err, time_t secs, uint32_t nsecs)
+{
+	struct sysstat *ss;
+	time_t nowsecs;
+	uint32_t nownsecs, us;
+	unsigned b;
+	int spl;
+
+	gettime(&nowsecs, &nownsecs);
+	if (nowsecs < secs || (nowsecs == secs && nownsecs < nsecs)) {
+		us = 0;
+	}
+	else if (nowsecs - secs > 4000) {
+		us = 0xffffffff;
+	}
+	else {
+		us = (nowsecs - secs) * 1000000 + nownsecs / 1000 -
+			nsecs / 1000;
+	}
+
+	for (b = 0; us >> b != 0 && b < SYSSTAT_NBUCKETS - 1; b++) {
+		/* nothing */
+	}
+
+	spl = splhigh();
+	ss = sysstat_get(callno);
+	if (ss != NULL) {
+		ss->ss_returns++;
+		if (err) {
+			ss->ss_errors++;
+		}
+		ss->ss_totalus += us;
+		if (us > ss->ss_maxus) {
+			ss->ss_maxus = us;
+		}
+		ss->ss_buckets[b]++;
+	}
+	splx(spl);
+}
+
+int
+sysstat_start(void)
+{
+	int result;
+
+	sysstat_stop();
+
+	result = percpu_alloc(&sysstats);
+	if (result) {
+		return result;
+	}
+
+	sysstat_enabled = true;
+	return 0;
+}
+
+void
+sysstat_reset(void)
+{
+	percpu_zero(&sysstats);
+}
+
+void
+sysstat_stop(void)
+{
+	sysstat_enabled = false;
+}
+
+/*
+ * Add up all cpus' entries for CALLNO.
+ */
+static
+void
+sysstat_sum(int callno, struct sysstat *ret)
+{
+	struct sysstat *table, *ss;
+	unsigned i, b;
+
+	bzero(ret, sizeof(*ret));
+	for (i=0; i<MAXCPUS; i++) {
+		table = percpu_get(&sysstats, i);
+		if (table == NULL) {
+			continue;
+		}
+		ss = &table[callno];
+		ret->ss_calls += ss->ss_calls;
+		ret->ss_returns += ss->ss_returns;
+		ret->ss_errors += ss->ss_errors;
+		ret->ss_totalus += ss->ss_totalus;
+		if (ss->ss_maxus > ret->ss_maxus) {
+			ret->ss_maxus = ss->ss_maxus;
+		}
+		for (b=0; b<SYSSTAT_NBUCKETS; b++) {
+			ret->ss_buckets[b] += ss->ss_buckets[b];
+		}
+	}
+}
+
+static
+const char *
+sysstat_name(int callno, char *buf, size_t len)
+{
+	const char *name;
+
+	name = syscall_name(callno);
+	if (name != NULL) {
+		return name;
+	}
+	snprintf(buf, len, "#%d", callno);
+	return buf;
+}
+
+void
+sysstat_print(void)
+{
+	struct sysstat ss;
+	char buf[16];
+	int callno;
+
+	kprintf("%-12s %9s %8s %10s %10s %12s\n", "call", "calls",
+		"errors", "avg us", "max us", "total us");
+	for (callno=0; callno<SYSSTAT_NCALLS; callno++) {
+		sysstat_sum(callno, &ss);
+		if (ss.ss_calls == 0) {
+			continue;
+		}
+		kprintf("%-12s %9u %8u %10llu %10u %12llu\n",
+			sysstat_name(callno, buf, sizeof(buf)),
+			ss.ss_calls, ss.ss_errors,
+			ss.ss_returns ? ss.ss_totalus / ss.ss_returns : 0,
+			ss.ss_maxus, ss.ss_totalus);
+	}
+}
+
+int
+sysstat_printhist(const char *call)
+{
+	struct sysstat ss;
+	const char *name;
+	char buf[16], range[24], bar[41];
+	unsigned b, i, width, most;
+	int callno;
+
+	for (callno=0; callno<SYSSTAT_NCALLS; callno++) {
+		name = syscall_name(callno);
+		if (name != NULL && !strcmp(name, call)) {
+			break;
+		}
+	}
+	if (callno == SYSSTAT_NCALLS) {
+		callno = atoi(call);
+		/* 0 is also what atoi gives for junk; fork has a name */
+		if (callno <= 0 || callno >= SYSSTAT_NCALLS) {
+			return EINVAL;
+		}
+	}
+
+	sysstat_sum(callno, &ss);
+	kprintf("%s: %u calls, %u timed\n",
+		sysstat_name(callno, buf, sizeof(buf)), ss.ss_calls,
+		ss.ss_returns);
+
+	most = 0;
+	for (b=0; b<SYSSTAT_NBUCKETS; b++) {
+		if (ss.ss_buckets[b] > most) {
+			most = ss.ss_buckets[b];
+		}
+	}
+	for (b=0; b<SYSSTAT_NBUCKETS; b++) {
+		if (ss.ss_buckets[b] == 0) {
+			continue;
+		}
+		if (b == 0) {
+			snprintf(range, sizeof(range), "< 1");
+		}
+		else if (b == SYSSTAT_NBUCKETS - 1) {
+			snprintf(range, sizeof(range), "%u+", 1U << (b-1));
+		}
+		else {
+			snprintf(range, sizeof(range), "%u-%u", 1U << (b-1),
+				 (1U << b) - 1);
+		}
+		width = ss.ss_buckets[b] * (uint64_t)(sizeof(bar) - 1) / most;
+		for (i=0; i<width; i++) {
+			bar[i] = '#';
+		}
+		bar[width] = 0;
+		kprintf("    %17s us %9u %s\n", range, ss.ss_buckets[b], bar);
+	}
+	return 0;
+}
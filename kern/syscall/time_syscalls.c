@@ -28,9 +28,14 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
+#include <kern/time.h>
+#include <lib.h>
 #include <clock.h>
+#include <timer.h>
 #include <copyinout.h>
 #include <syscall.h>
+#include <lamebus/ltimer.h>
 
 /*
  * Example system call: get the time of day.
@@ -56,3 +61,41 @@ sys___time(userptr_t user_seconds_ptr, userptr_t user_nanoseconds_ptr)
 
 	return 0;
 }
+
+/*
+ * Sleep for at least the time in *USER_REQ. The timer only ticks every
+ * LT_GRANULARITY usec, so round up, plus one tick for the part of the
+ * current tick that has already gone by. Nothing can interrupt the
+ * sleep, so the time remaining is never reported.
+ */
+int
+sys_nanosleep(const_userptr_t user_req, userptr_t user_rem)
+{
+	struct timespec req;
+	uint64_t usecs, ticks;
+	int result;
+
+	(void)user_rem;
+
+	result = copyin(user_req, &req, sizeof(req));
+	if (result) {
+		return result;
+	}
+	if (req.tv_sec < 0 || req.tv_nsec < 0 || req.tv_nsec >= 1000000000) {
+		return EINVAL;
+	}
+	if (req.tv_sec == 0 && req.tv_nsec == 0) {
+		return 0;
+	}
+
+	usecs = (uint64_t)req.tv_sec * 1000000 + DIVROUNDUP(req.tv_nsec, 1000);
+	ticks = DIVROUNDUP(usecs, LT_GRANULARITY) + 1;
+
+	/* Never wake early, however long the request. */
+	while (ticks > 0xffffffff) {
+		timer_sleep(0xffffffff);
+		ticks -= 0xffffffff;
+	}
+	timer_sleep(ticks);
+	return 0;
+}
@@ -0,0 +1,132 @@
+/*
+ * Memory-management system calls: mmap, munmap, msync, sbrk.
+ *
+ * These check arguments and permissions; the address space work is
+ * done by as_mmap and friends. MAP_ANON mappings are backed by zeroed
+ * pages instead of a file; MAP_ANON|MAP_SHARED memory stays shared
+ * with children across fork.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/mman.h>
+#include <lib.h>
+#include <current.h>
+#include <proc.h>
+#include <addrspace.h>
+#include <vnode.h>
+#include <file.h>
+#include <pagecache.h>
+#include <syscall.h>
+
+int
+sys_mmap(userptr_t addr, size_t len, int prot, int flags, int fd,
+	 off_t offset, int *retval)
+{
+	struct openfile *of;
+	vaddr_t va;
+	size_t npages;
+	int result;
+
+	/* The address is only a hint, and we don't take hints. */
+	(void)addr;
+
+	if (len == 0 || offset < 0 || (offset % PAGE_SIZE) != 0) {
+		return EINVAL;
+	}
+	if ((prot & ~(PROT_READ | PROT_WRITE | PROT_EXEC)) != 0) {
+		return EINVAL;
+	}
+	if ((flags & ~MAP_ANON) != MAP_SHARED &&
+	    (flags & ~MAP_ANON) != MAP_PRIVATE) {
+		return EINVAL;
+	}
+
+	if (flags & MAP_ANON) {
+		/* Anonymous memory: no file, so nothing else to check. */
+		result = as_mmap(curproc_getas(), len, prot, flags, NULL, 0,
+				 &va);
+		if (result) {
+			return result;
+		}
+		*retval = (int)va;
+		return 0;
+	}
+
+	/*
+	 * Every file page the mapping covers must be indexable in the
+	 * page cache; otherwise huge offsets would wrap around onto
+	 * other pages of the file.
+	 */
+	npages = len / PAGE_SIZE + ((len % PAGE_SIZE) != 0);
+	if (offset / PAGE_SIZE + npages > PAGECACHE_MAXPAGES) {
+		return EINVAL;
+	}
+
+	result = filetable_get(curproc->p_filetable, fd, &of);
+	if (result) {
+		return result;
+	}
+
+	/*
+	 * The file must be readable, and to write through a shared
+	 * mapping it must also be writable.
+	 */
+	if (of->of_accmode == O_WRONLY) {
+		return EACCES;
+	}
+	if ((flags & MAP_SHARED) && (prot & PROT_WRITE) &&
+	    of->of_accmode != O_RDWR) {
+		return EACCES;
+	}
+
+	result = VOP_MMAP(of->of_vnode, prot);
+	if (result) {
+		return result;
+	}
+
+	result = as_mmap(curproc_getas(), len, prot, flags, of->of_vnode,
+			 offset, &va);
+	if (result) {
+		return result;
+	}
+
+	*retval = (int)va;
+	return 0;
+}
+
+int
+sys_munmap(userptr_t addr, size_t len)
+{
+	return as_munmap(curproc_getas(), (vaddr_t)addr, len);
+}
+
+int
+sys_msync(userptr_t addr, size_t len, int flags)
+{
+	if ((flags & ~(MS_ASYNC | MS_SYNC | MS_INVALIDATE)) != 0) {
+		return EINVAL;
+	}
+	if ((flags & MS_ASYNC) && (flags & MS_SYNC)) {
+		return EINVAL;
+	}
+
+	return as_msync(curproc_getas(), (vaddr_t)addr, len,
+			(flags & MS_ASYNC) != 0);
+}
+
+int
+sys_sbrk(int amount, int *retval)
+{
+	vaddr_t oldbreak;
+	int result;
+
+	result = as_sbrk(curproc_getas(), amount, &oldbreak);
+	if (result) {
+		return result;
+	}
+
+	*retval = (int)oldbreak;
+	return 0;
+}
@@ -0,0 +1,129 @@
+/*
+ * Work queue benchmark: how long does deferred work take to start
+ * running when it is handed to the work queue, compared to forking a
+ * thread for it?
+ *
+ * Each round hands off one item and waits for it, timing from the
+ * handoff to when the function starts. Then a burst of NBURST items
+ * is handed off at once and the total time to finish them all is
+ * reported.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <thread.h>
+#include <synch.h>
+#include <workqueue.h>
+#include <test.h>
+
+#define NROUNDS	200
+#define NBURST	64
+
+static struct semaphore *wqt_done;
+static time_t wqt_secs;
+static uint32_t wqt_nsecs;
+
+/* Run by each item: note when we started and say we're done. */
+static
+void
+wqt_func(void *unused)
+{
+	(void)unused;
+	gettime(&wqt_secs, &wqt_nsecs);
+	V(wqt_done);
+}
+
+static
+void
+wqt_thread(void *unused, unsigned long unused2)
+{
+	(void)unused2;
+	wqt_func(unused);
+}
+
+/*
+ * Hand off one item, with the work queue if W is not NULL and
+ * otherwise by forking a thread.
+ */
+static
+void
+wqt_start(struct work *w)
+{
+	int result;
+
+	if (w != NULL) {
+		work_queue(w);
+		return;
+	}
+	result = thread_fork("wqbench", NULL, wqt_thread, NULL, 0);
+	if (result) {
+		panic("wqbench: thread_fork: %s\n", strerror(result));
+	}
+}
+
+static
+uint32_t
+wqt_usecs(time_t s0, uint32_t ns0, time_t s1, uint32_t ns1)
+{
+	time_t secs;
+	uint32_t nsecs;
+
+	getinterval(s0, ns0, s1, ns1, &secs, &nsecs);
+	return secs * 1000000 + nsecs / 1000;
+}
+
+static
+void
+wqt_run(const char *what, bool usework)
+{
+	static struct work works[NBURST];
+	time_t s0, s1;
+	uint32_t ns0, ns1, total;
+	unsigned i;
+
+	for (i=0; i<NBURST; i++) {
+		work_init(&works[i], wqt_func, NULL);
+	}
+
+	total = 0;
+	for (i=0; i<NROUNDS; i++) {
+		gettime(&s0, &ns0);
+		wqt_start(usework ? &works[0] : NULL);
+		P(wqt_done);
+		total += wqt_usecs(s0, ns0, wqt_secs, wqt_nsecs);
+	}
+	kprintf("%-12s latency: %u us average over %u\n", what,
+		total / NROUNDS, NROUNDS);
+
+	gettime(&s0, &ns0);
+	for (i=0; i<NBURST; i++) {
+		wqt_start(usework ? &works[i] : NULL);
+	}
+	for (i=0; i<NBURST; i++) {
+		P(wqt_done);
+	}
+	gettime(&s1, &ns1);
+	kprintf("%-12s burst of %u: %u us\n", what, NBURST,
+		wqt_usecs(s0, ns0, s1, ns1));
+}
+
+int
+workqueuebench(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	wqt_done = sem_create("wqbench", 0);
+	if (wqt_done == NULL) {
+		panic("wqbench: sem_create failed\n");
+	}
+
+	wqt_run("workqueue", true);
+	wqt_run("thread_fork", false);
+
+	sem_destroy(wqt_done);
+	wqt_done = NULL;
+	kprintf("Work queue benchmark done.\n");
+	return 0;
+}
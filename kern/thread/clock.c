@@ -30,8 +30,8 @@
 #include <types.h>
 #include <lib.h>
 #include <cpu.h>
-#include <wchan.h>
 #include <clock.h>
+#include <timer.h>
 #include <thread.h>
 #include <lamebus/ltimer.h>
 #include <current.h>
@@ -39,9 +39,8 @@
 /*
  * Time handling.
  *
- * This is pretty primitive. A real kernel will typically have some
- * kind of support for scheduling callbacks to happen at specific
- * points in the future, usually with more resolution that one second.
+ * Timed sleeps and other callbacks are scheduled on the timer wheel
+ * (see timer.c), which timerclock() drives.
  *
  * A real kernel also has to maintain the time of day; in OS/161 we
  * skimp on that because we have a known-good hardware clock.
@@ -54,24 +53,10 @@
 #define SCHEDULE_HARDCLOCKS	4	/* Reschedule every 4 hardclocks. */
 #define MIGRATE_HARDCLOCKS	16	/* Migrate every 16 hardclocks. */
 
-/*
- * Once a second, everything waiting on lbolt is awakened by CPU 0.
- */
-static struct wchan *lbolt;
-/*
- * Once every LT_GRANULARITY usec, everything on minibolt is awakenened by CPU 0
- */
-static struct wchan *minibolt;
-
 /* 
- * number of minibolts per second
+ * number of timer ticks per second
  */
-#define MINI_PER_SECOND (1000000/LT_GRANULARITY);
-
-/*
- * minibolt countdown
- */
-static int minicount;
+#define MINI_PER_SECOND (1000000/LT_GRANULARITY)
 
 /*
  * Setup.
@@ -79,17 +64,9 @@ static int minicount;
 void
 hardclock_bootstrap(void)
 {
-	lbolt = wchan_create("lbolt");
-	if (lbolt == NULL) {
-		panic("Couldn't create lbolt\n");
-	}
-	minibolt = wchan_create("minibolt");
-	if (minibolt == NULL) {
-		panic("Couldn't create minibolt\n");
-	}
-	minicount = MINI_PER_SECOND;
 	/* we assume MINI_PER_SECOND > 0 */
-	KASSERT(minicount > 0);
+	COMPILE_ASSERT(MINI_PER_SECOND > 0);
+	timer_bootstrap();
 }
 
 /*
@@ -99,13 +76,16 @@ hardclock_bootstrap(void)
 void
 timerclock(void)
 {
-	/* Broadcast on minibolt */
-	wchan_wakeall(minibolt);
-	/* Broadcast on lbolt if a second has elapsed */
-	if (--minicount <= 0) {
-	  minicount = MINI_PER_SECOND;
-	  wchan_wakeall(lbolt);
-	}
+	timer_tick();
+}
+
+/*
+ * Start or stop the timerclock() calls.
+ */
+void
+timerclock_enable(bool on)
+{
+	ltimer_timerclock_enable(on);
 }
 
 /*
@@ -126,7 +106,8 @@ hardclock(void)
 	if ((curcpu->c_hardclocks % MIGRATE_HARDCLOCKS) == 0) {
 		thread_consider_migration();
 	}
-	thread_yield();
+	kprintf_poll();
+	thread_preempt();
 }
 
 /*
@@ -135,10 +116,8 @@ hardclock(void)
 void
 clocksleep(int num_secs)
 {
-  while (num_secs > 0) {
-    wchan_lock(lbolt);
-    wchan_sleep(lbolt);
-    num_secs--;
+  if (num_secs > 0) {
+    timer_sleep((uint32_t)num_secs * MINI_PER_SECOND);
   }
 }
 
@@ -149,9 +128,7 @@ clocksleep(int num_secs)
 void
 clocknap(int num_ticks)
 {
-  while (num_ticks > 0) {
-    wchan_lock(minibolt);
-    wchan_sleep(minibolt);
-    num_ticks--;
+  if (num_ticks > 0) {
+    timer_sleep(num_ticks);
   }
 }
@@ -0,0 +1,398 @@
+/*
+ * Lock contention statistics. See lockstat.h.
+ *
+ * The hooks are called with interrupts off (inside spinlock_acquire
+ * and spinlock_release, or with a lock's internal spinlock held), so
+ * each cpu can update its own table without locking. They must not
+ * take any locks themselves.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <cpu.h>
+#include <current.h>
+#include <spinlock.h>
+#include <mainbus.h>
+#include <percpu.h>
+#include <lockstat.h>
+
+/* Spinlocks one cpu can hold at once and still have timed */
+#define LOCKSTAT_MAXHELD	8
+
+struct lockstat_entry {
+	bool le_inuse;
+	int le_kind;				/* LOCKSTAT_* */
+	vaddr_t le_site;			/* spinlocks only */
+	char le_name[LOCKSTAT_NAMELEN];		/* locks and semaphores */
+	unsigned le_acquires;
+	unsigned le_contended;
+	uint64_t le_spins;
+	uint64_t le_wait;			/* total cycles waiting */
+	uint64_t le_maxwait;
+	uint64_t le_hold;			/* total cycles held */
+};
+
+/* A spinlock this cpu holds, and when it got it */
+struct lockstat_held {
+	struct spinlock *lh_lock;
+	struct lockstat_entry *lh_entry;
+	uint64_t lh_start;
+};
+
+struct lockstat_cpu {
+	unsigned lc_overflow;			/* lookups that didn't fit */
+	unsigned lc_gen;			/* lockstat_gen when reset */
+	struct lockstat_held lc_held[LOCKSTAT_MAXHELD];
+	unsigned lc_nheld;
+	struct lockstat_entry lc_entries[LOCKSTAT_NENTRIES];
+};
+
+volatile bool lockstat_enabled;
+static volatile unsigned lockstat_gen;
+static struct percpu lockstats =
+	PERCPU_INITIALIZER(sizeof(struct lockstat_cpu));
+
+/*
+ * Get this cpu's table, or NULL if it has none. A cpu forgets the
+ * spinlocks it was timing when the statistics are restarted. (The
+ * tables are cleared then too, but another cpu may be in the middle
+ * of a hook while that happens.)
+ */
+static
+struct lockstat_cpu *
+lockstat_mycpu(void)
+{
+	struct lockstat_cpu *lc;
+
+	lc = percpu_get(&lockstats, curcpu->c_number);
+	if (lc == NULL) {
+		return NULL;
+	}
+	if (lc->lc_gen != lockstat_gen) {
+		lc->lc_nheld = 0;
+		lc->lc_gen = lockstat_gen;
+	}
+	return lc;
+}
+
+static
+unsigned
+lockstat_hash(int kind, vaddr_t site, const char *name)
+{
+	unsigned h, i;
+
+	if (kind == LOCKSTAT_SPIN) {
+		return (site >> 2) * 2654435761U;
+	}
+	/* only as much of the name as gets kept */
+	h = kind;
+	for (i=0; name[i] != 0 && i < LOCKSTAT_NAMELEN - 1; i++) {
+		h = h * 33 + (unsigned char)name[i];
+	}
+	return h;
+}
+
+/*
+ * Does the stored (possibly cut-off) NAME1 match NAME2?
+ */
+static
+bool
+lockstat_namematch(const char *name1, const char *name2)
+{
+	unsigned i;
+
+	for (i=0; i<LOCKSTAT_NAMELEN - 1; i++) {
+		if (name1[i] != name2[i]) {
+			return false;
+		}
+		if (name1[i] == 0) {
+			break;
+		}
+	}
+	return true;
+}
+
+/*
+ * Find (or make) the entry for a lock in this cpu's table. Names are
+ * cut to LOCKSTAT_NAMELEN-1 characters.
+ */
+static
+struct lockstat_entry *
+lockstat_find(struct lockstat_cpu *lc, int kind, vaddr_t site,
+	      const char *name)
+{
+	struct lockstat_entry *le;
+	unsigned h, i, j;
+
+	h = lockstat_hash(kind, site, name);
+	for (i=0; i<LOCKSTAT_NENTRIES; i++) {
+		le = &lc->lc_entries[(h + i) % LOCKSTAT_NENTRIES];
+		if (!le->le_inuse) {
+			le->le_inuse = true;
+			le->le_kind = kind;
+			le->le_site = site;
+			for (j=0; name != NULL && name[j] != 0 &&
+				     j < LOCKSTAT_NAMELEN - 1; j++) {
+				le->le_name[j] = name[j];
+			}
+			le->le_name[j] = 0;
+			return le;
+		}
+		if (le->le_kind != kind) {
+			continue;
+		}
+		if (kind == LOCKSTAT_SPIN ? le->le_site == site :
+		    lockstat_namematch(le->le_name, name)) {
+			return le;
+		}
+	}
+	lc->lc_overflow++;
+	return NULL;
+}
+
+static
+void
+lockstat_wait(struct lockstat_entry *le, uint64_t waitstart)
+{
+	uint64_t now, wait;
+
+	le->le_acquires++;
+	if (waitstart == 0) {
+		return;
+	}
+	now = mainbus_cycles();
+	wait = now > waitstart ? now - waitstart : 0;
+	le->le_contended++;
+	le->le_wait += wait;
+	if (wait > le->le_maxwait) {
+		le->le_maxwait = wait;
+	}
+}
+
+void
+lockstat_spin_acquired(struct spinlock *lk, vaddr_t site, unsigned spins,
+		       uint64_t waitstart)
+{
+	struct lockstat_cpu *lc;
+	struct lockstat_entry *le;
+	struct lockstat_held *lh;
+
+	lc = lockstat_mycpu();
+	if (lc == NULL) {
+		return;
+	}
+	le = lockstat_find(lc, LOCKSTAT_SPIN, site, NULL);
+	if (le == NULL) {
+		return;
+	}
+	lockstat_wait(le, waitstart);
+	le->le_spins += spins;
+
+	if (lc->lc_nheld < LOCKSTAT_MAXHELD) {
+		lh = &lc->lc_held[lc->lc_nheld++];
+		lh->lh_lock = lk;
+		lh->lh_entry = le;
+		lh->lh_start = mainbus_cycles();
+	}
+}
+
+void
+lockstat_spin_releasing(struct spinlock *lk)
+{
+	struct lockstat_cpu *lc;
+	struct lockstat_held *lh;
+	uint64_t now;
+	unsigned i;
+
+	lc = lockstat_mycpu();
+	if (lc == NULL) {
+		return;
+	}
+
+	/* Usually the most recent, but not always. */
+	for (i = lc->lc_nheld; i-- > 0; ) {
+		lh = &lc->lc_held[i];
+		if (lh->lh_lock != lk) {
+			continue;
+		}
+		now = mainbus_cycles();
+		if (now > lh->lh_start) {
+			lh->lh_entry->le_hold += now - lh->lh_start;
+		}
+		lc->lc_nheld--;
+		for (; i < lc->lc_nheld; i++) {
+			lc->lc_held[i] = lc->lc_held[i+1];
+		}
+		return;
+	}
+}
+
+void
+lockstat_acquired(int kind, const char *name, uint64_t waitstart)
+{
+	struct lockstat_cpu *lc;
+	struct lockstat_entry *le;
+
+	lc = lockstat_mycpu();
+	if (lc == NULL) {
+		return;
+	}
+	le = lockstat_find(lc, kind, 0, name);
+	if (le != NULL) {
+		lockstat_wait(le, waitstart);
+	}
+}
+
+void
+lockstat_released(const char *name, uint64_t holdstart)
+{
+	struct lockstat_cpu *lc;
+	struct lockstat_entry *le;
+	uint64_t now;
+
+	lc = lockstat_mycpu();
+	if (lc == NULL) {
+		return;
+	}
+	le = lockstat_find(lc, LOCKSTAT_LOCK, 0, name);
+	now = mainbus_cycles();
+	if (le != NULL && now > holdstart) {
+		le->le_hold += now - holdstart;
+	}
+}
+
+int
+lockstat_start(void)
+{
+	int result;
+
+	lockstat_stop();
+
+	result = percpu_alloc(&lockstats);
+	if (result) {
+		return result;
+	}
+
+	lockstat_gen++;
+	lockstat_enabled = true;
+	return 0;
+}
+
+void
+lockstat_stop(void)
+{
+	lockstat_enabled = false;
+}
+
+static
+bool
+lockstat_samelock(const struct lockstat_entry *a,
+		  const struct lockstat_entry *b)
+{
+	if (a->le_kind != b->le_kind) {
+		return false;
+	}
+	if (a->le_kind == LOCKSTAT_SPIN) {
+		return a->le_site == b->le_site;
+	}
+	return !strcmp(a->le_name, b->le_name);
+}
+
+/*
+ * Add up the cpus' tables (still being updated, if collection is on,
+ * so the totals are only as exact as that allows) and print the N
+ * entries with the most total wait, then the most acquires.
+ */
+void
+lockstat_print(unsigned n)
+{
+	static const char *const kindnames[] = { "spin", "lock", "sem" };
+	struct lockstat_cpu *lc;
+	struct lockstat_entry *all, *le, *best;
+	unsigned i, j, k, nall, ncpus, overflow;
+	char name[LOCKSTAT_NAMELEN];
+
+	ncpus = cpu_count();
+	all = kmalloc(ncpus * LOCKSTAT_NENTRIES * sizeof(*all));
+	if (all == NULL) {
+		kprintf("lockstat: Out of memory\n");
+		return;
+	}
+
+	nall = 0;
+	overflow = 0;
+	for (i=0; i<ncpus; i++) {
+		lc = percpu_get(&lockstats, i);
+		if (lc == NULL) {
+			continue;
+		}
+		overflow += lc->lc_overflow;
+		for (j=0; j<LOCKSTAT_NENTRIES; j++) {
+			le = &lc->lc_entries[j];
+			if (!le->le_inuse) {
+				continue;
+			}
+			for (k=0; k<nall; k++) {
+				if (lockstat_samelock(&all[k], le)) {
+					break;
+				}
+			}
+			if (k == nall) {
+				all[nall++] = *le;
+				continue;
+			}
+			all[k].le_acquires += le->le_acquires;
+			all[k].le_contended += le->le_contended;
+			all[k].le_spins += le->le_spins;
+			all[k].le_wait += le->le_wait;
+			all[k].le_hold += le->le_hold;
+			if (le->le_maxwait > all[k].le_maxwait) {
+				all[k].le_maxwait = le->le_maxwait;
+			}
+		}
+	}
+
+	kprintf("Lock statistics%s, times in cycles:\n",
+		lockstat_enabled ? " so far" : "");
+	kprintf("%-4s %-19s %9s %9s %10s %12s %9s %9s\n",
+		"kind", "name", "acquires", "contended", "spins",
+		"total wait", "max wait", "avg hold");
+
+	/* Selection by most wait; n is small. */
+	for (i=0; i<n && i<nall; i++) {
+		best = &all[i];
+		for (j=i+1; j<nall; j++) {
+			if (all[j].le_wait > best->le_wait ||
+			    (all[j].le_wait == best->le_wait &&
+			     all[j].le_acquires > best->le_acquires)) {
+				best = &all[j];
+			}
+		}
+		if (best != &all[i]) {
+			struct lockstat_entry tmp = all[i];
+			all[i] = *best;
+			*best = tmp;
+		}
+		le = &all[i];
+
+		if (le->le_kind == LOCKSTAT_SPIN) {
+			snprintf(name, sizeof(name), "0x%08lx",
+				 (unsigned long)le->le_site);
+		}
+		else {
+			strcpy(name, le->le_name);
+		}
+		kprintf("%-4s %-19s %9u %9u %10llu %12llu %9llu %9llu\n",
+			kindnames[le->le_kind], name, le->le_acquires,
+			le->le_contended, le->le_spins, le->le_wait,
+			le->le_maxwait,
+			le->le_kind == LOCKSTAT_SEM || le->le_acquires == 0 ?
+			0 : le->le_hold / le->le_acquires);
+	}
+	if (overflow > 0) {
+		kprintf("(%u acquires not counted: tables full)\n", overflow);
+	}
+
+	kfree(all);
+}
@@ -0,0 +1,127 @@
+/*
+ * Sampling profiler driven by hardclock. See prof.h, and
+ * <kern/prof.h> for the dump format.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <cpu.h>
+#include <current.h>
+#include <clock.h>
+#include <vfs.h>
+#include <vnode.h>
+#include <percpu.h>
+#include <prof.h>
+
+struct profbuf {
+	unsigned pb_count;		/* samples taken, kept or not */
+	uint32_t pb_samples[PROF_NSAMPLES];
+};
+
+volatile bool prof_enabled;
+static struct percpu profbufs = PERCPU_INITIALIZER(sizeof(struct profbuf));
+
+/*
+ * Called with interrupts off, so nothing else touches this cpu's
+ * buffer meanwhile.
+ */
+void
+prof_sample(vaddr_t pc)
+{
+	struct profbuf *pb;
+
+	pb = percpu_get(&profbufs, curcpu->c_number);
+	if (pb == NULL) {
+		/* cpu came up after profiling started */
+		return;
+	}
+	if (pb->pb_count < PROF_NSAMPLES) {
+		pb->pb_samples[pb->pb_count] = pc;
+	}
+	pb->pb_count++;
+}
+
+int
+prof_start(void)
+{
+	int result;
+
+	prof_stop();
+
+	result = percpu_alloc(&profbufs);
+	if (result) {
+		return result;
+	}
+
+	prof_enabled = true;
+	return 0;
+}
+
+void
+prof_stop(void)
+{
+	prof_enabled = false;
+}
+
+int
+prof_dump(const char *path)
+{
+	struct prof_header ph;
+	struct profbuf *pb;
+	struct vnode *vn;
+	unsigned i, ncpus, n;
+	off_t pos;
+	int result;
+
+	prof_stop();
+
+	ncpus = cpu_count();
+	ph.ph_magic = PROF_MAGIC;
+	ph.ph_ncpus = ncpus;
+	ph.ph_hz = HZ;
+	ph.ph_nsamples = 0;
+	ph.ph_dropped = 0;
+	for (i=0; i<ncpus; i++) {
+		pb = percpu_get(&profbufs, i);
+		if (pb == NULL) {
+			continue;
+		}
+		if (pb->pb_count > PROF_NSAMPLES) {
+			ph.ph_nsamples += PROF_NSAMPLES;
+			ph.ph_dropped += pb->pb_count - PROF_NSAMPLES;
+		}
+		else {
+			ph.ph_nsamples += pb->pb_count;
+		}
+	}
+
+	result = percpu_openfile(path, &vn);
+	if (result) {
+		return result;
+	}
+
+	pos = 0;
+	result = percpu_write(vn, &ph, sizeof(ph), &pos);
+
+	for (i=0; i<ncpus && result == 0; i++) {
+		pb = percpu_get(&profbufs, i);
+		if (pb == NULL) {
+			continue;
+		}
+		n = pb->pb_count < PROF_NSAMPLES ? pb->pb_count : PROF_NSAMPLES;
+		if (n == 0) {
+			continue;
+		}
+		result = percpu_write(vn, pb->pb_samples, n * sizeof(uint32_t),
+				      &pos);
+	}
+
+	vfs_close(vn);
+	if (result == 0) {
+		kprintf("prof: wrote %u samples from %u cpus to %s "
+			"(%u not kept)\n", ph.ph_nsamples, ncpus, path,
+			ph.ph_dropped);
+	}
+	return result;
+}
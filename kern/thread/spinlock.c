@@ -36,6 +36,8 @@
 #include <spl.h>
 #include <spinlock.h>
 #include <current.h>	/* for curcpu */
+#include <mainbus.h>
+#include <lockstat.h>
 
 /*
  * Spinlocks.
@@ -73,6 +75,9 @@ void
 spinlock_acquire(struct spinlock *lk)
 {
 	struct cpu *mycpu;
+	unsigned spins;
+	uint64_t waitstart;
+	bool stats;
 
 	splraise(IPL_NONE, IPL_HIGH);
 
@@ -87,6 +92,9 @@ spinlock_acquire(struct spinlock *lk)
 		mycpu = NULL;
 	}
 
+	stats = lockstat_enabled && mycpu != NULL;
+	spins = 0;
+	waitstart = 0;
 	while (1) {
 		/*
 		 * Do test-test-and-set, that is, read first before
@@ -98,16 +106,21 @@ spinlock_acquire(struct spinlock *lk)
 		 * previously unheld and we now own it. If it was 1,
 		 * we don't.
 		 */
-		if (spinlock_data_get(&lk->lk_lock) != 0) {
-			continue;
+		if (spinlock_data_get(&lk->lk_lock) == 0 &&
+		    spinlock_data_testandset(&lk->lk_lock) == 0) {
+			break;
 		}
-		if (spinlock_data_testandset(&lk->lk_lock) != 0) {
-			continue;
+		if (stats && spins++ == 0) {
+			waitstart = mainbus_cycles();
 		}
-		break;
 	}
 
 	lk->lk_holder = mycpu;
+	if (stats) {
+		lockstat_spin_acquired(lk,
+			(vaddr_t)__builtin_return_address(0), spins,
+			waitstart);
+	}
 }
 
 /*
@@ -119,6 +132,9 @@ spinlock_release(struct spinlock *lk)
 	/* this must work before curcpu initialization */
 	if (CURCPU_EXISTS()) {
 		KASSERT(lk->lk_holder == curcpu->c_self);
+		if (lockstat_enabled) {
+			lockstat_spin_releasing(lk);
+		}
 	}
 
 	lk->lk_holder = NULL;
@@ -39,6 +39,8 @@
 #include <thread.h>
 #include <current.h>
 #include <synch.h>
+#include <mainbus.h>
+#include <lockstat.h>
 
 ////////////////////////////////////////////////////////////
 //
@@ -90,6 +92,8 @@ sem_destroy(struct semaphore *sem)
 void 
 P(struct semaphore *sem)
 {
+	uint64_t waitstart = 0;
+
         KASSERT(sem != NULL);
 
         /*
@@ -101,6 +105,9 @@ P(struct semaphore *sem)
         KASSERT(curthread->t_in_interrupt == false);
 
 	spinlock_acquire(&sem->sem_lock);
+	if (lockstat_enabled && sem->sem_count == 0) {
+		waitstart = mainbus_cycles();
+	}
         while (sem->sem_count == 0) {
 		/*
 		 * Bridge to the wchan lock, so if someone else comes
@@ -126,6 +133,9 @@ P(struct semaphore *sem)
         }
         KASSERT(sem->sem_count > 0);
         sem->sem_count--;
+	if (lockstat_enabled) {
+		lockstat_acquired(LOCKSTAT_SEM, sem->sem_name, waitstart);
+	}
 	spinlock_release(&sem->sem_lock);
 }
 
@@ -162,9 +172,18 @@ lock_create(const char *name)
                 kfree(lock);
                 return NULL;
         }
-        
-        // add stuff here as needed
-        
+
+	lock->lk_wchan = wchan_create(lock->lk_name);
+	if (lock->lk_wchan == NULL) {
+		kfree(lock->lk_name);
+		kfree(lock);
+		return NULL;
+	}
+
+	spinlock_init(&lock->lk_lock);
+	lock->lk_holder = NULL;
+	lock->lk_holdstart = 0;
+
         return lock;
 }
 
@@ -172,9 +191,11 @@ void
 lock_destroy(struct lock *lock)
 {
         KASSERT(lock != NULL);
+	KASSERT(lock->lk_holder == NULL);
 
-        // add stuff here as needed
-        
+	/* wchan_cleanup will assert if anyone's waiting on it */
+	spinlock_cleanup(&lock->lk_lock);
+	wchan_destroy(lock->lk_wchan);
         kfree(lock->lk_name);
         kfree(lock);
 }
@@ -182,27 +203,62 @@ lock_destroy(struct lock *lock)
 void
 lock_acquire(struct lock *lock)
 {
-        // Write this
+	uint64_t waitstart = 0;
+
+	KASSERT(lock != NULL);
+
+	/* May not block in an interrupt handler. */
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&lock->lk_lock);
+	KASSERT(lock->lk_holder != curthread);
+	if (lockstat_enabled && lock->lk_holder != NULL) {
+		waitstart = mainbus_cycles();
+	}
+	while (lock->lk_holder != NULL) {
+		/* Same handoff to the wchan as in P(). */
+		wchan_lock(lock->lk_wchan);
+		spinlock_release(&lock->lk_lock);
+		wchan_sleep(lock->lk_wchan);
 
-        (void)lock;  // suppress warning until code gets written
+		spinlock_acquire(&lock->lk_lock);
+	}
+	lock->lk_holder = curthread;
+	lock->lk_holdstart = 0;
+	if (lockstat_enabled) {
+		lockstat_acquired(LOCKSTAT_LOCK, lock->lk_name, waitstart);
+		lock->lk_holdstart = mainbus_cycles();
+	}
+	spinlock_release(&lock->lk_lock);
 }
 
 void
 lock_release(struct lock *lock)
 {
-        // Write this
+	KASSERT(lock != NULL);
 
-        (void)lock;  // suppress warning until code gets written
+	spinlock_acquire(&lock->lk_lock);
+	KASSERT(lock->lk_holder == curthread);
+	if (lockstat_enabled && lock->lk_holdstart != 0) {
+		lockstat_released(lock->lk_name, lock->lk_holdstart);
+	}
+	lock->lk_holder = NULL;
+	wchan_wakeone(lock->lk_wchan);
+	spinlock_release(&lock->lk_lock);
 }
 
 bool
 lock_do_i_hold(struct lock *lock)
 {
-        // Write this
+	bool ret;
+
+	KASSERT(lock != NULL);
 
-        (void)lock;  // suppress warning until code gets written
+	spinlock_acquire(&lock->lk_lock);
+	ret = (lock->lk_holder == curthread);
+	spinlock_release(&lock->lk_lock);
 
-        return true; // dummy until code gets written
+	return ret;
 }
 
 ////////////////////////////////////////////////////////////
@@ -225,9 +281,14 @@ cv_create(const char *name)
                 kfree(cv);
                 return NULL;
         }
-        
-        // add stuff here as needed
-        
+
+	cv->cv_wchan = wchan_create(cv->cv_name);
+	if (cv->cv_wchan == NULL) {
+		kfree(cv->cv_name);
+		kfree(cv);
+		return NULL;
+	}
+
         return cv;
 }
 
@@ -236,8 +297,8 @@ cv_destroy(struct cv *cv)
 {
         KASSERT(cv != NULL);
 
-        // add stuff here as needed
-        
+	/* wchan_cleanup will assert if anyone's waiting on it */
+	wchan_destroy(cv->cv_wchan);
         kfree(cv->cv_name);
         kfree(cv);
 }
@@ -245,23 +306,33 @@ cv_destroy(struct cv *cv)
 void
 cv_wait(struct cv *cv, struct lock *lock)
 {
-        // Write this
-        (void)cv;    // suppress warning until code gets written
-        (void)lock;  // suppress warning until code gets written
+	KASSERT(cv != NULL);
+	KASSERT(lock_do_i_hold(lock));
+
+	/*
+	 * Lock the wchan before letting go of the lock, so that a
+	 * signal sent as soon as the lock is free can't be missed.
+	 */
+	wchan_lock(cv->cv_wchan);
+	lock_release(lock);
+	wchan_sleep(cv->cv_wchan);
+	lock_acquire(lock);
 }
 
 void
 cv_signal(struct cv *cv, struct lock *lock)
 {
-        // Write this
-	(void)cv;    // suppress warning until code gets written
-	(void)lock;  // suppress warning until code gets written
+	KASSERT(cv != NULL);
+	KASSERT(lock_do_i_hold(lock));
+
+	wchan_wakeone(cv->cv_wchan);
 }
 
 void
 cv_broadcast(struct cv *cv, struct lock *lock)
 {
-	// Write this
-	(void)cv;    // suppress warning until code gets written
-	(void)lock;  // suppress warning until code gets written
+	KASSERT(cv != NULL);
+	KASSERT(lock_do_i_hold(lock));
+
+	wchan_wakeall(cv->cv_wchan);
 }
@@ -47,9 +47,12 @@
 #include <proc.h>
 #include <current.h>
 #include <synch.h>
+#include <workqueue.h>
 #include <addrspace.h>
 #include <mainbus.h>
 #include <vnode.h>
+#include <counter.h>
+#include <trace.h>
 
 #include "opt-synchprobs.h"
 
@@ -72,6 +75,24 @@ static struct cpuarray allcpus;
 /* Used to wait for secondary CPUs to come online. */
 static struct semaphore *cpu_startup_sem;
 
+/* Scheduler statistics. */
+#define SCHED_SWITCHES		0
+#define SCHED_FORKS		1
+#define SCHED_MIGRATIONS	2
+#define SCHED_IDLES		3
+#define SCHED_PREEMPTIONS	4
+#define SCHED_NCOUNTERS		5
+
+static const char *const sched_counter_names[SCHED_NCOUNTERS] = {
+	"switches",
+	"forks",
+	"migrations",
+	"idles",
+	"preemptions",
+};
+
+DEFCOUNTERS(sched_counters, "sched", sched_counter_names, SCHED_NCOUNTERS);
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -180,6 +201,7 @@ cpu_create(unsigned hardware_number)
 	c->c_curthread = NULL;
 	threadlist_init(&c->c_zombies);
 	c->c_hardclocks = 0;
+	c->c_ticks_suppressed = 0;
 
 	c->c_isidle = false;
 	threadlist_init(&c->c_runqueue);
@@ -187,6 +209,7 @@ cpu_create(unsigned hardware_number)
 
 	c->c_ipi_pending = 0;
 	c->c_numshootdown = 0;
+	c->c_shootdowns_done = 0;
 	spinlock_init(&c->c_ipi_lock);
 
 	result = cpuarray_add(&allcpus, c, &c->c_number);
@@ -350,6 +373,7 @@ thread_bootstrap(void)
 	struct thread *bootthread;
 
 	cpuarray_init(&allcpus);
+	counterset_register(&sched_counters);
 
 	/*
 	 * Create the cpu structure for the bootup CPU, the one we're
@@ -401,6 +425,8 @@ cpu_hatch(unsigned software_number)
 	spl0();
 
 	kprintf("cpu%u: %s\n", software_number, cpu_identify());
+	workqueue_start();
+	kprintf_startlog();
 
 	V(cpu_startup_sem);
 	thread_exit();
@@ -426,6 +452,32 @@ thread_start_cpus(void)
 	cpu_startup_sem = NULL;
 }
 
+/*
+ * Return how many cpus there are. They are numbered from 0.
+ */
+unsigned
+cpu_count(void)
+{
+	return cpuarray_num(&allcpus);
+}
+
+/*
+ * Print how many hardclocks each cpu has taken, and how many it
+ * skipped while idle.
+ */
+void
+cpu_printtickstats(void)
+{
+	struct cpu *c;
+	unsigned i;
+
+	for (i=0; i<cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+		kprintf("cpu%u: %u hardclocks, %u suppressed while idle\n",
+			c->c_number, c->c_hardclocks, c->c_ticks_suppressed);
+	}
+}
+
 /*
  * Make a thread runnable.
  *
@@ -530,6 +582,7 @@ thread_fork(const char *name,
 
 	/* Lock the current cpu's run queue and make the new thread runnable */
 	thread_make_runnable(newthread, false);
+	counter_inc(&sched_counters, SCHED_FORKS);
 
 	return 0;
 }
@@ -548,6 +601,7 @@ void
 thread_switch(threadstate_t newstate, struct wchan *wc)
 {
 	struct thread *cur, *next;
+	bool tickless;
 	int spl;
 
 	DEBUGASSERT(curcpu->c_curthread == curthread);
@@ -629,17 +683,46 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	 * lock to look at it, this should not be visible or matter.
 	 */
 
-	/* The current cpu is now idle. */
+	/*
+	 * The current cpu is now idle. If it really has nothing to
+	 * run, there is nothing for hardclock to do either, so stop it
+	 * until something turns up; that will come with an interrupt
+	 * (a wakeup from a device or timer, or IPI_UNIDLE) anyway.
+	 */
 	curcpu->c_isidle = true;
+	counter_inc(&sched_counters, SCHED_IDLES);
+	tickless = false;
 	do {
 		next = threadlist_remhead(&curcpu->c_runqueue);
 		if (next == NULL) {
 			spinlock_release(&curcpu->c_runqueue_lock);
+			if (!tickless) {
+				/*
+				 * Messages logged under a spinlock wait
+				 * for a hardclock to be printed, and
+				 * ours is about to stop. Hand them to
+				 * the klog thread, then look again in
+				 * case it landed here.
+				 */
+				kprintf_poll();
+				mainbus_hardclock_stop();
+				tickless = true;
+				spinlock_acquire(&curcpu->c_runqueue_lock);
+				continue;
+			}
 			cpu_idle();
 			spinlock_acquire(&curcpu->c_runqueue_lock);
 		}
 	} while (next == NULL);
 	curcpu->c_isidle = false;
+	if (tickless) {
+		curcpu->c_ticks_suppressed += mainbus_hardclock_start();
+	}
+
+	if (next != cur) {
+		counter_inc(&sched_counters, SCHED_SWITCHES);
+		TRACE(TREV_SWITCH, next, newstate);
+	}
 
 	/*
 	 * Note that curcpu->c_curthread may be the same variable as
@@ -817,6 +900,19 @@ thread_yield(void)
 	thread_switch(S_READY, NULL);
 }
 
+/*
+ * Yield if anything else is on our run queue. The peek is unlocked;
+ * a thread that turns up just after is picked up on the next tick.
+ */
+void
+thread_preempt(void)
+{
+	if (!threadlist_isempty(&curcpu->c_runqueue)) {
+		counter_inc(&sched_counters, SCHED_PREEMPTIONS);
+		thread_yield();
+	}
+}
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -925,6 +1021,7 @@ thread_consider_migration(void)
 
 			t->t_cpu = c;
 			threadlist_addtail(&c->c_runqueue, t);
+			counter_inc(&sched_counters, SCHED_MIGRATIONS);
 			DEBUG(DB_THREADS,
 			      "Migrated thread %s: cpu %u -> %u",
 			      t->t_name, curcpu->c_number, c->c_number);
@@ -1025,6 +1122,7 @@ wchan_sleep(struct wchan *wc)
 	/* may not sleep in an interrupt handler */
 	KASSERT(!curthread->t_in_interrupt);
 
+	TRACE(TREV_SLEEP, wc, 0);
 	thread_switch(S_SLEEP, wc);
 }
 
@@ -1050,6 +1148,7 @@ wchan_wakeone(struct wchan *wc)
 		return;
 	}
 
+	TRACE(TREV_WAKE, wc, target);
 	thread_make_runnable(target, false);
 }
 
@@ -1084,6 +1183,7 @@ wchan_wakeall(struct wchan *wc)
 	 * make each thread runnable.
 	 */
 	while ((target = threadlist_remhead(&list)) != NULL) {
+		TRACE(TREV_WAKE, wc, target);
 		thread_make_runnable(target, false);
 	}
 
@@ -1143,23 +1243,57 @@ ipi_broadcast(int code)
 void
 ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping)
 {
+	ipi_tlbshootdown_batch(target, mapping, 1);
+}
+
+unsigned
+ipi_tlbshootdown_batch(struct cpu *target,
+		       const struct tlbshootdown *mappings, unsigned num)
+{
+	unsigned i, ticket;
 	int n;
 
 	spinlock_acquire(&target->c_ipi_lock);
 
-	n = target->c_numshootdown;
-	if (n == TLBSHOOTDOWN_MAX) {
-		target->c_numshootdown = TLBSHOOTDOWN_ALL;
-	}
-	else {
-		target->c_shootdown[n] = *mapping;
+	for (i=0; i<num; i++) {
+		n = target->c_numshootdown;
+		if (n == TLBSHOOTDOWN_ALL) {
+			break;
+		}
+		if (n == TLBSHOOTDOWN_MAX || num > TLBSHOOTDOWN_MAX) {
+			target->c_numshootdown = TLBSHOOTDOWN_ALL;
+			break;
+		}
+		target->c_shootdown[n] = mappings[i];
 		target->c_numshootdown = n+1;
 	}
 
+	/*
+	 * The target bumps c_shootdowns_done under c_ipi_lock after
+	 * doing everything queued, so any change from the value now
+	 * means ours are done.
+	 */
+	ticket = target->c_shootdowns_done;
+
 	target->c_ipi_pending |= (uint32_t)1 << IPI_TLBSHOOTDOWN;
 	mainbus_send_ipi(target);
 
 	spinlock_release(&target->c_ipi_lock);
+	return ticket;
+}
+
+void
+ipi_tlbshootdown_wait(struct cpu *target, unsigned ticket)
+{
+	bool done;
+
+	KASSERT(curthread->t_curspl == 0);
+
+	do {
+		spinlock_acquire(&target->c_ipi_lock);
+		done = target->c_shootdowns_done != ticket;
+		spinlock_release(&target->c_ipi_lock);
+	} while (!done);
 }
 
 void
@@ -1202,6 +1336,7 @@ interprocessor_interrupt(void)
 			}
 		}
 		curcpu->c_numshootdown = 0;
+		curcpu->c_shootdowns_done++;
 	}
 
 	curcpu->c_ipi_pending = 0;
@@ -0,0 +1,265 @@
+/*
+ * Hierarchical timing wheel. See timer.h.
+ *
+ * There are TW_LEVELS wheels of TW_SLOTS slots each. A timer due in
+ * fewer than TW_SLOTS ticks goes on level 0, in the slot for its
+ * expiry tick; one due within TW_SLOTS^2 ticks goes on level 1, in
+ * the slot for its expiry tick divided by TW_SLOTS; and so on. Each
+ * tick runs the timers in one level-0 slot. Every TW_SLOTS ticks one
+ * level-1 slot, whose timers are now all due within TW_SLOTS ticks,
+ * is emptied back into the wheel, and likewise for the higher levels.
+ * Timers further off than the top level reaches are clamped to it.
+ *
+ * Everything is protected by timer_lock. Timer functions are called
+ * with it released, so they can add timers and wake threads.
+ *
+ * Sleeping threads wait on one of a few shared wait channels, picked
+ * by the address of their timer; a wakeup disturbs only the other
+ * sleepers that share it, and only when a timer fires.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <clock.h>
+#include <timer.h>
+
+#define TW_BITS		6
+#define TW_SLOTS	(1 << TW_BITS)
+#define TW_MASK		(TW_SLOTS - 1)
+#define TW_LEVELS	4
+#define TW_MAXTICKS	((1U << (TW_BITS * TW_LEVELS)) - 1)
+
+#define TIMER_NWCHANS	16
+
+static struct spinlock timer_lock = SPINLOCK_INITIALIZER;
+static struct timer *timer_wheel[TW_LEVELS][TW_SLOTS];
+static volatile uint32_t timer_now;	/* ticks so far */
+static unsigned timer_npending;		/* timers in the wheel */
+static bool timer_clockon = true;	/* the tick starts out running */
+
+static struct wchan *timer_wchans[TIMER_NWCHANS];
+
+void
+timer_init(struct timer *t, void (*func)(void *), void *data)
+{
+	t->tm_next = NULL;
+	t->tm_prevp = NULL;
+	t->tm_expires = 0;
+	t->tm_func = func;
+	t->tm_data = data;
+	t->tm_pending = false;
+}
+
+/*
+ * Put T in the right slot for its expiry time. T may be due now (if
+ * it is being cascaded), in which case it goes in the level-0 slot
+ * about to be run.
+ */
+static
+void
+timer_insert(struct timer *t)
+{
+	struct timer **slot;
+	uint32_t delta;
+	unsigned level;
+
+	KASSERT(spinlock_do_i_hold(&timer_lock));
+
+	delta = t->tm_expires - timer_now;
+	for (level = 0; level < TW_LEVELS - 1; level++) {
+		if (delta < (1U << (TW_BITS * (level + 1)))) {
+			break;
+		}
+	}
+	slot = &timer_wheel[level]
+		[(t->tm_expires >> (TW_BITS * level)) & TW_MASK];
+
+	t->tm_next = *slot;
+	if (t->tm_next != NULL) {
+		t->tm_next->tm_prevp = &t->tm_next;
+	}
+	t->tm_prevp = slot;
+	*slot = t;
+}
+
+static
+void
+timer_remove(struct timer *t)
+{
+	KASSERT(spinlock_do_i_hold(&timer_lock));
+
+	*t->tm_prevp = t->tm_next;
+	if (t->tm_next != NULL) {
+		t->tm_next->tm_prevp = t->tm_prevp;
+	}
+	t->tm_next = NULL;
+	t->tm_prevp = NULL;
+}
+
+void
+timer_add(struct timer *t, uint32_t ticks)
+{
+	if (ticks == 0) {
+		ticks = 1;
+	}
+	if (ticks > TW_MAXTICKS) {
+		ticks = TW_MAXTICKS;
+	}
+
+	spinlock_acquire(&timer_lock);
+	KASSERT(!t->tm_pending);
+	t->tm_expires = timer_now + ticks;
+	t->tm_pending = true;
+	timer_insert(t);
+	timer_npending++;
+	if (!timer_clockon) {
+		timer_clockon = true;
+		timerclock_enable(true);
+	}
+	spinlock_release(&timer_lock);
+}
+
+bool
+timer_cancel(struct timer *t)
+{
+	bool was;
+
+	spinlock_acquire(&timer_lock);
+	was = t->tm_pending;
+	if (was) {
+		timer_remove(t);
+		t->tm_pending = false;
+		timer_npending--;
+	}
+	spinlock_release(&timer_lock);
+	return was;
+}
+
+void
+timer_tick(void)
+{
+	struct timer *t, *due;
+	void (*func)(void *);
+	void *data;
+	unsigned level;
+	uint32_t now;
+
+	spinlock_acquire(&timer_lock);
+	now = ++timer_now;
+
+	/*
+	 * Cascade, from the top down, each level whose lower levels
+	 * have just gone all the way around.
+	 */
+	for (level = TW_LEVELS - 1; level > 0; level--) {
+		if ((now & ((1U << (TW_BITS * level)) - 1)) != 0) {
+			continue;
+		}
+		due = timer_wheel[level][(now >> (TW_BITS * level)) & TW_MASK];
+		timer_wheel[level][(now >> (TW_BITS * level)) & TW_MASK] = NULL;
+		while (due != NULL) {
+			t = due;
+			due = t->tm_next;
+			timer_insert(t);
+		}
+	}
+
+	spinlock_release(&timer_lock);
+
+	/*
+	 * Everything in this slot is due now. Take the timers off one
+	 * at a time, since each may be reused (or gone) as soon as its
+	 * function is called. Nothing new can land in this slot: new
+	 * timers are due at least a tick from now.
+	 */
+	while (1) {
+		spinlock_acquire(&timer_lock);
+		t = timer_wheel[0][now & TW_MASK];
+		if (t == NULL) {
+			/* Nothing left to wait for; stop ticking. */
+			if (timer_npending == 0 && timer_clockon) {
+				timer_clockon = false;
+				timerclock_enable(false);
+			}
+			spinlock_release(&timer_lock);
+			break;
+		}
+		KASSERT(t->tm_expires == now);
+		timer_remove(t);
+		t->tm_pending = false;
+		timer_npending--;
+		func = t->tm_func;
+		data = t->tm_data;
+		spinlock_release(&timer_lock);
+
+		func(data);
+	}
+}
+
+/*
+ * A thread waiting in timer_sleep.
+ */
+struct timer_sleeper {
+	struct timer ts_timer;
+	struct wchan *ts_wchan;
+	volatile bool ts_done;
+};
+
+static
+void
+timer_wakeup(void *data)
+{
+	struct timer_sleeper *ts = data;
+	struct wchan *wc;
+
+	/* Once ts_done is set, TS may vanish. */
+	wc = ts->ts_wchan;
+	ts->ts_done = true;
+	wchan_wakeall(wc);
+}
+
+void
+timer_sleep(uint32_t ticks)
+{
+	struct timer_sleeper ts;
+	struct wchan *wc;
+	uint32_t chunk;
+
+	wc = timer_wchans[((uintptr_t)&ts / sizeof(ts)) % TIMER_NWCHANS];
+	ts.ts_wchan = wc;
+	timer_init(&ts.ts_timer, timer_wakeup, &ts);
+
+	/*
+	 * timer_add clamps to what the wheel can reach, so sleep in
+	 * pieces no longer than that until the whole time has passed.
+	 */
+	do {
+		chunk = ticks > TW_MAXTICKS ? TW_MAXTICKS : ticks;
+		ticks -= chunk;
+		ts.ts_done = false;
+
+		/* Hold the channel so the wakeup can't come before we sleep. */
+		wchan_lock(wc);
+		timer_add(&ts.ts_timer, chunk);
+		while (!ts.ts_done) {
+			wchan_sleep(wc);
+			wchan_lock(wc);
+		}
+		wchan_unlock(wc);
+	} while (ticks > 0);
+}
+
+void
+timer_bootstrap(void)
+{
+	unsigned i;
+
+	for (i=0; i<TIMER_NWCHANS; i++) {
+		timer_wchans[i] = wchan_create("timer");
+		if (timer_wchans[i] == NULL) {
+			panic("timer_bootstrap: Out of memory\n");
+		}
+	}
+}
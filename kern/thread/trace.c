@@ -0,0 +1,176 @@
+/*
+ * Kernel tracepoints: per-cpu rings of binary event records. See
+ * trace.h, and <kern/trace.h> for the record format.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <cpu.h>
+#include <current.h>
+#include <spl.h>
+#include <vfs.h>
+#include <vnode.h>
+#include <mainbus.h>
+#include <percpu.h>
+#include <trace.h>
+#include <lamebus/ltrace.h>
+
+/* Codes passed to ltrace_debug to mark tracing in sys161's output */
+#define TRACE_DEBUG_STOP	0
+#define TRACE_DEBUG_START	1
+
+/* trace161 flags turned on by trace_start */
+#define TRACE_MAXFLAGS		16
+
+struct tracebuf {
+	unsigned tb_next;			/* count ever recorded */
+	struct trace_record tb_records[TRACE_NRECORDS];
+};
+
+volatile bool trace_enabled;
+static struct percpu tracebufs = PERCPU_INITIALIZER(sizeof(struct tracebuf));
+static char trace_flags[TRACE_MAXFLAGS + 1];
+
+void
+trace_record(unsigned event, uint32_t arg1, uint32_t arg2)
+{
+	struct tracebuf *tb;
+	struct trace_record *tr;
+	uint64_t now;
+	int spl;
+
+	spl = splhigh();
+	tb = percpu_get(&tracebufs, curcpu->c_number);
+	if (tb != NULL) {
+		now = mainbus_cycles();
+		tr = &tb->tb_records[tb->tb_next % TRACE_NRECORDS];
+		tr->tr_cycles_hi = now >> 32;
+		tr->tr_cycles_lo = now;
+		tr->tr_event = event;
+		tr->tr_cpu = curcpu->c_number;
+		tr->tr_thread = (uint32_t)curthread;
+		tr->tr_arg1 = arg1;
+		tr->tr_arg2 = arg2;
+		tb->tb_next++;
+	}
+	splx(spl);
+}
+
+int
+trace_start(const char *flags)
+{
+	unsigned i;
+	int result;
+
+	trace_stop();
+
+	result = percpu_alloc(&tracebufs);
+	if (result) {
+		return result;
+	}
+
+	if (flags == NULL) {
+		flags = "";
+	}
+	if (strlen(flags) > TRACE_MAXFLAGS) {
+		return EINVAL;
+	}
+	strcpy(trace_flags, flags);
+	for (i=0; trace_flags[i] != 0; i++) {
+		ltrace_on(trace_flags[i]);
+	}
+
+	ltrace_debug(TRACE_DEBUG_START);
+	trace_enabled = true;
+	return 0;
+}
+
+void
+trace_stop(void)
+{
+	unsigned i;
+
+	if (!trace_enabled) {
+		return;
+	}
+	trace_enabled = false;
+
+	ltrace_debug(TRACE_DEBUG_STOP);
+	for (i=0; trace_flags[i] != 0; i++) {
+		ltrace_off(trace_flags[i]);
+	}
+	trace_flags[0] = 0;
+}
+
+int
+trace_dump(const char *path)
+{
+	struct trace_header th;
+	struct tracebuf *tb;
+	struct vnode *vn;
+	unsigned i, ncpus, n, first, start;
+	off_t pos;
+	int result;
+
+	trace_stop();
+
+	ncpus = cpu_count();
+	th.th_magic = TRACE_MAGIC;
+	th.th_ncpus = ncpus;
+	th.th_nrecords = 0;
+	th.th_dropped = 0;
+	for (i=0; i<ncpus; i++) {
+		tb = percpu_get(&tracebufs, i);
+		if (tb == NULL) {
+			continue;
+		}
+		if (tb->tb_next > TRACE_NRECORDS) {
+			th.th_nrecords += TRACE_NRECORDS;
+			th.th_dropped += tb->tb_next - TRACE_NRECORDS;
+		}
+		else {
+			th.th_nrecords += tb->tb_next;
+		}
+	}
+
+	result = percpu_openfile(path, &vn);
+	if (result) {
+		return result;
+	}
+
+	pos = 0;
+	result = percpu_write(vn, &th, sizeof(th), &pos);
+
+	/* Oldest first: from the slot after the newest to the end... */
+	for (i=0; i<ncpus && result == 0; i++) {
+		tb = percpu_get(&tracebufs, i);
+		if (tb == NULL) {
+			continue;
+		}
+		if (tb->tb_next > TRACE_NRECORDS) {
+			n = TRACE_NRECORDS;
+			start = tb->tb_next % TRACE_NRECORDS;
+		}
+		else {
+			n = tb->tb_next;
+			start = 0;
+		}
+		first = TRACE_NRECORDS - start;
+		if (first > n) {
+			first = n;
+		}
+		result = percpu_write(vn, &tb->tb_records[start],
+				     first * sizeof(struct trace_record), &pos);
+		if (result == 0 && n > first) {
+			/* ...then round to the start of the ring. */
+			result = percpu_write(vn, tb->tb_records,
+					     (n - first) *
+					     sizeof(struct trace_record),
+					     &pos);
+		}
+	}
+
+	vfs_close(vn);
+	return result;
+}
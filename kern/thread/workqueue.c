@@ -0,0 +1,158 @@
+/*
+ * Per-cpu work queues. See workqueue.h.
+ *
+ * Each queue is a list protected by a spinlock, plus a semaphore
+ * counting the items on it, which the workers P to wait for work.
+ * Both can be used from interrupt handlers.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spinlock.h>
+#include <synch.h>
+#include <thread.h>
+#include <current.h>
+#include <workqueue.h>
+#include <platform/maxcpus.h>
+
+struct workqueue {
+	struct spinlock wq_lock;
+	struct work *wq_head;
+	struct work *wq_tail;
+	unsigned wq_count;		/* items queued before wq_sem existed */
+	struct semaphore *wq_sem;	/* one count per queued item */
+};
+
+static struct workqueue workqueues[MAXCPUS];
+
+void
+work_init(struct work *w, void (*func)(void *), void *data)
+{
+	w->w_next = NULL;
+	w->w_func = func;
+	w->w_data = data;
+	w->w_queued = false;
+}
+
+bool
+work_queue(struct work *w)
+{
+	struct workqueue *wq;
+	struct semaphore *sem;
+
+	wq = &workqueues[curcpu->c_number];
+	spinlock_acquire(&wq->wq_lock);
+	if (w->w_queued) {
+		spinlock_release(&wq->wq_lock);
+		return false;
+	}
+	w->w_queued = true;
+	w->w_next = NULL;
+	if (wq->wq_tail == NULL) {
+		wq->wq_head = w;
+	}
+	else {
+		wq->wq_tail->w_next = w;
+	}
+	wq->wq_tail = w;
+	sem = wq->wq_sem;
+	if (sem == NULL) {
+		wq->wq_count++;
+	}
+	spinlock_release(&wq->wq_lock);
+
+	if (sem != NULL) {
+		V(sem);
+	}
+	return true;
+}
+
+/*
+ * Worker thread for the queue of cpu number CPUNUM. Workers may
+ * migrate, but keep serving the queue they started on.
+ */
+static
+void
+workqueue_worker(void *unused, unsigned long cpunum)
+{
+	struct workqueue *wq = &workqueues[cpunum];
+	struct work *w;
+	void (*func)(void *);
+	void *data;
+
+	(void)unused;
+
+	while (1) {
+		P(wq->wq_sem);
+
+		spinlock_acquire(&wq->wq_lock);
+		w = wq->wq_head;
+		KASSERT(w != NULL);
+		wq->wq_head = w->w_next;
+		if (wq->wq_head == NULL) {
+			wq->wq_tail = NULL;
+		}
+		w->w_next = NULL;
+		w->w_queued = false;
+		func = w->w_func;
+		data = w->w_data;
+		spinlock_release(&wq->wq_lock);
+
+		/* W may be freed or requeued by now. */
+		func(data);
+	}
+}
+
+void
+workqueue_bootstrap(void)
+{
+	unsigned i;
+
+	for (i=0; i<MAXCPUS; i++) {
+		spinlock_init(&workqueues[i].wq_lock);
+		workqueues[i].wq_head = NULL;
+		workqueues[i].wq_tail = NULL;
+		workqueues[i].wq_count = 0;
+		workqueues[i].wq_sem = NULL;
+	}
+}
+
+void
+workqueue_start(void)
+{
+	struct workqueue *wq;
+	struct semaphore *sem;
+	unsigned cpunum, i;
+	int result;
+
+	cpunum = curcpu->c_number;
+	wq = &workqueues[cpunum];
+	KASSERT(wq->wq_sem == NULL);
+
+	sem = sem_create("workqueue", 0);
+	if (sem == NULL) {
+		panic("workqueue_start: Out of memory\n");
+	}
+
+	/* Hand over anything queued before now. */
+	spinlock_acquire(&wq->wq_lock);
+	wq->wq_sem = sem;
+	i = wq->wq_count;
+	wq->wq_count = 0;
+	spinlock_release(&wq->wq_lock);
+	for (; i>0; i--) {
+		V(sem);
+	}
+
+	/* thread_fork puts the new threads on this cpu. */
+	for (i=0; i<WQ_NWORKERS; i++) {
+		result = thread_fork("worker", NULL, workqueue_worker, NULL,
+				     cpunum);
+		if (result) {
+			panic("workqueue_start: thread_fork: %s\n",
+			      strerror(result));
+		}
+	}
+}
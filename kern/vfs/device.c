@@ -241,15 +241,17 @@ null_fsync(struct vnode *v)
 }
 
 /*
- * For mmap. If you want this to do anything, you have to write it
- * yourself. Some devices may not make sense to map. Others do.
+ * For mmap. None of our devices can be mapped: the page cache works
+ * in terms of file offsets, which mean nothing for a serial port and
+ * would bypass the buffering a disk device expects.
  */
 static
 int
-dev_mmap(struct vnode *v  /* add stuff as needed */)
+dev_mmap(struct vnode *v, int prot)
 {
 	(void)v;
-	return EUNIMP;
+	(void)prot;
+	return ENODEV;
 }
 
 /*
@@ -36,6 +36,7 @@
 #include <synch.h>
 #include <vfs.h>
 #include <vnode.h>
+#include <pagecache.h>
 
 /*
  * Initialize an abstract vnode.
@@ -53,6 +54,7 @@ vnode_init(struct vnode *vn, const struct vnode_ops *ops,
 	vn->vn_opencount = 0;
 	vn->vn_fs = fs;
 	vn->vn_data = fsdata;
+	vn->vn_pagecache = NULL;
 	return 0;
 }
 
@@ -65,6 +67,7 @@ vnode_cleanup(struct vnode *vn)
 {
 	KASSERT(vn->vn_refcount==1);
 	KASSERT(vn->vn_opencount==0);
+	KASSERT(vn->vn_pagecache==NULL);
 
 	vn->vn_ops = NULL;
 	vn->vn_refcount = 0;
@@ -109,6 +112,9 @@ vnode_decref(struct vnode *vn)
 		vn->vn_refcount--;
 	}
 	else {
+		/* Nothing maps the file any more; write back and drop it. */
+		pagecache_destroy(vn);
+
 		result = VOP_RECLAIM(vn);
 		if (result != 0 && result != EBUSY) {
 			// XXX: lame.
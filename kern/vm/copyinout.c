@@ -214,6 +214,15 @@ copyout(const void *src, userptr_t userdest, size_t len)
 	return 0;
 }
 
+/*
+ * HASZERO(w) is nonzero if any byte of the 32-bit word W is zero.
+ * Subtracting 1 from each byte sets the top bit of a byte that was 0;
+ * "& ~w" drops bytes whose top bit was set already. Borrows can mark
+ * other bytes too, but only above a byte that really is zero, so the
+ * yes/no answer is exact.
+ */
+#define HASZERO(w) (((w) - 0x01010101U) & ~(w) & 0x80808080U)
+
 /*
  * Common string copying function that behaves the way that's desired
  * for copyinstr and copyoutstr.
@@ -229,29 +238,75 @@ copyout(const void *src, userptr_t userdest, size_t len)
  * hit STOPLEN it's because the string has run into the end of
  * userspace. Thus in the latter case we return EFAULT, not 
  * ENAMETOOLONG.
+ *
+ * The copy goes a page of source at a time, so the limit is only
+ * worked out once per page. Within a page, once the source is
+ * word-aligned it is read a word at a time, and words with no zero
+ * byte in them are copied whole. An aligned word read never crosses
+ * into the next page, so it faults only if the bytes we need would.
  */
 static
 int
 copystr(char *dest, const char *src, size_t maxlen, size_t stoplen,
 	size_t *gotlen)
 {
-	size_t i;
+	size_t i, limit, end;
+	uint32_t w;
+
+	limit = maxlen < stoplen ? maxlen : stoplen;
 
-	for (i=0; i<maxlen && i<stoplen; i++) {
-		dest[i] = src[i];
-		if (src[i] == 0) {
-			if (gotlen != NULL) {
-				*gotlen = i+1;
+	i = 0;
+	while (i < limit) {
+		/* The end of this page of source, or the limit. */
+		end = i + PAGE_SIZE - ((vaddr_t)(src + i) % PAGE_SIZE);
+		if (end > limit) {
+			end = limit;
+		}
+
+		/* Bytes up to a word boundary in the source... */
+		while (i < end && ((vaddr_t)(src + i) & 3) != 0) {
+			if ((dest[i] = src[i]) == 0) {
+				goto found;
 			}
-			return 0;
+			i++;
+		}
+
+		/* ...whole words while none of them holds the end... */
+		while (i + sizeof(w) <= end) {
+			w = *(const uint32_t *)(src + i);
+			if (HASZERO(w)) {
+				break;
+			}
+			if (((vaddr_t)(dest + i) & 3) == 0) {
+				*(uint32_t *)(dest + i) = w;
+			}
+			else {
+				memcpy(dest + i, &w, sizeof(w));
+			}
+			i += sizeof(w);
+		}
+
+		/* ...and bytes to the end of the page or the string. */
+		while (i < end) {
+			if ((dest[i] = src[i]) == 0) {
+				goto found;
+			}
+			i++;
 		}
 	}
+
 	if (stoplen < maxlen) {
 		/* ran into user-kernel boundary */
 		return EFAULT;
 	}
 	/* otherwise just ran out of space */
 	return ENAMETOOLONG;
+
+ found:
+	if (gotlen != NULL) {
+		*gotlen = i+1;
+	}
+	return 0;
 }
 
 /*
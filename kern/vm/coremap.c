@@ -0,0 +1,259 @@
+/*
+ * Coremap: physical page allocator.
+ *
+ * Until vm_bootstrap runs, kernel pages come straight out of
+ * ram_stealmem and can never be given back. Once coremap_bootstrap
+ * has been called, all remaining RAM is tracked here, one entry per
+ * page, and both kernel (multi-page, contiguous) and user (single
+ * page, reference counted) allocations are served from it.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <vm.h>
+#include <coremap.h>
+
+struct coremap_entry {
+	uint16_t cme_refcount;		/* 0 if the page is free */
+	uint16_t cme_npages;		/* pages in kernel block starting here */
+	bool cme_kernel;		/* page belongs to a kernel block */
+};
+
+/*
+ * Wrap ram_stealmem in a spinlock.
+ */
+static struct spinlock stealmem_lock = SPINLOCK_INITIALIZER;
+
+/* Protects everything below. */
+static struct spinlock coremap_lock = SPINLOCK_INITIALIZER;
+
+static struct coremap_entry *coremap;
+static paddr_t coremap_base;		/* physical address of entry 0 */
+static unsigned coremap_npages;		/* number of entries */
+static unsigned coremap_nfree;		/* free pages */
+static unsigned coremap_nkernel;	/* pages in kernel blocks */
+static unsigned coremap_hint;		/* where to start the next 1-page scan */
+
+#define PADDR_TO_CMINDEX(pa) (((pa) - coremap_base) / PAGE_SIZE)
+#define CMINDEX_TO_PADDR(ix) (coremap_base + (paddr_t)(ix) * PAGE_SIZE)
+
+void
+coremap_bootstrap(void)
+{
+	paddr_t lo, hi;
+	size_t cmsize;
+	unsigned npages;
+
+	ram_getsize(&lo, &hi);
+	KASSERT(lo < hi);
+
+	/*
+	 * Put the coremap itself at the bottom of free memory, sized
+	 * for the whole range (this overestimates by the coremap's own
+	 * pages, which is harmless), and manage what's left over.
+	 */
+	npages = (hi - lo) / PAGE_SIZE;
+	cmsize = ROUNDUP(npages * sizeof(struct coremap_entry), PAGE_SIZE);
+	coremap = (struct coremap_entry *)PADDR_TO_KVADDR(lo);
+	bzero(coremap, cmsize);
+
+	spinlock_acquire(&coremap_lock);
+	coremap_base = lo + cmsize;
+	coremap_npages = (hi - coremap_base) / PAGE_SIZE;
+	coremap_nfree = coremap_npages;
+	coremap_nkernel = 0;
+	coremap_hint = 0;
+	spinlock_release(&coremap_lock);
+
+	kprintf("coremap: %u pages managed, %uk used by coremap\n",
+		coremap_npages, (unsigned)(cmsize / 1024));
+}
+
+/*
+ * Find NPAGES contiguous free pages. Returns the index of the first,
+ * or coremap_npages if there aren't any. Single pages are searched
+ * for next-fit from coremap_hint so that repeated user allocations
+ * don't rescan the low, mostly-full part of memory every time.
+ * Call with coremap_lock held.
+ */
+static
+unsigned
+coremap_findrun(unsigned npages)
+{
+	unsigned i, j, run;
+
+	if (npages == 1) {
+		for (j=0; j<coremap_npages; j++) {
+			i = (coremap_hint + j) % coremap_npages;
+			if (coremap[i].cme_refcount == 0) {
+				coremap_hint = (i + 1) % coremap_npages;
+				return i;
+			}
+		}
+		return coremap_npages;
+	}
+
+	run = 0;
+	for (i=0; i<coremap_npages; i++) {
+		if (coremap[i].cme_refcount != 0) {
+			run = 0;
+			continue;
+		}
+		run++;
+		if (run == npages) {
+			return i + 1 - npages;
+		}
+	}
+	return coremap_npages;
+}
+
+/* Allocate/free some kernel-space virtual pages */
+vaddr_t
+alloc_kpages(int npages)
+{
+	paddr_t pa;
+	unsigned ix, i;
+
+	KASSERT(npages > 0);
+
+	if (coremap == NULL) {
+		spinlock_acquire(&stealmem_lock);
+		pa = ram_stealmem(npages);
+		spinlock_release(&stealmem_lock);
+		if (pa == 0) {
+			return 0;
+		}
+		return PADDR_TO_KVADDR(pa);
+	}
+
+	spinlock_acquire(&coremap_lock);
+	ix = coremap_findrun(npages);
+	if (ix == coremap_npages) {
+		spinlock_release(&coremap_lock);
+		return 0;
+	}
+	for (i=0; i<(unsigned)npages; i++) {
+		KASSERT(coremap[ix+i].cme_refcount == 0);
+		coremap[ix+i].cme_refcount = 1;
+		coremap[ix+i].cme_npages = 0;
+		coremap[ix+i].cme_kernel = true;
+	}
+	coremap[ix].cme_npages = npages;
+	coremap_nfree -= npages;
+	coremap_nkernel += npages;
+	spinlock_release(&coremap_lock);
+
+	return PADDR_TO_KVADDR(CMINDEX_TO_PADDR(ix));
+}
+
+void
+free_kpages(vaddr_t addr)
+{
+	paddr_t pa;
+	unsigned ix, i, npages;
+
+	pa = KVADDR_TO_PADDR(addr);
+	if (coremap == NULL || pa < coremap_base) {
+		/* stolen before the coremap existed - leak it. */
+		return;
+	}
+
+	spinlock_acquire(&coremap_lock);
+	ix = PADDR_TO_CMINDEX(pa);
+	KASSERT(ix < coremap_npages);
+	KASSERT(coremap[ix].cme_kernel);
+	npages = coremap[ix].cme_npages;
+	KASSERT(npages > 0);
+	for (i=0; i<npages; i++) {
+		KASSERT(coremap[ix+i].cme_kernel);
+		coremap[ix+i].cme_refcount = 0;
+		coremap[ix+i].cme_npages = 0;
+		coremap[ix+i].cme_kernel = false;
+	}
+	coremap_nfree += npages;
+	coremap_nkernel -= npages;
+	spinlock_release(&coremap_lock);
+}
+
+paddr_t
+page_alloc(void)
+{
+	unsigned ix;
+
+	KASSERT(coremap != NULL);
+
+	spinlock_acquire(&coremap_lock);
+	ix = coremap_findrun(1);
+	if (ix == coremap_npages) {
+		spinlock_release(&coremap_lock);
+		return 0;
+	}
+	coremap[ix].cme_refcount = 1;
+	coremap[ix].cme_npages = 0;
+	coremap[ix].cme_kernel = false;
+	coremap_nfree--;
+	spinlock_release(&coremap_lock);
+
+	return CMINDEX_TO_PADDR(ix);
+}
+
+void
+page_incref(paddr_t pa)
+{
+	unsigned ix;
+
+	spinlock_acquire(&coremap_lock);
+	ix = PADDR_TO_CMINDEX(pa);
+	KASSERT(ix < coremap_npages);
+	KASSERT(!coremap[ix].cme_kernel);
+	KASSERT(coremap[ix].cme_refcount > 0);
+	KASSERT(coremap[ix].cme_refcount < 0xffff);
+	coremap[ix].cme_refcount++;
+	spinlock_release(&coremap_lock);
+}
+
+void
+page_decref(paddr_t pa)
+{
+	unsigned ix;
+
+	spinlock_acquire(&coremap_lock);
+	ix = PADDR_TO_CMINDEX(pa);
+	KASSERT(ix < coremap_npages);
+	KASSERT(!coremap[ix].cme_kernel);
+	KASSERT(coremap[ix].cme_refcount > 0);
+	coremap[ix].cme_refcount--;
+	if (coremap[ix].cme_refcount == 0) {
+		coremap_nfree++;
+	}
+	spinlock_release(&coremap_lock);
+}
+
+unsigned
+page_refcount(paddr_t pa)
+{
+	unsigned ix, ret;
+
+	spinlock_acquire(&coremap_lock);
+	ix = PADDR_TO_CMINDEX(pa);
+	KASSERT(ix < coremap_npages);
+	ret = coremap[ix].cme_refcount;
+	spinlock_release(&coremap_lock);
+	return ret;
+}
+
+void
+coremap_printstats(void)
+{
+	unsigned total, nfree, nkernel;
+
+	spinlock_acquire(&coremap_lock);
+	total = coremap_npages;
+	nfree = coremap_nfree;
+	nkernel = coremap_nkernel;
+	spinlock_release(&coremap_lock);
+
+	kprintf("coremap: %u pages: %u kernel, %u user, %u free\n",
+		total, nkernel, total - nfree - nkernel, nfree);
+}
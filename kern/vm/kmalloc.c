@@ -31,11 +31,33 @@
 #include <lib.h>
 #include <spinlock.h>
 #include <vm.h>
+#include <counter.h>
 
 /*
  * Kernel malloc.
  */
 
+#define KHEAP_KMALLOCS		0
+#define KHEAP_KFREES		1
+#define KHEAP_LARGE		2
+#define KHEAP_FAILED		3
+#define KHEAP_NCOUNTERS		4
+
+static const char *const kheap_counter_names[KHEAP_NCOUNTERS] = {
+	"kmallocs",
+	"kfrees",
+	"large kmallocs",
+	"failed kmallocs",
+};
+
+DEFCOUNTERS(kheap_counters, "kmalloc", kheap_counter_names, KHEAP_NCOUNTERS);
+
+void
+kheap_bootstrap(void)
+{
+	counterset_register(&kheap_counters);
+}
+
 
 static
 void
@@ -601,21 +623,32 @@ subpage_kfree(void *ptr)
 void *
 kmalloc(size_t sz)
 {
+	void *ptr;
+
+	counter_inc(&kheap_counters, KHEAP_KMALLOCS);
+
 	if (sz>=LARGEST_SUBPAGE_SIZE) {
 		unsigned long npages;
 		vaddr_t address;
 
+		counter_inc(&kheap_counters, KHEAP_LARGE);
+
 		/* Round up to a whole number of pages. */
 		npages = (sz + PAGE_SIZE - 1)/PAGE_SIZE;
 		address = alloc_kpages(npages);
 		if (address==0) {
+			counter_inc(&kheap_counters, KHEAP_FAILED);
 			return NULL;
 		}
 
 		return (void *)address;
 	}
 
-	return subpage_kmalloc(sz);
+	ptr = subpage_kmalloc(sz);
+	if (ptr == NULL) {
+		counter_inc(&kheap_counters, KHEAP_FAILED);
+	}
+	return ptr;
 }
 
 void
@@ -626,7 +659,9 @@ kfree(void *ptr)
 	 */
 	if (ptr == NULL) {
 		return;
-	} else if (subpage_kfree(ptr)) {
+	}
+	counter_inc(&kheap_counters, KHEAP_KFREES);
+	if (subpage_kfree(ptr)) {
 		KASSERT((vaddr_t)ptr%PAGE_SIZE==0);
 		free_kpages((vaddr_t)ptr);
 	}
@@ -0,0 +1,366 @@
+/*
+ * Page cache for memory-mapped files. See pagecache.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <synch.h>
+#include <uio.h>
+#include <stat.h>
+#include <vnode.h>
+#include <vm.h>
+#include <coremap.h>
+#include <pagecache.h>
+#include <workqueue.h>
+
+/*
+ * Entries in pc_pages are page-aligned physical addresses, so the low
+ * bits are free for flags.
+ */
+#define PC_DIRTY	0x1
+
+struct pagecache {
+	struct semaphore *pc_mutex;	/* serializes fills and flushes */
+	paddr_t *pc_pages;		/* file page number -> frame|flags */
+	unsigned pc_maxpages;		/* allocated size of pc_pages */
+};
+
+/* Protects the vn_pagecache pointers while caches are attached. */
+static struct spinlock pagecache_attachlock = SPINLOCK_INITIALIZER;
+
+/*
+ * Get the cache for VN, creating it if necessary.
+ */
+static
+struct pagecache *
+pagecache_get(struct vnode *vn)
+{
+	struct pagecache *pc, *newpc;
+
+	spinlock_acquire(&pagecache_attachlock);
+	pc = vn->vn_pagecache;
+	spinlock_release(&pagecache_attachlock);
+	if (pc != NULL) {
+		return pc;
+	}
+
+	newpc = kmalloc(sizeof(*newpc));
+	if (newpc == NULL) {
+		return NULL;
+	}
+	newpc->pc_mutex = sem_create("pagecache", 1);
+	if (newpc->pc_mutex == NULL) {
+		kfree(newpc);
+		return NULL;
+	}
+	newpc->pc_pages = NULL;
+	newpc->pc_maxpages = 0;
+
+	/* Someone else may have beaten us to it while we slept. */
+	spinlock_acquire(&pagecache_attachlock);
+	pc = vn->vn_pagecache;
+	if (pc == NULL) {
+		vn->vn_pagecache = pc = newpc;
+		newpc = NULL;
+	}
+	spinlock_release(&pagecache_attachlock);
+
+	if (newpc != NULL) {
+		sem_destroy(newpc->pc_mutex);
+		kfree(newpc);
+	}
+	return pc;
+}
+
+/*
+ * Make sure pc_pages can be indexed with IX. Call with pc_mutex held.
+ */
+static
+int
+pagecache_grow(struct pagecache *pc, unsigned ix)
+{
+	paddr_t *newpages;
+	unsigned newmax, i;
+
+	if (ix < pc->pc_maxpages) {
+		return 0;
+	}
+
+	if (ix >= PAGECACHE_MAXPAGES) {
+		return ENOMEM;
+	}
+
+	/* Double until IX fits, without overflowing past the limit. */
+	newmax = pc->pc_maxpages ? pc->pc_maxpages : 16;
+	while (newmax <= ix) {
+		if (newmax > PAGECACHE_MAXPAGES / 2) {
+			newmax = PAGECACHE_MAXPAGES;
+			break;
+		}
+		newmax *= 2;
+	}
+
+	newpages = kmalloc(newmax * sizeof(paddr_t));
+	if (newpages == NULL) {
+		return ENOMEM;
+	}
+	for (i=0; i<pc->pc_maxpages; i++) {
+		newpages[i] = pc->pc_pages[i];
+	}
+	for (; i<newmax; i++) {
+		newpages[i] = 0;
+	}
+
+	if (pc->pc_pages != NULL) {
+		kfree(pc->pc_pages);
+	}
+	pc->pc_pages = newpages;
+	pc->pc_maxpages = newmax;
+	return 0;
+}
+
+int
+pagecache_getpage(struct vnode *vn, off_t offset, paddr_t *ret,
+		  bool *wasread)
+{
+	struct pagecache *pc;
+	struct iovec iov;
+	struct uio ku;
+	unsigned ix;
+	paddr_t pa;
+	size_t got;
+	int result;
+
+	KASSERT((offset % PAGE_SIZE) == 0);
+
+	*wasread = false;
+	if (offset / PAGE_SIZE >= PAGECACHE_MAXPAGES) {
+		return EINVAL;
+	}
+
+	pc = pagecache_get(vn);
+	if (pc == NULL) {
+		return ENOMEM;
+	}
+	ix = offset / PAGE_SIZE;
+
+	P(pc->pc_mutex);
+
+	result = pagecache_grow(pc, ix);
+	if (result) {
+		V(pc->pc_mutex);
+		return result;
+	}
+
+	pa = pc->pc_pages[ix] & PAGE_FRAME;
+	if (pa == 0) {
+		pa = page_alloc();
+		if (pa == 0) {
+			V(pc->pc_mutex);
+			return ENOMEM;
+		}
+
+		uio_kinit(&iov, &ku, (void *)PADDR_TO_KVADDR(pa), PAGE_SIZE,
+			  offset, UIO_READ);
+		result = VOP_READ(vn, &ku);
+		if (result) {
+			page_decref(pa);
+			V(pc->pc_mutex);
+			return result;
+		}
+
+		/* Zero whatever lies past EOF. */
+		got = PAGE_SIZE - ku.uio_resid;
+		if (got < PAGE_SIZE) {
+			bzero((void *)(PADDR_TO_KVADDR(pa) + got),
+			      PAGE_SIZE - got);
+		}
+
+		pc->pc_pages[ix] = pa;
+		*wasread = true;
+	}
+
+	/* One reference for the cache, one for the caller. */
+	page_incref(pa);
+	V(pc->pc_mutex);
+
+	*ret = pa;
+	return 0;
+}
+
+void
+pagecache_markdirty(struct vnode *vn, off_t offset)
+{
+	struct pagecache *pc;
+	unsigned ix;
+
+	pc = vn->vn_pagecache;
+	KASSERT(pc != NULL);
+	ix = offset / PAGE_SIZE;
+
+	P(pc->pc_mutex);
+	KASSERT(ix < pc->pc_maxpages);
+	KASSERT(pc->pc_pages[ix] != 0);
+	pc->pc_pages[ix] |= PC_DIRTY;
+	V(pc->pc_mutex);
+}
+
+/*
+ * Write back dirty pages in the index range [START, END). Call with
+ * pc_mutex held.
+ *
+ * Pages are written only up to the current end of file; a mapping
+ * never extends the file. A page stays marked dirty while anything
+ * besides the cache still maps it, because a writable mapping could
+ * dirty it again without faulting.
+ */
+static
+int
+pagecache_writeback(struct vnode *vn, struct pagecache *pc,
+		    unsigned start, unsigned end)
+{
+	struct stat st;
+	struct iovec iov;
+	struct uio ku;
+	unsigned ix;
+	paddr_t pa;
+	off_t pos;
+	size_t len;
+	int result;
+
+	if (end > pc->pc_maxpages) {
+		end = pc->pc_maxpages;
+	}
+
+	result = VOP_STAT(vn, &st);
+	if (result) {
+		return result;
+	}
+
+	for (ix = start; ix < end; ix++) {
+		if ((pc->pc_pages[ix] & PC_DIRTY) == 0) {
+			continue;
+		}
+		pa = pc->pc_pages[ix] & PAGE_FRAME;
+		pos = (off_t)ix * PAGE_SIZE;
+
+		if (pos < st.st_size) {
+			len = PAGE_SIZE;
+			if (st.st_size - pos < PAGE_SIZE) {
+				len = st.st_size - pos;
+			}
+			uio_kinit(&iov, &ku, (void *)PADDR_TO_KVADDR(pa),
+				  len, pos, UIO_WRITE);
+			result = VOP_WRITE(vn, &ku);
+			if (result) {
+				return result;
+			}
+		}
+
+		if (page_refcount(pa) == 1) {
+			pc->pc_pages[ix] &= ~(paddr_t)PC_DIRTY;
+		}
+	}
+	return 0;
+}
+
+int
+pagecache_flush(struct vnode *vn, off_t offset, off_t len)
+{
+	struct pagecache *pc;
+	unsigned start, end;
+	int result;
+
+	spinlock_acquire(&pagecache_attachlock);
+	pc = vn->vn_pagecache;
+	spinlock_release(&pagecache_attachlock);
+	if (pc == NULL) {
+		return 0;
+	}
+
+	start = offset / PAGE_SIZE;
+	end = DIVROUNDUP(offset + len, PAGE_SIZE);
+
+	P(pc->pc_mutex);
+	result = pagecache_writeback(vn, pc, start, end);
+	V(pc->pc_mutex);
+	return result;
+}
+
+/*
+ * A queued pagecache_flush_async. Holds a reference to the vnode.
+ */
+struct pagecache_flushwork {
+	struct work pf_work;
+	struct vnode *pf_vnode;
+	off_t pf_offset;
+	off_t pf_len;
+};
+
+static
+void
+pagecache_flushwork(void *data)
+{
+	struct pagecache_flushwork *pf = data;
+
+	(void)pagecache_flush(pf->pf_vnode, pf->pf_offset, pf->pf_len);
+	VOP_DECREF(pf->pf_vnode);
+	kfree(pf);
+}
+
+void
+pagecache_flush_async(struct vnode *vn, off_t offset, off_t len)
+{
+	struct pagecache_flushwork *pf;
+
+	pf = kmalloc(sizeof(*pf));
+	if (pf == NULL) {
+		(void)pagecache_flush(vn, offset, len);
+		return;
+	}
+	VOP_INCREF(vn);
+	pf->pf_vnode = vn;
+	pf->pf_offset = offset;
+	pf->pf_len = len;
+	work_init(&pf->pf_work, pagecache_flushwork, pf);
+	work_queue(&pf->pf_work);
+}
+
+void
+pagecache_destroy(struct vnode *vn)
+{
+	struct pagecache *pc;
+	unsigned ix;
+	paddr_t pa;
+	int result;
+
+	spinlock_acquire(&pagecache_attachlock);
+	pc = vn->vn_pagecache;
+	vn->vn_pagecache = NULL;
+	spinlock_release(&pagecache_attachlock);
+	if (pc == NULL) {
+		return;
+	}
+
+	P(pc->pc_mutex);
+	result = pagecache_writeback(vn, pc, 0, pc->pc_maxpages);
+	if (result) {
+		kprintf("pagecache: Warning: writeback failed: %s\n",
+			strerror(result));
+	}
+	for (ix = 0; ix < pc->pc_maxpages; ix++) {
+		pa = pc->pc_pages[ix] & PAGE_FRAME;
+		if (pa != 0) {
+			page_decref(pa);
+		}
+	}
+	V(pc->pc_mutex);
+
+	if (pc->pc_pages != NULL) {
+		kfree(pc->pc_pages);
+	}
+	sem_destroy(pc->pc_mutex);
+	kfree(pc);
+}
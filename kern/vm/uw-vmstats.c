@@ -2,27 +2,17 @@
 
 /* belongs in kern/vm/uw-vmstats.c */
 
-/* NOTE !!!!!! WARNING !!!!!
- * All of the functions whose names begin with '_'
- * assume that atomicity is ensured elsewhere
- * (i.e., outside of these routines) by acquiring stats_lock.
- * All of the functions whose names do not begin
- * with '_' ensure atomicity locally.
+/* The counts are a counter set (see counter.h), so incrementing one
+ * takes no lock.
  */
 
 #include <types.h>
 #include <lib.h>
-#include <synch.h>
-#include <spl.h>
+#include <counter.h>
 #include <uw-vmstats.h>
 
-/* Counters for tracking statistics */
-static unsigned int stats_counts[VMSTAT_COUNT];
-
-struct spinlock stats_lock = SPINLOCK_INITIALIZER;
-
 /* Strings used in printing out the statistics */
-static const char *stats_names[] = {
+static const char *const stats_names[] = {
  /*  0 */ "TLB Faults", 
  /*  1 */ "TLB Faults with Free",
  /*  2 */ "TLB Faults with Replace",
@@ -33,69 +23,49 @@ static const char *stats_names[] = {
  /*  7 */ "Page Faults from ELF",
  /*  8 */ "Page Faults from Swapfile",
  /*  9 */ "Swapfile Writes",
+ /* 10 */ "TLB Flushes Avoided",
+ /* 11 */ "ASID Rollovers",
+ /* 12 */ "TLB Shootdowns Sent",
+ /* 13 */ "TLB Shootdowns Deferred",
+ /* 14 */ "TLB Shootdown Wait (us)",
 };
 
 
-/* ---------------------------------------------------------------------- */
-/* Assumes vmstat_init has already been called */
-void
-vmstats_inc(unsigned int index)
-{
-    spinlock_acquire(&stats_lock);
-      _vmstats_inc(index);
-    spinlock_release(&stats_lock);
-}
+DEFCOUNTERS(vm_counters, "vm", stats_names, VMSTAT_COUNT);
 
 /* ---------------------------------------------------------------------- */
 void
-vmstats_init(void)
+vmstats_inc(unsigned int index)
 {
-  /* Although the spinlock is initialized at declaration time we do it here
-   * again in case we want use/reset these stats repeatedly without shutting down the kernel.
-   */
-  spinlock_init(&stats_lock);
-
-  spinlock_acquire(&stats_lock);
-    _vmstats_init();
-  spinlock_release(&stats_lock);
+  counter_inc(&vm_counters, index);
 }
 
 /* ---------------------------------------------------------------------- */
 void
-_vmstats_inc(unsigned int index)
+vmstats_add(unsigned int index, unsigned int amount)
 {
-  KASSERT(index < VMSTAT_COUNT);
-  stats_counts[index]++;
+  counter_add(&vm_counters, index, amount);
 }
 
 /* ---------------------------------------------------------------------- */
 void
-_vmstats_init(void)
+vmstats_init(void)
 {
-  int i = 0;
-
-  if (sizeof(stats_names) / sizeof(char *) != VMSTAT_COUNT) {
-    kprintf("vmstats_init: number of stats_names = %d != VMSTAT_COUNT = %d\n",
-      (sizeof(stats_names) / sizeof(char *)), VMSTAT_COUNT);
-    panic("Should really fix this before proceeding\n");
-  }
-
-  for (i=0; i<VMSTAT_COUNT; i++) {
-    stats_counts[i] = 0;
-  }
+  COMPILE_ASSERT(sizeof(stats_names) / sizeof(stats_names[0]) == VMSTAT_COUNT);
 
+  counterset_register(&vm_counters);
+  counterset_reset(&vm_counters);
 }
 
 /* ---------------------------------------------------------------------- */
-/* Assumes vmstat_init has already been called */
-/* NOTE: We do not grab the spinlock here because kprintf may block
- * and we can't block while holding a spinlock.
- * Just use this when there is only one thread remaining.
+/* Counts still going up while this runs may make the totals below
+ * disagree slightly; best used when things are quiet.
  */
 
 void
 vmstats_print(void)
 {
+  unsigned stats_counts[VMSTAT_COUNT];
   int i = 0;
   int free_plus_replace = 0;
   int disk_plus_zeroed_plus_reload = 0;
@@ -103,6 +73,10 @@ vmstats_print(void)
   int elf_plus_swap_reads = 0;
   int disk_reads = 0;
 
+  for (i=0; i<VMSTAT_COUNT; i++) {
+    stats_counts[i] = counter_read(&vm_counters, i);
+  }
+
   kprintf("VMSTATS:\n");
   for (i=0; i<VMSTAT_COUNT; i++) {
     kprintf("VMSTAT %25s = %10d\n", stats_names[i], stats_counts[i]);
@@ -128,6 +102,11 @@ vmstats_print(void)
       tlb_faults, disk_plus_zeroed_plus_reload); 
   }
 
+  if (stats_counts[VMSTAT_TLB_SHOOTDOWN] > 0) {
+    kprintf("VMSTAT Average TLB shootdown wait = %d us\n",
+      stats_counts[VMSTAT_TLB_SHOOTDOWN_USEC] / stats_counts[VMSTAT_TLB_SHOOTDOWN]);
+  }
+
   kprintf("VMSTAT ELF File reads + Swapfile reads = %d\n", elf_plus_swap_reads);
   if (disk_reads != elf_plus_swap_reads) {
     kprintf("WARNING: ELF File reads + Swapfile reads != Page Faults (Disk) %d\n",
@@ -0,0 +1,20 @@
+#ifndef _SYS_MMAN_H_
+#define _SYS_MMAN_H_
+
+/*
+ * Memory mapping. Get the PROT_*, MAP_*, and MS_* constants from the
+ * kernel.
+ */
+#include <sys/types.h>
+#include <kern/mman.h>
+
+/*
+ * mmap never takes ADDR literally; the kernel picks the address.
+ * With MAP_ANON, FD and OFFSET are ignored and the memory starts out
+ * zeroed; MAP_ANON|MAP_SHARED memory is shared with forked children.
+ */
+void *mmap(void *addr, size_t len, int prot, int flags, int fd, off_t offset);
+int munmap(void *addr, size_t len);
+int msync(void *addr, size_t len, int flags);
+
+#endif /* _SYS_MMAN_H_ */
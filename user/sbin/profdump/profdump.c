@@ -0,0 +1,417 @@
+/*
+ * profdump - symbolize a kernel profile on the host.
+ *
+ * Usage: hostbin/host-profdump [-a] [-n count] [-u program] kernel profile
+ *
+ * Reads a file written by the kernel menu's "prof dump" command
+ * (format in <kern/prof.h>) and the symbol table of the kernel it was
+ * taken from, and prints the functions that the most samples landed
+ * in, with their share of the samples. User-mode samples are lumped
+ * together as "(user)" unless -u names the program they came from,
+ * in which case they are symbolized against it too.
+ *
+ *    -a          list the samples by address within each function
+ *                as well;
+ *    -n count    how many functions to print (default 30, 0 for all).
+ *
+ * Reads the ELF files directly rather than through libelf, since they
+ * are big-endian MIPS and the host may be neither.
+ */
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+
+#include "kern/prof.h"
+
+#ifdef HOST
+#include "hostcompat.h"
+#endif
+
+/* The parts of ELF we need */
+#define EI_NIDENT	16
+#define EH_SHOFF	32
+#define EH_SHENTSIZE	46
+#define EH_SHNUM	48
+#define SH_TYPE		4
+#define SH_OFFSET	16
+#define SH_SIZE		20
+#define SH_LINK		24
+#define SHT_SYMTAB	2
+#define SYM_SIZE	16
+#define STT_NOTYPE	0
+#define STT_FUNC	2
+
+#define USERLIMIT	0x80000000	/* kernel addresses are above */
+
+struct symbol {
+	uint32_t addr;
+	const char *name;
+	unsigned long count;
+};
+
+struct symtab {
+	struct symbol *syms;
+	unsigned nsyms;
+};
+
+/* One sample address and how often it was seen */
+struct hit {
+	uint32_t pc;
+	unsigned long count;
+	struct symbol *sym;
+};
+
+static
+uint32_t
+get32(const unsigned char *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+		((uint32_t)p[2] << 8) | p[3];
+}
+
+static
+uint16_t
+get16(const unsigned char *p)
+{
+	return (p[0] << 8) | p[1];
+}
+
+static
+unsigned char *
+readfile(const char *path, size_t *lenret)
+{
+	unsigned char *buf;
+	long len;
+	FILE *f;
+
+	f = fopen(path, "rb");
+	if (f == NULL) {
+		err(1, "%s", path);
+	}
+	if (fseek(f, 0, SEEK_END) < 0 || (len = ftell(f)) < 0) {
+		err(1, "%s: seek", path);
+	}
+	rewind(f);
+	buf = malloc(len + 1);
+	if (buf == NULL) {
+		err(1, "malloc");
+	}
+	if (fread(buf, 1, len, f) != (size_t)len) {
+		errx(1, "%s: short read", path);
+	}
+	fclose(f);
+	*lenret = len;
+	return buf;
+}
+
+static
+int
+compare_symbols(const void *a, const void *b)
+{
+	const struct symbol *x = a, *y = b;
+
+	if (x->addr != y->addr) {
+		return x->addr < y->addr ? -1 : 1;
+	}
+	return 0;
+}
+
+/*
+ * Load the code symbols of an ELF file. Assembler routines often have
+ * no type, so untyped symbols are taken too, less local labels.
+ */
+static
+void
+loadsymbols(const char *path, struct symtab *st)
+{
+	unsigned char *img, *sh, *sym;
+	const char *strs, *name;
+	size_t len, off, size, strsize;
+	unsigned i, j, shnum, shentsize, type;
+
+	img = readfile(path, &len);
+	if (len < 52 || memcmp(img, "\177ELF", 4) != 0 || img[4] != 1 ||
+	    img[5] != 2) {
+		errx(1, "%s: not a 32-bit big-endian ELF file", path);
+	}
+
+	st->syms = NULL;
+	st->nsyms = 0;
+	shnum = get16(img + EH_SHNUM);
+	shentsize = get16(img + EH_SHENTSIZE);
+	for (i=0; i<shnum; i++) {
+		sh = img + get32(img + EH_SHOFF) + i * shentsize;
+		if (sh + shentsize > img + len) {
+			errx(1, "%s: bad section header", path);
+		}
+		if (get32(sh + SH_TYPE) != SHT_SYMTAB) {
+			continue;
+		}
+		off = get32(sh + SH_OFFSET);
+		size = get32(sh + SH_SIZE);
+
+		/* the string table is the section sh_link names */
+		sh = img + get32(img + EH_SHOFF) +
+			get32(sh + SH_LINK) * shentsize;
+		strs = (const char *)img + get32(sh + SH_OFFSET);
+		strsize = get32(sh + SH_SIZE);
+		if (off + size > len ||
+		    (const unsigned char *)strs + strsize > img + len) {
+			errx(1, "%s: bad symbol table", path);
+		}
+
+		st->syms = realloc(st->syms, (st->nsyms + size / SYM_SIZE) *
+				   sizeof(struct symbol));
+		if (st->syms == NULL) {
+			err(1, "realloc");
+		}
+		for (j=0; j<size / SYM_SIZE; j++) {
+			sym = img + off + j * SYM_SIZE;
+			type = sym[12] & 0xf;
+			if (type != STT_FUNC && type != STT_NOTYPE) {
+				continue;
+			}
+			if (get16(sym + 14) == 0 || get32(sym + 4) == 0 ||
+			    get32(sym) >= strsize) {
+				/* undefined, or no address */
+				continue;
+			}
+			name = strs + get32(sym);
+			if (name[0] == 0 || name[0] == '$' || name[0] == '.') {
+				continue;
+			}
+			st->syms[st->nsyms].addr = get32(sym + 4);
+			st->syms[st->nsyms].name = name;
+			st->syms[st->nsyms].count = 0;
+			st->nsyms++;
+		}
+	}
+	if (st->nsyms == 0) {
+		errx(1, "%s: no symbols", path);
+	}
+	qsort(st->syms, st->nsyms, sizeof(struct symbol), compare_symbols);
+}
+
+/*
+ * Find the symbol at or below PC.
+ */
+static
+struct symbol *
+lookup(struct symtab *st, uint32_t pc)
+{
+	unsigned lo, hi, mid;
+
+	if (st->nsyms == 0 || pc < st->syms[0].addr) {
+		return NULL;
+	}
+	lo = 0;
+	hi = st->nsyms;
+	while (hi - lo > 1) {
+		mid = (lo + hi) / 2;
+		if (st->syms[mid].addr <= pc) {
+			lo = mid;
+		}
+		else {
+			hi = mid;
+		}
+	}
+	return &st->syms[lo];
+}
+
+static
+int
+compare_pcs(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static
+int
+compare_counts(const void *a, const void *b)
+{
+	const struct symbol *x = *(struct symbol *const *)a;
+	const struct symbol *y = *(struct symbol *const *)b;
+
+	if (x->count != y->count) {
+		return x->count > y->count ? -1 : 1;
+	}
+	return strcmp(x->name, y->name);
+}
+
+static
+void
+usage(void)
+{
+	errx(1, "Usage: profdump [-a] [-n count] [-u program] "
+	     "kernel profile");
+}
+
+int
+main(int argc, char **argv)
+{
+	struct prof_header ph;
+	struct symtab kst, ust;
+	struct symbol unknown = { 0, "(unknown)", 0 };
+	struct symbol user = { 0, "(user)", 0 };
+	struct symbol **order, *sym;
+	struct hit *hits;
+	unsigned char *img;
+	uint32_t *pcs;
+	size_t len;
+	unsigned long i, j, n, nhits, nsyms, kernel;
+	unsigned top = 30;
+	const char *userprog = NULL;
+	int ch, byaddr = 0;
+
+#ifdef HOST
+	hostcompat_init(argc, argv);
+#endif
+
+	while ((ch = getopt(argc, argv, "an:u:")) != -1) {
+		switch (ch) {
+		    case 'a':
+			byaddr = 1;
+			break;
+		    case 'n':
+			top = atoi(optarg);
+			break;
+		    case 'u':
+			userprog = optarg;
+			break;
+		    default:
+			usage();
+		}
+	}
+	if (optind != argc - 2) {
+		usage();
+	}
+
+	loadsymbols(argv[optind], &kst);
+	ust.syms = NULL;
+	ust.nsyms = 0;
+	if (userprog != NULL) {
+		loadsymbols(userprog, &ust);
+	}
+
+	img = readfile(argv[optind+1], &len);
+	if (len < sizeof(ph)) {
+		errx(1, "%s: short file", argv[optind+1]);
+	}
+	ph.ph_magic = get32(img);
+	ph.ph_ncpus = get32(img + 4);
+	ph.ph_hz = get32(img + 8);
+	ph.ph_nsamples = get32(img + 12);
+	ph.ph_dropped = get32(img + 16);
+	if (ph.ph_magic != PROF_MAGIC) {
+		errx(1, "%s: not a profile dump", argv[optind+1]);
+	}
+	n = ph.ph_nsamples;
+	if (len < sizeof(ph) + n * 4) {
+		errx(1, "%s: short file", argv[optind+1]);
+	}
+	if (n == 0) {
+		printf("No samples\n");
+		return 0;
+	}
+
+	pcs = malloc(n * sizeof(uint32_t));
+	if (pcs == NULL) {
+		err(1, "malloc");
+	}
+	for (i=0; i<n; i++) {
+		pcs[i] = get32(img + sizeof(ph) + i * 4);
+	}
+	qsort(pcs, n, sizeof(uint32_t), compare_pcs);
+
+	/* Collapse to distinct addresses and charge them to symbols */
+	hits = malloc(n * sizeof(struct hit));
+	if (hits == NULL) {
+		err(1, "malloc");
+	}
+	nhits = 0;
+	kernel = 0;
+	for (i=0; i<n; i++) {
+		if (nhits > 0 && hits[nhits-1].pc == pcs[i]) {
+			hits[nhits-1].count++;
+		}
+		else {
+			hits[nhits].pc = pcs[i];
+			hits[nhits].count = 1;
+			nhits++;
+		}
+	}
+	for (i=0; i<nhits; i++) {
+		if (hits[i].pc >= USERLIMIT) {
+			sym = lookup(&kst, hits[i].pc);
+			kernel += hits[i].count;
+		}
+		else if (userprog != NULL) {
+			sym = lookup(&ust, hits[i].pc);
+		}
+		else {
+			sym = &user;
+		}
+		if (sym == NULL) {
+			sym = &unknown;
+		}
+		sym->count += hits[i].count;
+		hits[i].sym = sym;
+	}
+
+	nsyms = kst.nsyms + ust.nsyms + 2;
+	order = malloc(nsyms * sizeof(struct symbol *));
+	if (order == NULL) {
+		err(1, "malloc");
+	}
+	nsyms = 0;
+	for (i=0; i<kst.nsyms; i++) {
+		if (kst.syms[i].count > 0) {
+			order[nsyms++] = &kst.syms[i];
+		}
+	}
+	for (i=0; i<ust.nsyms; i++) {
+		if (ust.syms[i].count > 0) {
+			order[nsyms++] = &ust.syms[i];
+		}
+	}
+	if (user.count > 0) {
+		order[nsyms++] = &user;
+	}
+	if (unknown.count > 0) {
+		order[nsyms++] = &unknown;
+	}
+	qsort(order, nsyms, sizeof(struct symbol *), compare_counts);
+
+	printf("%lu samples from %u cpus at %u Hz (%u more not kept)\n",
+	       n, ph.ph_ncpus, ph.ph_hz, ph.ph_dropped);
+	printf("%lu kernel (%.1f%%), %lu user (%.1f%%)\n\n",
+	       kernel, 100.0 * kernel / n, n - kernel,
+	       100.0 * (n - kernel) / n);
+
+	if (top == 0 || top > nsyms) {
+		top = nsyms;
+	}
+	printf("%8s %6s  %s\n", "samples", "%", "function");
+	for (i=0; i<top; i++) {
+		printf("%8lu %5.1f%%  %s\n", order[i]->count,
+		       100.0 * order[i]->count / n, order[i]->name);
+		if (!byaddr) {
+			continue;
+		}
+		for (j=0; j<nhits; j++) {
+			if (hits[j].sym == order[i]) {
+				printf("%8lu         0x%08x\n", hits[j].count,
+				       (unsigned)hits[j].pc);
+			}
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,409 @@
+/*
+ * tracedump - decode a kernel trace dump on the host.
+ *
+ * Usage: hostbin/host-tracedump [-l] [-m mhz] tracefile
+ *
+ * Reads a file written by the kernel menu's "trace dump" command
+ * (format in <kern/trace.h>). By default prints how many of each
+ * event there were and, for each kind of interval the events mark
+ * out, a histogram of their lengths in powers of two microseconds:
+ *
+ *    syscall  - system call entry to return, per thread;
+ *    fault    - vm_fault entry to return, per thread;
+ *    sleep    - wchan sleep to the wakeup of the same thread;
+ *    runqueue - wakeup to the thread next being switched to;
+ *    disk     - disk request to completion, per disk.
+ *
+ * With -l, lists every record instead. -m gives the cpu clock rate
+ * in MHz (default 25, as System/161 is normally configured).
+ *
+ * Timestamps come from each cpu's cycle counter and are only roughly
+ * comparable between cpus, so intervals that start on one cpu and
+ * end on another are approximate.
+ */
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+
+#include "kern/trace.h"
+
+#ifdef HOST
+#include <netinet/in.h> // for arpa/inet.h
+#include <arpa/inet.h>  // for ntohl
+#include "hostcompat.h"
+#define SWAPL(x) ntohl(x)
+#define SWAPS(x) ntohs(x)
+#else
+#define SWAPL(x) (x)
+#define SWAPS(x) (x)
+#endif
+
+#define NBUCKETS	32
+
+/* A decoded record */
+struct event {
+	uint64_t cycles;
+	unsigned event, cpu;
+	uint32_t thread, arg1, arg2;
+};
+
+/* The kinds of interval */
+enum { IV_SYSCALL, IV_FAULT, IV_SLEEP, IV_RUNQ, IV_DISK, IV_NKINDS };
+
+static const char *const ivnames[IV_NKINDS] = {
+	"syscall", "fault", "sleep", "runqueue", "disk",
+};
+
+static const char *const evnames[TREV_NEVENTS] = {
+	"?", "switch", "sleep", "wake", "syscall", "sysret",
+	"fault", "faultdone", "diskio", "diskdone",
+};
+
+struct histogram {
+	unsigned long count;
+	uint64_t total, min, max;	/* in cycles */
+	unsigned long buckets[NBUCKETS];
+};
+
+/* Interval starts waiting for their end, by kind and key */
+struct pending {
+	int inuse;
+	unsigned kind;
+	uint32_t key;
+	uint64_t start;
+};
+
+static struct histogram histograms[IV_NKINDS];
+static struct pending *pending;
+static unsigned long pendingsize;	/* power of 2 */
+static unsigned long evcounts[TREV_NEVENTS];
+static unsigned mhz = 25;
+
+/*
+ * Make the table of pending intervals. Each interval starts with a
+ * record, so with room for twice the number of records it can never
+ * be more than half full.
+ */
+static
+void
+initpending(unsigned long nrecords)
+{
+	pendingsize = 1024;
+	while (pendingsize < 2 * nrecords) {
+		pendingsize *= 2;
+	}
+	pending = calloc(pendingsize, sizeof(*pending));
+	if (pending == NULL) {
+		err(1, "malloc");
+	}
+}
+
+static
+unsigned long
+pendinghash(unsigned kind, uint32_t key)
+{
+	return (key * 2654435761U + kind) & (pendingsize - 1);
+}
+
+static
+struct pending *
+findpending(unsigned kind, uint32_t key, int create)
+{
+	unsigned long i, h;
+
+	h = pendinghash(kind, key);
+	for (i=0; i<pendingsize; i++) {
+		struct pending *p = &pending[(h + i) & (pendingsize - 1)];
+		if (p->inuse && p->kind == kind && p->key == key) {
+			return p;
+		}
+		if (!p->inuse) {
+			if (!create) {
+				return NULL;
+			}
+			p->inuse = 1;
+			p->kind = kind;
+			p->key = key;
+			return p;
+		}
+	}
+	errx(1, "Too many intervals in progress");
+	return NULL;
+}
+
+/*
+ * Delete P from the table. This is linear probing, so move later
+ * entries of the same run back into the hole wherever their probe
+ * sequence allows, rather than leave a tombstone that would never
+ * be reused.
+ */
+static
+void
+droppending(struct pending *p)
+{
+	unsigned long hole, j, home;
+
+	hole = p - pending;
+	j = hole;
+	while (1) {
+		j = (j + 1) & (pendingsize - 1);
+		if (!pending[j].inuse) {
+			break;
+		}
+		home = pendinghash(pending[j].kind, pending[j].key);
+		/* Can't move it if its home lies after the hole. */
+		if (((j - home) & (pendingsize - 1)) <
+		    ((j - hole) & (pendingsize - 1))) {
+			continue;
+		}
+		pending[hole] = pending[j];
+		hole = j;
+	}
+	pending[hole].inuse = 0;
+}
+
+static
+void
+ivstart(unsigned kind, uint32_t key, uint64_t now)
+{
+	/* A second start for the same key replaces the first. */
+	findpending(kind, key, 1)->start = now;
+}
+
+static
+void
+ivend(unsigned kind, uint32_t key, uint64_t now)
+{
+	struct histogram *h = &histograms[kind];
+	struct pending *p;
+	uint64_t len, us;
+	unsigned b;
+
+	p = findpending(kind, key, 0);
+	if (p == NULL) {
+		/* started before the trace did */
+		return;
+	}
+	len = now > p->start ? now - p->start : 0;
+	droppending(p);
+
+	if (h->count == 0 || len < h->min) {
+		h->min = len;
+	}
+	if (len > h->max) {
+		h->max = len;
+	}
+	h->count++;
+	h->total += len;
+
+	us = len / mhz;
+	for (b = 0; us > 0 && b < NBUCKETS - 1; b++) {
+		us >>= 1;
+	}
+	h->buckets[b]++;
+}
+
+static
+void
+account(const struct event *ev)
+{
+	switch (ev->event) {
+	    case TREV_SYSCALL:
+		ivstart(IV_SYSCALL, ev->thread, ev->cycles);
+		break;
+	    case TREV_SYSRET:
+		ivend(IV_SYSCALL, ev->thread, ev->cycles);
+		break;
+	    case TREV_FAULT:
+		ivstart(IV_FAULT, ev->thread, ev->cycles);
+		break;
+	    case TREV_FAULTDONE:
+		ivend(IV_FAULT, ev->thread, ev->cycles);
+		break;
+	    case TREV_SLEEP:
+		ivstart(IV_SLEEP, ev->thread, ev->cycles);
+		break;
+	    case TREV_WAKE:
+		ivend(IV_SLEEP, ev->arg2, ev->cycles);
+		ivstart(IV_RUNQ, ev->arg2, ev->cycles);
+		break;
+	    case TREV_SWITCH:
+		ivend(IV_RUNQ, ev->arg1, ev->cycles);
+		break;
+	    case TREV_DISKIO:
+		ivstart(IV_DISK, ev->arg1, ev->cycles);
+		break;
+	    case TREV_DISKDONE:
+		ivend(IV_DISK, ev->arg1, ev->cycles);
+		break;
+	}
+}
+
+static
+void
+printhistogram(const char *name, const struct histogram *h)
+{
+	unsigned long most;
+	unsigned b, i, width;
+
+	printf("%s: %lu intervals", name, h->count);
+	if (h->count == 0) {
+		printf("\n\n");
+		return;
+	}
+	printf(", min %llu us, avg %llu us, max %llu us\n",
+	       (unsigned long long)(h->min / mhz),
+	       (unsigned long long)(h->total / h->count / mhz),
+	       (unsigned long long)(h->max / mhz));
+
+	most = 0;
+	for (b=0; b<NBUCKETS; b++) {
+		if (h->buckets[b] > most) {
+			most = h->buckets[b];
+		}
+	}
+	for (b=0; b<NBUCKETS; b++) {
+		if (h->buckets[b] == 0) {
+			continue;
+		}
+		if (b == 0) {
+			printf("    %10s < 1 us  ", "");
+		}
+		else {
+			printf("    %10lu - %-6lu", 1UL << (b-1), (1UL << b) - 1);
+		}
+		printf(" %8lu ", h->buckets[b]);
+		width = (unsigned)(h->buckets[b] * 40 / most);
+		for (i=0; i<width; i++) {
+			putchar('#');
+		}
+		putchar('\n');
+	}
+	putchar('\n');
+}
+
+static
+int
+compare_events(const void *a, const void *b)
+{
+	const struct event *x = a, *y = b;
+
+	if (x->cycles != y->cycles) {
+		return x->cycles < y->cycles ? -1 : 1;
+	}
+	return 0;
+}
+
+static
+void
+usage(void)
+{
+	errx(1, "Usage: tracedump [-l] [-m mhz] tracefile");
+}
+
+int
+main(int argc, char **argv)
+{
+	struct trace_header th;
+	struct trace_record tr;
+	struct event *evs;
+	unsigned long i, n;
+	unsigned k;
+	int ch, list = 0;
+	FILE *f;
+
+#ifdef HOST
+	hostcompat_init(argc, argv);
+#endif
+
+	while ((ch = getopt(argc, argv, "lm:")) != -1) {
+		switch (ch) {
+		    case 'l':
+			list = 1;
+			break;
+		    case 'm':
+			mhz = atoi(optarg);
+			if (mhz == 0) {
+				usage();
+			}
+			break;
+		    default:
+			usage();
+		}
+	}
+	if (optind != argc - 1) {
+		usage();
+	}
+
+	f = fopen(argv[optind], "rb");
+	if (f == NULL) {
+		err(1, "%s", argv[optind]);
+	}
+	if (fread(&th, sizeof(th), 1, f) != 1) {
+		errx(1, "%s: short file", argv[optind]);
+	}
+	if (SWAPL(th.th_magic) != TRACE_MAGIC) {
+		errx(1, "%s: not a trace dump", argv[optind]);
+	}
+	n = SWAPL(th.th_nrecords);
+
+	evs = malloc(n * sizeof(*evs) + 1);
+	if (evs == NULL) {
+		err(1, "malloc");
+	}
+	for (i=0; i<n; i++) {
+		if (fread(&tr, sizeof(tr), 1, f) != 1) {
+			errx(1, "%s: short file", argv[optind]);
+		}
+		evs[i].cycles = ((uint64_t)SWAPL(tr.tr_cycles_hi) << 32) |
+			SWAPL(tr.tr_cycles_lo);
+		evs[i].event = SWAPS(tr.tr_event);
+		evs[i].cpu = SWAPS(tr.tr_cpu);
+		evs[i].thread = SWAPL(tr.tr_thread);
+		evs[i].arg1 = SWAPL(tr.tr_arg1);
+		evs[i].arg2 = SWAPL(tr.tr_arg2);
+		if (evs[i].event >= TREV_NEVENTS) {
+			evs[i].event = 0;
+		}
+	}
+	fclose(f);
+
+	qsort(evs, n, sizeof(*evs), compare_events);
+
+	printf("%lu records from %u cpus, %u overwritten before the dump\n\n",
+	       n, (unsigned)SWAPL(th.th_ncpus), (unsigned)SWAPL(th.th_dropped));
+
+	if (list) {
+		for (i=0; i<n; i++) {
+			printf("%14llu cpu%-2u %08x %-10s 0x%08x 0x%08x\n",
+			       (unsigned long long)evs[i].cycles, evs[i].cpu,
+			       evs[i].thread, evnames[evs[i].event],
+			       evs[i].arg1, evs[i].arg2);
+		}
+		free(evs);
+		return 0;
+	}
+
+	initpending(n);
+	for (i=0; i<n; i++) {
+		evcounts[evs[i].event]++;
+		account(&evs[i]);
+	}
+
+	for (k=1; k<TREV_NEVENTS; k++) {
+		printf("%-10s %10lu\n", evnames[k], evcounts[k]);
+	}
+	printf("\n");
+	for (k=0; k<IV_NKINDS; k++) {
+		printhistogram(ivnames[k], &histograms[k]);
+	}
+
+	free(pending);
+	free(evs);
+	return 0;
+}
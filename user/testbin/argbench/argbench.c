@@ -0,0 +1,144 @@
+/*
+ * argbench - execv argument passing benchmark.
+ *
+ * Usage: argbench [count [nargs [arglen]]]
+ *
+ * Runs /testbin/argtest COUNT times (default 50) with NARGS arguments
+ * (default 64) of ARGLEN characters each (default 200), forking and
+ * waiting for each one, and reports the average time per run. Then
+ * does the same with no arguments, so the difference is the cost of
+ * getting the arguments through execv: copying the strings in with
+ * copyinstr and out to the new process's stack.
+ *
+ * argtest prints all its arguments; its output goes to null: so the
+ * console doesn't dominate the timing.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <err.h>
+
+#define PROG		"/testbin/argtest"
+#define DEFAULT_COUNT	50
+#define DEFAULT_NARGS	64
+#define DEFAULT_ARGLEN	200
+#define MAXARGS		500
+#define MAXARGLEN	1000
+
+static char *args[MAXARGS + 2];
+
+/*
+ * Run argtest with args[] once.
+ */
+static
+void
+runone(void)
+{
+	pid_t pid;
+	int status, fd;
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		/* reopen stdout (fd 1, the lowest free) on null: */
+		close(STDOUT_FILENO);
+		fd = open("null:", O_WRONLY);
+		if (fd != STDOUT_FILENO) {
+			_exit(2);
+		}
+		execv(PROG, args);
+		_exit(3);
+	}
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "%s failed (status 0x%x)", PROG, status);
+	}
+}
+
+/*
+ * Run it COUNT times and return the average in microseconds.
+ */
+static
+unsigned long
+run(unsigned count)
+{
+	time_t s0, s1;
+	unsigned long ns0, ns1;
+	unsigned i;
+
+	__time(&s0, &ns0);
+	for (i=0; i<count; i++) {
+		runone();
+	}
+	__time(&s1, &ns1);
+	return ((s1 - s0) * 1000000UL + ns1 / 1000 - ns0 / 1000) / count;
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned count, nargs, arglen, i, cut;
+	unsigned long withargs, without;
+	char *arg;
+
+	count = DEFAULT_COUNT;
+	nargs = DEFAULT_NARGS;
+	arglen = DEFAULT_ARGLEN;
+	if (argc > 4) {
+		errx(1, "Usage: argbench [count [nargs [arglen]]]");
+	}
+	if (argc > 1) {
+		count = atoi(argv[1]);
+		if (count == 0) {
+			errx(1, "count must be positive");
+		}
+	}
+	if (argc > 2) {
+		nargs = atoi(argv[2]);
+		if (nargs > MAXARGS) {
+			errx(1, "at most %u args", MAXARGS);
+		}
+	}
+	if (argc > 3) {
+		arglen = atoi(argv[3]);
+		if (arglen > MAXARGLEN) {
+			errx(1, "at most %u characters per arg", MAXARGLEN);
+		}
+	}
+
+	args[0] = (char *)PROG;
+	for (i=0; i<nargs; i++) {
+		arg = malloc(arglen + 1);
+		if (arg == NULL) {
+			errx(1, "Out of memory");
+		}
+		/* vary the lengths a little, so the alignments vary */
+		cut = i % 4 < arglen ? i % 4 : arglen;
+		memset(arg, 'a' + i % 26, arglen);
+		arg[arglen - cut] = 0;
+		args[i+1] = arg;
+	}
+	args[nargs+1] = NULL;
+
+	withargs = run(count);
+	args[1] = NULL;
+	without = run(count);
+
+	printf("%u runs of argtest: %lu us each with %u args of about "
+	       "%u chars, %lu us with none\n", count, withargs, nargs,
+	       arglen, without);
+	if (withargs > without) {
+		printf("Argument passing: %lu us per exec\n",
+		       withargs - without);
+	}
+	return 0;
+}
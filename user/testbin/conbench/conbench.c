@@ -0,0 +1,98 @@
+/*
+ * conbench - console output throughput benchmark.
+ *
+ * Usage: conbench [kilobytes]
+ *
+ * Writes KILOBYTES (default 1024) of text to the console, first in
+ * 4k writes and then in writes of a single line, and reports the
+ * throughput of each. The text is lines of 64 characters that count
+ * up, so lost or repeated output shows.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+
+#define DEFAULT_KB	1024
+#define LINELEN		64
+#define BLOCKSIZE	4096
+
+static char block[BLOCKSIZE];
+
+static
+void
+fill(unsigned lineno)
+{
+	unsigned i;
+
+	for (i=0; i<BLOCKSIZE; i += LINELEN) {
+		snprintf(block + i, LINELEN, "%08u ", lineno++);
+		memset(block + i + 9, 'a' + lineno % 26, LINELEN - 10);
+		block[i + LINELEN - 1] = '\n';
+	}
+}
+
+static
+unsigned long
+run(unsigned kb, size_t chunk)
+{
+	time_t s0, s1;
+	unsigned long ns0, ns1, usecs;
+	unsigned i;
+	size_t off;
+	ssize_t r;
+
+	__time(&s0, &ns0);
+	for (i=0; i<kb * 1024 / BLOCKSIZE; i++) {
+		fill(i * (BLOCKSIZE / LINELEN));
+		for (off = 0; off < BLOCKSIZE; off += chunk) {
+			r = write(STDOUT_FILENO, block + off, chunk);
+			if (r < 0) {
+				err(1, "write");
+			}
+			if ((size_t)r != chunk) {
+				errx(1, "short write (%ld of %lu)", (long)r,
+				     (unsigned long)chunk);
+			}
+		}
+	}
+	__time(&s1, &ns1);
+
+	usecs = (s1 - s0) * 1000000UL + ns1 / 1000 - ns0 / 1000;
+	if (usecs == 0) {
+		usecs = 1;
+	}
+	return usecs;
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned kb = DEFAULT_KB;
+	unsigned long blockus, lineus;
+
+	if (argc > 2) {
+		errx(1, "Usage: conbench [kilobytes]");
+	}
+	if (argc == 2) {
+		kb = atoi(argv[1]);
+		if (kb < BLOCKSIZE / 1024) {
+			errx(1, "need at least %d kilobytes", BLOCKSIZE / 1024);
+		}
+	}
+
+	blockus = run(kb, BLOCKSIZE);
+	lineus = run(kb, LINELEN);
+
+	printf("conbench: %uk in %d-byte writes: %lu us, %lu bytes/sec\n",
+	       kb, BLOCKSIZE, blockus,
+	       (unsigned long)((unsigned long long)kb * 1024 * 1000000
+			       / blockus));
+	printf("conbench: %uk in %d-byte writes: %lu us, %lu bytes/sec\n",
+	       kb, LINELEN, lineus,
+	       (unsigned long)((unsigned long long)kb * 1024 * 1000000
+			       / lineus));
+	return 0;
+}
@@ -0,0 +1,115 @@
+/*
+ * execbench - exec latency benchmark.
+ *
+ * Usage: execbench [count [nargs]]
+ *
+ * Execs itself COUNT times in a row (default 100), each time passing
+ * the start time and NARGS extra filler arguments (default 0), then
+ * reports the average time per exec. Running it with a larger NARGS
+ * shows how the cost of argument passing grows.
+ *
+ * Each exec checks that it received the arguments it was sent.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+
+#define PROG		"/testbin/execbench"
+#define DEFAULT_COUNT	100
+#define MAXARGS		500
+#define FILLER		"filler-argument-filler-argument"
+
+static char remstr[16], countstr[16], nargstr[16], secstr[16], nsecstr[16];
+static char *args[MAXARGS + 8];
+
+/*
+ * Exec the next round: execbench -r remaining count nargs sec nsec filler...
+ */
+static
+void
+next(unsigned remaining, unsigned count, unsigned nargs,
+     time_t secs, unsigned long nsecs)
+{
+	unsigned i;
+
+	snprintf(remstr, sizeof(remstr), "%u", remaining);
+	snprintf(countstr, sizeof(countstr), "%u", count);
+	snprintf(nargstr, sizeof(nargstr), "%u", nargs);
+	snprintf(secstr, sizeof(secstr), "%lu", (unsigned long)secs);
+	snprintf(nsecstr, sizeof(nsecstr), "%lu", nsecs);
+
+	args[0] = (char *)PROG;
+	args[1] = (char *)"-r";
+	args[2] = remstr;
+	args[3] = countstr;
+	args[4] = nargstr;
+	args[5] = secstr;
+	args[6] = nsecstr;
+	for (i=0; i<nargs; i++) {
+		args[7+i] = (char *)FILLER;
+	}
+	args[7+nargs] = NULL;
+
+	execv(PROG, args);
+	err(1, "%s", PROG);
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned count, nargs, remaining, i;
+	time_t s0, s1;
+	unsigned long ns0, ns1, usecs;
+
+	if (argc >= 7 && !strcmp(argv[1], "-r")) {
+		remaining = atoi(argv[2]);
+		count = atoi(argv[3]);
+		nargs = atoi(argv[4]);
+		s0 = atoi(argv[5]);
+		ns0 = atoi(argv[6]);
+
+		if ((unsigned)argc != 7 + nargs || argv[argc] != NULL) {
+			errx(1, "got %d args, expected %u", argc, 7 + nargs);
+		}
+		for (i=0; i<nargs; i++) {
+			if (strcmp(argv[7+i], FILLER)) {
+				errx(1, "argument %u garbled", 7+i);
+			}
+		}
+
+		if (remaining > 0) {
+			next(remaining - 1, count, nargs, s0, ns0);
+		}
+
+		__time(&s1, &ns1);
+		usecs = (s1 - s0) * 1000000UL + ns1 / 1000 - ns0 / 1000;
+		printf("%u execs with %u args: %lu us each\n", count,
+		       nargs + 7, usecs / count);
+		return 0;
+	}
+
+	count = DEFAULT_COUNT;
+	nargs = 0;
+	if (argc > 3) {
+		errx(1, "Usage: execbench [count [nargs]]");
+	}
+	if (argc > 1) {
+		count = atoi(argv[1]);
+		if (count == 0) {
+			errx(1, "count must be positive");
+		}
+	}
+	if (argc > 2) {
+		nargs = atoi(argv[2]);
+		if (nargs > MAXARGS) {
+			errx(1, "at most %u extra args", MAXARGS);
+		}
+	}
+
+	__time(&s0, &ns0);
+	next(count - 1, count, nargs, s0, ns0);
+	return 1;
+}
@@ -0,0 +1,165 @@
+/*
+ * mallocbench - malloc/free microbenchmark.
+ *
+ * Usage: mallocbench [iterations]
+ *
+ * Times three workloads and reports each as operations per second
+ * (an operation being one malloc plus one free):
+ *
+ *    pairs  - allocate and immediately free, cycling through sizes
+ *             from 8 bytes to 2k;
+ *    churn  - keep a pool of live blocks of random small sizes and
+ *             repeatedly replace a random one, as sort-style programs
+ *             do;
+ *    large  - allocate and free blocks of 8k to 32k.
+ *
+ * Each block is written to, and checked when freed, so that blocks
+ * handed out twice are noticed.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+
+#define DEFAULT_ITERS	20000
+#define POOLSIZE	256
+
+static void *pool[POOLSIZE];
+static size_t poolsize[POOLSIZE];
+
+static time_t s0;
+static unsigned long ns0;
+
+static
+void
+start(void)
+{
+	__time(&s0, &ns0);
+}
+
+static
+void
+stop(const char *what, unsigned ops)
+{
+	time_t s1;
+	unsigned long ns1, usecs;
+
+	__time(&s1, &ns1);
+	usecs = (s1 - s0) * 1000000UL + ns1 / 1000 - ns0 / 1000;
+	if (usecs == 0) {
+		usecs = 1;
+	}
+	printf("%-6s %7u ops in %8lu us: %lu ops/sec\n", what, ops, usecs,
+	       (unsigned long)((unsigned long long)ops * 1000000 / usecs));
+}
+
+static
+void *
+xmalloc(size_t size, unsigned char tag)
+{
+	unsigned char *p;
+
+	p = malloc(size);
+	if (p == NULL) {
+		errx(1, "malloc of %lu bytes failed", (unsigned long)size);
+	}
+	p[0] = tag;
+	p[size-1] = tag;
+	return p;
+}
+
+static
+void
+xfree(void *ptr, size_t size, unsigned char tag)
+{
+	unsigned char *p = ptr;
+
+	if (p[0] != tag || p[size-1] != tag) {
+		errx(1, "block at %p (%lu bytes) was overwritten", ptr,
+		     (unsigned long)size);
+	}
+	free(p);
+}
+
+static
+void
+pairs(unsigned iters)
+{
+	unsigned i;
+	size_t size;
+	void *p;
+
+	start();
+	for (i=0; i<iters; i++) {
+		size = (size_t)8 << (i % 9);
+		p = xmalloc(size, i);
+		xfree(p, size, i);
+	}
+	stop("pairs", iters);
+}
+
+static
+void
+churn(unsigned iters)
+{
+	unsigned i, slot;
+
+	for (i=0; i<POOLSIZE; i++) {
+		poolsize[i] = 1 + random() % 512;
+		pool[i] = xmalloc(poolsize[i], i);
+	}
+
+	start();
+	for (i=0; i<iters; i++) {
+		slot = random() % POOLSIZE;
+		xfree(pool[slot], poolsize[slot], slot);
+		poolsize[slot] = 1 + random() % 512;
+		pool[slot] = xmalloc(poolsize[slot], slot);
+	}
+	stop("churn", iters);
+
+	for (i=0; i<POOLSIZE; i++) {
+		xfree(pool[i], poolsize[i], i);
+	}
+}
+
+static
+void
+large(unsigned iters)
+{
+	unsigned i;
+	size_t size;
+	void *p;
+
+	start();
+	for (i=0; i<iters; i++) {
+		size = (size_t)8192 << (i % 3);
+		p = xmalloc(size, i);
+		xfree(p, size, i);
+	}
+	stop("large", iters);
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned iters = DEFAULT_ITERS;
+
+	if (argc > 2) {
+		errx(1, "Usage: mallocbench [iterations]");
+	}
+	if (argc == 2) {
+		iters = atoi(argv[1]);
+		if (iters == 0) {
+			errx(1, "iterations must be positive");
+		}
+	}
+
+	srandom(1);
+	pairs(iters);
+	churn(iters);
+	large(iters / 10 + 1);
+	return 0;
+}
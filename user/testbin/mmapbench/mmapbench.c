@@ -0,0 +1,237 @@
+/*
+ * mmapbench - compare reading a file with read() against touching
+ * it through mmap().
+ *
+ * Usage: mmapbench [filename [size]]
+ *
+ * Creates the file the way bigfile does, then times several passes
+ * that checksum it with read() and with a shared read-only mapping.
+ * The first mapped pass fills the page cache; later ones show the
+ * cost of mapping pages already cached. Finally it checks that stores
+ * through a shared mapping reach the file after msync().
+ *
+ * The default size, 1M, is 256 pages: well past the 64-entry TLB, so
+ * the mapped passes pay for TLB refills as well as page faults.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+
+#define DEFAULT_SIZE	(1024*1024)
+#define PASSES		4
+#define CHUNK		4096
+
+static char buffer[CHUNK];
+
+static
+void
+getnow(time_t *secs, unsigned long *nsecs)
+{
+	if (__time(secs, nsecs) == (time_t)-1) {
+		err(1, "__time");
+	}
+}
+
+/* Microseconds since S0/NS0. */
+static
+unsigned long
+elapsed(time_t s0, unsigned long ns0)
+{
+	time_t s1;
+	unsigned long ns1;
+
+	getnow(&s1, &ns1);
+	return (s1 - s0) * 1000000UL + ns1 / 1000 - ns0 / 1000;
+}
+
+static
+void
+report(const char *what, int pass, size_t size, unsigned long usecs)
+{
+	if (usecs == 0) {
+		usecs = 1;
+	}
+	printf("%-6s pass %d: %lu us, %lu KB/s\n", what, pass, usecs,
+	       (unsigned long)(size / 1024) * 1000000UL / usecs);
+}
+
+static
+void
+makefile(const char *filename, size_t size)
+{
+	size_t i, len;
+	int fd, r;
+
+	fd = open(filename, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s: create", filename);
+	}
+	for (i=0; i<CHUNK; i++) {
+		buffer[i] = 'a' + i % 26;
+	}
+	for (i=0; i<size; i+=len) {
+		len = size - i < CHUNK ? size - i : CHUNK;
+		r = write(fd, buffer, len);
+		if (r < 0) {
+			err(1, "%s: write", filename);
+		}
+		if ((size_t)r != len) {
+			errx(1, "%s: short write", filename);
+		}
+	}
+	close(fd);
+}
+
+static
+unsigned
+sum_read(const char *filename, size_t size)
+{
+	unsigned sum = 0;
+	size_t done, i;
+	int fd, r;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s: open", filename);
+	}
+	for (done=0; done<size; done+=r) {
+		r = read(fd, buffer, CHUNK);
+		if (r < 0) {
+			err(1, "%s: read", filename);
+		}
+		if (r == 0) {
+			errx(1, "%s: unexpected EOF", filename);
+		}
+		for (i=0; i<(size_t)r; i++) {
+			sum += (unsigned char)buffer[i];
+		}
+	}
+	close(fd);
+	return sum;
+}
+
+static
+unsigned
+sum_mmap(const char *filename, size_t size)
+{
+	unsigned sum = 0;
+	const unsigned char *p;
+	size_t i;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s: open", filename);
+	}
+	p = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED) {
+		err(1, "%s: mmap", filename);
+	}
+	close(fd);
+
+	for (i=0; i<size; i++) {
+		sum += p[i];
+	}
+
+	if (munmap((void *)p, size)) {
+		err(1, "munmap");
+	}
+	return sum;
+}
+
+/*
+ * Store through a shared mapping, msync, and make sure read() sees it.
+ */
+static
+void
+check_coherence(const char *filename, size_t size)
+{
+	char *p;
+	size_t i;
+	int fd;
+
+	fd = open(filename, O_RDWR);
+	if (fd < 0) {
+		err(1, "%s: open", filename);
+	}
+	p = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED) {
+		err(1, "%s: mmap", filename);
+	}
+	for (i=0; i<size; i+=CHUNK) {
+		p[i] = 'Z';
+	}
+	if (msync(p, size, MS_SYNC)) {
+		err(1, "msync");
+	}
+
+	for (i=0; i<size; i+=CHUNK) {
+		if (lseek(fd, i, SEEK_SET) < 0) {
+			err(1, "%s: lseek", filename);
+		}
+		if (read(fd, buffer, 1) != 1) {
+			err(1, "%s: read", filename);
+		}
+		if (buffer[0] != 'Z') {
+			errx(1, "%s: offset %lu: store not written back",
+			     filename, (unsigned long)i);
+		}
+	}
+
+	if (munmap(p, size)) {
+		err(1, "munmap");
+	}
+	close(fd);
+	printf("msync: stores visible to read()\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *filename = "mmapbench.dat";
+	size_t size = DEFAULT_SIZE;
+	unsigned rsum, msum;
+	time_t s0;
+	unsigned long ns0;
+	int pass;
+
+	if (argc > 3) {
+		errx(1, "Usage: mmapbench [filename [size]]");
+	}
+	if (argc > 1) {
+		filename = argv[1];
+	}
+	if (argc > 2) {
+		size = atoi(argv[2]);
+		if (size == 0) {
+			errx(1, "Size must be positive");
+		}
+	}
+
+	printf("Creating %s, %lu bytes\n", filename, (unsigned long)size);
+	makefile(filename, size);
+
+	rsum = msum = 0;
+	for (pass=0; pass<PASSES; pass++) {
+		getnow(&s0, &ns0);
+		rsum = sum_read(filename, size);
+		report("read", pass, size, elapsed(s0, ns0));
+
+		getnow(&s0, &ns0);
+		msum = sum_mmap(filename, size);
+		report("mmap", pass, size, elapsed(s0, ns0));
+
+		if (rsum != msum) {
+			errx(1, "Checksum mismatch: read %u, mmap %u",
+			     rsum, msum);
+		}
+	}
+
+	check_coherence(filename, size);
+	return 0;
+}
@@ -0,0 +1,103 @@
+/*
+ * nullsys - system call overhead benchmark.
+ *
+ * Usage: nullsys [iterations]
+ *
+ * Times ITERATIONS (default 100000) calls each of:
+ *
+ *    getpid  - about the least work a system call can do;
+ *    close   - close(-1), which fails at once with EBADF, to time
+ *              the error return;
+ *    lseek   - a seek on our own executable, whose 64-bit offset and
+ *              third argument come in through the register pair and
+ *              the user stack.
+ *
+ * and reports the cost of each in nanoseconds per call. The lseek
+ * results are checked, to catch mistakes in 64-bit argument passing.
+ */
+
+#include <sys/types.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+
+#define DEFAULT_ITERS	100000
+
+static time_t s0;
+static unsigned long ns0;
+
+static
+void
+start(void)
+{
+	__time(&s0, &ns0);
+}
+
+static
+void
+stop(const char *what, unsigned iters)
+{
+	time_t s1;
+	unsigned long ns1;
+	unsigned long long ns;
+
+	__time(&s1, &ns1);
+	ns = (unsigned long long)(s1 - s0) * 1000000000ULL + ns1 - ns0;
+	printf("%-7s %8u calls in %10llu ns: %llu ns each\n", what, iters,
+	       ns, ns / iters);
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned iters = DEFAULT_ITERS, i;
+	off_t pos, got;
+	int fd;
+
+	if (argc > 2) {
+		errx(1, "Usage: nullsys [iterations]");
+	}
+	if (argc == 2) {
+		iters = atoi(argv[1]);
+		if (iters == 0) {
+			errx(1, "iterations must be positive");
+		}
+	}
+
+	start();
+	for (i=0; i<iters; i++) {
+		getpid();
+	}
+	stop("getpid", iters);
+
+	start();
+	for (i=0; i<iters; i++) {
+		if (close(-1) != -1 || errno != EBADF) {
+			errx(1, "close(-1) did not fail with EBADF");
+		}
+	}
+	stop("close", iters);
+
+	fd = open(argv[0], O_RDONLY);
+	if (fd < 0) {
+		warn("%s: skipping lseek", argv[0]);
+		return 0;
+	}
+	start();
+	for (i=0; i<iters; i++) {
+		/* something with bits in both halves */
+		pos = ((off_t)(i & 7) << 32) | i;
+		got = lseek(fd, pos, SEEK_SET);
+		if (got != pos) {
+			errx(1, "lseek to %lld gave %lld", (long long)pos,
+			     (long long)got);
+		}
+	}
+	stop("lseek", iters);
+	close(fd);
+
+	return 0;
+}
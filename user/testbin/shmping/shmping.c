@@ -0,0 +1,122 @@
+/*
+ * shmping - ping-pong between two processes through shared memory.
+ *
+ * Usage: shmping [rounds]
+ *
+ * Maps a page with MAP_ANON|MAP_SHARED, forks, and bounces a token
+ * back and forth by spinning on a word in the shared page. Reports
+ * the average round-trip time. Also checks that the child sees what
+ * the parent wrote before the fork and that the parent sees what the
+ * child writes afterwards.
+ *
+ * With a single CPU, each handoff waits for the spinning process to
+ * use up its time slice, so expect the latency to be about two
+ * scheduler quanta; with more CPUs it measures the cost of the
+ * shared page itself.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <err.h>
+
+#define DEFAULT_ROUNDS	1000
+#define MAGIC		0x5ca1ab1e
+
+struct shared {
+	volatile unsigned turn;		/* 0: parent's move, 1: child's */
+	volatile unsigned round;
+	volatile unsigned magic;	/* set by the parent before fork */
+	volatile unsigned reply;	/* set by the child */
+};
+
+static
+void
+child(struct shared *sh, unsigned rounds)
+{
+	unsigned i;
+
+	if (sh->magic != MAGIC) {
+		errx(1, "child: shared page not inherited (0x%x)", sh->magic);
+	}
+	sh->reply = MAGIC;
+
+	for (i=0; i<rounds; i++) {
+		while (sh->turn != 1) {
+			/* spin */
+		}
+		sh->round = i;
+		sh->turn = 0;
+	}
+	_exit(0);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct shared *sh;
+	unsigned rounds, i;
+	time_t s0, s1;
+	unsigned long ns0, ns1, usecs;
+	int status;
+	pid_t pid;
+
+	rounds = DEFAULT_ROUNDS;
+	if (argc > 2) {
+		errx(1, "Usage: shmping [rounds]");
+	}
+	if (argc == 2) {
+		rounds = atoi(argv[1]);
+		if (rounds == 0) {
+			errx(1, "rounds must be positive");
+		}
+	}
+
+	sh = mmap(NULL, sizeof(*sh), PROT_READ|PROT_WRITE,
+		  MAP_SHARED|MAP_ANON, -1, 0);
+	if (sh == MAP_FAILED) {
+		err(1, "mmap");
+	}
+	if (sh->turn != 0 || sh->reply != 0) {
+		errx(1, "anonymous memory not zeroed");
+	}
+	sh->magic = MAGIC;
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		child(sh, rounds);
+	}
+
+	__time(&s0, &ns0);
+	for (i=0; i<rounds; i++) {
+		sh->turn = 1;
+		while (sh->turn != 0) {
+			/* spin */
+		}
+		if (sh->round != i) {
+			errx(1, "round %u: child reports %u", i, sh->round);
+		}
+	}
+	__time(&s1, &ns1);
+
+	if (sh->reply != MAGIC) {
+		errx(1, "child's store not visible to parent");
+	}
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+
+	usecs = (s1 - s0) * 1000000UL + ns1 / 1000 - ns0 / 1000;
+	printf("%u round trips in %lu us: %lu us each\n", rounds, usecs,
+	       usecs / rounds);
+
+	if (munmap(sh, sizeof(*sh))) {
+		err(1, "munmap");
+	}
+	return 0;
+}
@@ -0,0 +1,99 @@
+/*
+ * sleeptest - check nanosleep.
+ *
+ * Usage: sleeptest [nprocs]
+ *
+ * Sleeps for a range of times from 1 ms to 1.5 s and checks that each
+ * sleep lasted at least as long as asked, reporting how much longer
+ * it took. The timer ticks every 10 ms, so overshoots of up to about
+ * two ticks are expected.
+ *
+ * With NPROCS, forks that many children that all sleep at once first,
+ * so that the parent's timings are taken with other sleepers around.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <err.h>
+
+static const unsigned long sleeps[] = {	/* usec */
+	1000, 10000, 15000, 50000, 100000, 250000, 1500000,
+};
+#define NSLEEPS (sizeof(sleeps) / sizeof(sleeps[0]))
+#define MAXPROCS 32
+
+static pid_t pids[MAXPROCS];
+
+static
+void
+dosleep(unsigned long usecs)
+{
+	struct timespec ts;
+
+	ts.tv_sec = usecs / 1000000;
+	ts.tv_nsec = (usecs % 1000000) * 1000;
+	if (nanosleep(&ts, NULL)) {
+		err(1, "nanosleep");
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	time_t s0, s1;
+	unsigned long ns0, ns1, took;
+	unsigned i, nprocs = 0;
+	struct timespec bad;
+	int status;
+
+	if (argc > 2) {
+		errx(1, "Usage: sleeptest [nprocs]");
+	}
+	if (argc == 2) {
+		nprocs = atoi(argv[1]);
+		if (nprocs > MAXPROCS) {
+			errx(1, "at most %d processes", MAXPROCS);
+		}
+	}
+
+	bad.tv_sec = 0;
+	bad.tv_nsec = 1000000000;
+	if (nanosleep(&bad, NULL) == 0) {
+		errx(1, "nanosleep accepted tv_nsec of 1000000000");
+	}
+
+	for (i=0; i<nprocs; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			err(1, "fork");
+		}
+		if (pids[i] == 0) {
+			dosleep(3000000);
+			_exit(0);
+		}
+	}
+
+	for (i=0; i<NSLEEPS; i++) {
+		__time(&s0, &ns0);
+		dosleep(sleeps[i]);
+		__time(&s1, &ns1);
+		took = (s1 - s0) * 1000000UL + ns1 / 1000 - ns0 / 1000;
+		if (took < sleeps[i]) {
+			errx(1, "asked for %lu us, slept %lu us", sleeps[i],
+			     took);
+		}
+		printf("asked for %7lu us, slept %7lu us (+%lu)\n",
+		       sleeps[i], took, took - sleeps[i]);
+	}
+
+	for (i=0; i<nprocs; i++) {
+		if (waitpid(pids[i], &status, 0) < 0) {
+			err(1, "waitpid");
+		}
+	}
+	printf("sleeptest: passed\n");
+	return 0;
+}
@@ -0,0 +1,100 @@
+/*
+ * spawnbench - process spawn latency benchmark.
+ *
+ * Usage: spawnbench [count]
+ *
+ * Starts COUNT children (default 100) one after another, waiting for
+ * each, and reports the average time per child for four ways of
+ * doing it:
+ *
+ *    fork+exit   - fork, child calls _exit at once;
+ *    vfork+exit  - the same with vfork;
+ *    fork+exec   - fork, child execs /bin/true, as the shell did;
+ *    vfork+exec  - the same with vfork, as the shell does now.
+ *
+ * The parent first touches a buffer of BUFPAGES pages, so fork has
+ * something like a shell's worth of memory to copy; vfork shouldn't
+ * care how big the parent is.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+
+#define PROG		"/bin/true"
+#define DEFAULT_COUNT	100
+#define BUFPAGES	32
+#define PAGE		4096
+
+static char buf[BUFPAGES * PAGE];
+
+static
+void
+spawn(unsigned count, int usevfork, int doexec, const char *what)
+{
+	char *args[2];
+	time_t s0, s1;
+	unsigned long ns0, ns1, usecs;
+	unsigned i;
+	int status;
+	pid_t pid;
+
+	args[0] = (char *)PROG;
+	args[1] = NULL;
+
+	__time(&s0, &ns0);
+	for (i=0; i<count; i++) {
+		pid = usevfork ? vfork() : fork();
+		if (pid < 0) {
+			err(1, "%s", what);
+		}
+		if (pid == 0) {
+			if (doexec) {
+				execv(PROG, args);
+			}
+			_exit(doexec ? 1 : 0);
+		}
+		if (waitpid(pid, &status, 0) < 0) {
+			err(1, "waitpid");
+		}
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			errx(1, "%s: child %u failed", what, i);
+		}
+	}
+	__time(&s1, &ns1);
+
+	usecs = (s1 - s0) * 1000000UL + ns1 / 1000 - ns0 / 1000;
+	printf("%-10s %5u children in %8lu us: %lu us each\n", what, count,
+	       usecs, usecs / count);
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned count = DEFAULT_COUNT;
+	unsigned i;
+
+	if (argc > 2) {
+		errx(1, "Usage: spawnbench [count]");
+	}
+	if (argc == 2) {
+		count = atoi(argv[1]);
+		if (count == 0) {
+			errx(1, "count must be positive");
+		}
+	}
+
+	for (i=0; i<BUFPAGES; i++) {
+		buf[i * PAGE] = 1;
+	}
+
+	spawn(count, 0, 0, "fork+exit");
+	spawn(count, 1, 0, "vfork+exit");
+	spawn(count, 0, 1, "fork+exec");
+	spawn(count, 1, 1, "vfork+exec");
+	return 0;
+}
@@ -0,0 +1,65 @@
+/*
+ * stackgrow.c
+ *
+ * 	Recurses deeply enough to need several hundred kilobytes of
+ *	stack, checking on the way back up that every frame kept its
+ *	contents.
+ *
+ * The stack starts out one page long and has to grow on demand for
+ * this to work. With an argument of "overflow" it recurses without
+ * limit instead, and should die on the guard page below the stack
+ * rather than run into the heap.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <err.h>
+
+#define FRAMESIZE	1024
+#define DEPTH		400	/* about 400k of stack */
+
+static
+unsigned
+recurse(unsigned depth, unsigned limit)
+{
+	volatile unsigned char frame[FRAMESIZE];
+	unsigned i, sum;
+
+	for (i=0; i<FRAMESIZE; i++) {
+		frame[i] = (unsigned char)(depth + i);
+	}
+
+	sum = depth;
+	if (limit == 0 || depth < limit) {
+		sum += recurse(depth + 1, limit);
+	}
+
+	for (i=0; i<FRAMESIZE; i++) {
+		if (frame[i] != (unsigned char)(depth + i)) {
+			errx(1, "frame at depth %u corrupted", depth);
+		}
+	}
+	return sum;
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned sum;
+
+	if (argc == 2 && !strcmp(argv[1], "overflow")) {
+		printf("Recursing until the stack overflows - "
+		       "I should die\n");
+		recurse(0, 0);
+		printf("I didn't get killed!  Program has a bug\n");
+		return 1;
+	}
+
+	sum = recurse(0, DEPTH);
+	if (sum != DEPTH * (DEPTH + 1) / 2) {
+		errx(1, "wrong sum %u", sum);
+	}
+	printf("stackgrow: %u frames of %u bytes: passed\n", DEPTH + 1,
+	       FRAMESIZE);
+	return 0;
+}
@@ -0,0 +1,110 @@
+/*
+ * tlbbench - TLB refill cost microbenchmark.
+ *
+ * Usage: tlbbench [accesses]
+ *
+ * Touches one word on each of a set of pages, round and round, and
+ * reports the average time per access for two set sizes:
+ *
+ *    fits   - 16 pages, which stay in the TLB, so after the first
+ *             pass every access hits;
+ *    spills - 256 pages, four times the size of the TLB, so nearly
+ *             every access misses and needs a refill.
+ *
+ * The difference between the two is roughly the cost of one TLB
+ * refill. All the pages are faulted in beforehand, so the refills
+ * measured are of pages already in the page table, which the kernel
+ * handles in its UTLB fast path. Run it with the vmstats output on
+ * to check that the refills did not go through vm_fault.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <err.h>
+
+#define PAGESIZE	4096
+#define NPAGES		256
+#define FITPAGES	16
+#define DEFAULT_ACCESSES 200000
+
+static volatile unsigned pages[NPAGES][PAGESIZE / sizeof(unsigned)];
+
+/*
+ * Make ACCESSES accesses to the first NUM pages and return the number
+ * of nanoseconds they took.
+ */
+static
+unsigned long long
+sweep(unsigned num, unsigned accesses)
+{
+	time_t s0, s1;
+	unsigned long ns0, ns1;
+	unsigned i, page;
+
+	__time(&s0, &ns0);
+	page = 0;
+	for (i=0; i<accesses; i++) {
+		pages[page][0]++;
+		if (++page == num) {
+			page = 0;
+		}
+	}
+	__time(&s1, &ns1);
+
+	return (unsigned long long)(s1 - s0) * 1000000000ULL + ns1 - ns0;
+}
+
+static
+void
+report(const char *what, unsigned num, unsigned accesses,
+       unsigned long long ns)
+{
+	printf("%-6s %3u pages: %u accesses in %llu us, %llu ns each\n",
+	       what, num, accesses, ns / 1000, ns / accesses);
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned accesses = DEFAULT_ACCESSES;
+	unsigned long long fits, spills;
+	unsigned i, total;
+
+	if (argc > 2) {
+		errx(1, "Usage: tlbbench [accesses]");
+	}
+	if (argc == 2) {
+		accesses = atoi(argv[1]);
+		if (accesses == 0) {
+			errx(1, "accesses must be positive");
+		}
+	}
+
+	/* Fault everything in first, so only refills are timed. */
+	for (i=0; i<NPAGES; i++) {
+		pages[i][0] = 0;
+	}
+
+	/* Warm up the small set, then time both. */
+	sweep(FITPAGES, FITPAGES);
+	fits = sweep(FITPAGES, accesses);
+	spills = sweep(NPAGES, accesses);
+
+	total = 0;
+	for (i=0; i<NPAGES; i++) {
+		total += pages[i][0];
+	}
+	if (total != FITPAGES + 2 * accesses) {
+		errx(1, "lost updates: %u, expected %u", total,
+		     FITPAGES + 2 * accesses);
+	}
+
+	report("fits", FITPAGES, accesses, fits);
+	report("spills", NPAGES, accesses, spills);
+	if (spills > fits) {
+		printf("about %llu ns per TLB refill\n",
+		       (spills - fits) / accesses);
+	}
+	return 0;
+}